@@ -0,0 +1,55 @@
+# generate an include/dashboard.h file holding the web/ dashboard, gzipped so
+# the firmware can send it straight from flash as a gzip encoded response
+
+import gzip
+import hashlib
+
+INDEX_PATH = "web/index.html"
+SCRIPT_PATH = "web/dashboard.js"
+HEADER_PATH = "include/dashboard.h"
+
+def compress(data):
+    # mtime 0 keeps the output, and so the header, stable between builds
+    return gzip.compress(data, compresslevel=9, mtime=0)
+
+def byte_array(name, data):
+    lines = [", ".join("0x%02x" % b for b in data[i:i + 16]) for i in range(0, len(data), 16)]
+    return "const uint8_t %s[] PROGMEM = {\n  %s\n};\n" % (name, ",\n  ".join(lines))
+
+def make_dashboard_header():
+    script = open(SCRIPT_PATH, "rb").read()
+
+    # the script is cached for good under a name that changes with its content
+    script_hash = hashlib.sha1(script).hexdigest()[:8]
+    script_path = "/dashboard.%s.js" % script_hash
+    index = open(INDEX_PATH, "rb").read().replace(b"%DASHBOARD_SCRIPT%", script_path.encode())
+
+    index_gzip = compress(index)
+    script_gzip = compress(script)
+    index_etag = hashlib.sha1(index_gzip).hexdigest()[:16]
+
+    print("dashboard = %s %d bytes (%d gzipped), %s %d bytes (%d gzipped)" % (
+        INDEX_PATH, len(index), len(index_gzip), SCRIPT_PATH, len(script), len(script_gzip)))
+
+    header = "// do not edit this file - automatically generated from web/ during build\n\n"
+    header += "#pragma once\n\n"
+    header += "#define DASHBOARD_INDEX_ETAG \"\\\"%s\\\"\"\n" % index_etag
+    header += "#define DASHBOARD_INDEX_GZIP_LENGTH %d\n" % len(index_gzip)
+    header += "#define DASHBOARD_SCRIPT_ETAG \"\\\"%s\\\"\"\n" % script_hash
+    header += "#define DASHBOARD_SCRIPT_PATH \"%s\"\n" % script_path
+    header += "#define DASHBOARD_SCRIPT_GZIP_LENGTH %d\n\n" % len(script_gzip)
+    header += byte_array("DASHBOARD_INDEX_GZIP", index_gzip) + "\n"
+    header += byte_array("DASHBOARD_SCRIPT_GZIP", script_gzip)
+
+    # only touch the file when the dashboard changed, to spare a rebuild
+    try:
+        if open(HEADER_PATH).read() == header:
+            return
+    except FileNotFoundError:
+        pass
+
+    f = open(HEADER_PATH, "w")
+    f.write(header)
+    f.close()
+
+make_dashboard_header()
@@ -0,0 +1,172 @@
+// do not edit this file - automatically generated from web/ during build
+
+#pragma once
+
+#define DASHBOARD_INDEX_ETAG "\"096a6e411d1c5419\""
+#define DASHBOARD_INDEX_GZIP_LENGTH 695
+#define DASHBOARD_SCRIPT_ETAG "\"8af7f6e5\""
+#define DASHBOARD_SCRIPT_PATH "/dashboard.8af7f6e5.js"
+#define DASHBOARD_SCRIPT_GZIP_LENGTH 1795
+
+const uint8_t DASHBOARD_INDEX_GZIP[] PROGMEM = {
+  0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0x7d, 0x54, 0x4d, 0x6f, 0x9c, 0x30,
+  0x10, 0xbd, 0xe7, 0x57, 0x4c, 0x59, 0xb5, 0x6a, 0xa5, 0xb0, 0xc0, 0x26, 0xd9, 0xa4, 0xc0, 0x72,
+  0x89, 0x54, 0xf5, 0x92, 0x4b, 0x23, 0xf5, 0x3e, 0xe0, 0x01, 0x9c, 0x82, 0x8d, 0x6c, 0xb3, 0x9b,
+  0x6d, 0xd5, 0xff, 0xde, 0x31, 0xb0, 0xd9, 0x24, 0x87, 0x1e, 0x90, 0xe1, 0xcd, 0x9b, 0x37, 0x9f,
+  0x26, 0xff, 0x20, 0x74, 0xe5, 0x8e, 0x03, 0x41, 0xeb, 0xfa, 0xae, 0xb8, 0xc8, 0xfd, 0x01, 0x1d,
+  0xaa, 0x66, 0x17, 0x90, 0x0a, 0x3c, 0x40, 0x28, 0xf8, 0xe8, 0xc9, 0x21, 0x54, 0x2d, 0x1a, 0x4b,
+  0x6e, 0x17, 0x8c, 0xae, 0x0e, 0xef, 0x82, 0x13, 0xac, 0xb0, 0xa7, 0x5d, 0xb0, 0x97, 0x74, 0x18,
+  0xb4, 0x71, 0x01, 0x54, 0x5a, 0x39, 0x52, 0x4c, 0x3b, 0x48, 0xe1, 0xda, 0x9d, 0xa0, 0xbd, 0xac,
+  0x28, 0x9c, 0x3e, 0x2e, 0x41, 0x2a, 0xe9, 0x24, 0x76, 0xa1, 0xad, 0xb0, 0xa3, 0x5d, 0xe2, 0x45,
+  0x9c, 0x74, 0x1d, 0x15, 0x3f, 0x34, 0x5a, 0x07, 0x0f, 0xe4, 0xc8, 0xe4, 0xd1, 0x0c, 0x5d, 0xe4,
+  0xd6, 0x1d, 0xfd, 0x59, 0x6a, 0x71, 0x84, 0x3f, 0x50, 0xb3, 0x70, 0x58, 0x63, 0x2f, 0xbb, 0x63,
+  0x0a, 0xf6, 0x68, 0x1d, 0xf5, 0xe1, 0x28, 0x2f, 0xc1, 0xa2, 0xb2, 0xa1, 0x25, 0x23, 0xeb, 0x0c,
+  0x7a, 0x7c, 0x9e, 0x43, 0xa5, 0x70, 0x1d, 0x1b, 0xea, 0x3d, 0x62, 0x1a, 0xa9, 0x52, 0x88, 0x01,
+  0x47, 0xa7, 0x33, 0x18, 0x50, 0x08, 0xa9, 0x9a, 0x14, 0x92, 0xc9, 0x5c, 0x62, 0xf5, 0xab, 0x31,
+  0x7a, 0x54, 0x22, 0x85, 0x55, 0x7d, 0x5b, 0x5f, 0x11, 0x65, 0x5c, 0x42, 0xa7, 0x0d, 0x7f, 0x6f,
+  0xca, 0x44, 0x24, 0xd7, 0x19, 0xfc, 0xbd, 0x68, 0x93, 0x53, 0x02, 0x56, 0xfe, 0x26, 0x76, 0x5e,
+  0x5f, 0x4d, 0xee, 0x6c, 0xd9, 0xbc, 0xb3, 0xbc, 0x8b, 0x1a, 0xc3, 0xfa, 0x66, 0xa1, 0x5a, 0xaa,
+  0x9c, 0xd4, 0x8a, 0xf9, 0x6f, 0xa3, 0xd6, 0x9c, 0x78, 0xa9, 0x8d, 0x20, 0x13, 0x1a, 0x14, 0x72,
+  0xb4, 0xe9, 0xc9, 0xe7, 0x5d, 0xb2, 0xb3, 0x6a, 0x58, 0x6a, 0xe7, 0x74, 0xff, 0x52, 0x81, 0x7e,
+  0x0e, 0x6d, 0x8b, 0x42, 0x1f, 0x7c, 0xb8, 0x64, 0x78, 0x86, 0x2b, 0x7e, 0x56, 0x71, 0x1c, 0x6f,
+  0x7c, 0xd0, 0x15, 0x36, 0xce, 0x4c, 0x41, 0x5f, 0x25, 0x79, 0x3d, 0x79, 0x4e, 0xc0, 0x81, 0x64,
+  0xd3, 0xba, 0x14, 0xb6, 0x71, 0x9c, 0x41, 0x27, 0x15, 0x85, 0xed, 0x82, 0x24, 0x93, 0xbb, 0x75,
+  0xe8, 0xe8, 0x12, 0x56, 0x16, 0xf7, 0x24, 0x58, 0xe5, 0xd4, 0x9b, 0x5b, 0xdc, 0x6e, 0x6f, 0x6e,
+  0x3d, 0xa5, 0x42, 0xb5, 0x47, 0xcb, 0xa6, 0xa5, 0xf1, 0x49, 0x1c, 0x7f, 0xcc, 0xe0, 0x45, 0x65,
+  0xb3, 0x54, 0xdf, 0x61, 0x49, 0x1d, 0xb3, 0x84, 0xb4, 0x43, 0x87, 0x3c, 0xc2, 0xba, 0xa3, 0xe7,
+  0x0c, 0x9e, 0x46, 0xeb, 0x64, 0x7d, 0x0c, 0x97, 0xb5, 0xe1, 0xc9, 0x0e, 0xc8, 0xfb, 0x52, 0x92,
+  0x3b, 0x10, 0xa9, 0x0c, 0xb0, 0x93, 0x8d, 0x0a, 0x25, 0x0f, 0x9b, 0xdb, 0x52, 0x31, 0x83, 0xcc,
+  0xb9, 0xbd, 0xd3, 0x14, 0x20, 0xf6, 0xf2, 0x52, 0x0d, 0xa3, 0x3b, 0x27, 0xf1, 0x75, 0x89, 0x5a,
+  0x8e, 0xdc, 0x2b, 0x5f, 0xfd, 0xd2, 0x3b, 0xa7, 0x87, 0xf4, 0x3c, 0x91, 0x3c, 0x5a, 0x56, 0x2c,
+  0x8f, 0x96, 0x4d, 0xf7, 0xbb, 0xe6, 0xf7, 0x3e, 0x01, 0x29, 0x76, 0x81, 0xdf, 0xed, 0xe0, 0xed,
+  0x6e, 0xb6, 0x89, 0x5f, 0xcc, 0x79, 0x92, 0xfc, 0x26, 0xe4, 0x7e, 0x62, 0xce, 0x5d, 0x0e, 0x8a,
+  0x30, 0xcc, 0x23, 0xc6, 0x5e, 0x59, 0xa6, 0x06, 0x06, 0xc5, 0xbd, 0x56, 0xca, 0x7b, 0xa9, 0xe6,
+  0x44, 0x88, 0xce, 0x2a, 0xe7, 0xb7, 0x76, 0x53, 0x7c, 0x97, 0xd6, 0x69, 0x73, 0xe4, 0x50, 0x1b,
+  0x06, 0x96, 0xee, 0x7a, 0xa5, 0x76, 0x36, 0x04, 0x45, 0x1e, 0xcd, 0xe8, 0x7f, 0x44, 0x1e, 0xc9,
+  0xf9, 0x58, 0x76, 0x51, 0xa9, 0xb5, 0xe9, 0xe7, 0x6c, 0x16, 0xdc, 0x8b, 0x78, 0xd0, 0x97, 0x3c,
+  0xb7, 0xc8, 0xff, 0x07, 0xd8, 0x3e, 0x96, 0xbd, 0xe4, 0x5b, 0xec, 0x6d, 0xaf, 0xd9, 0x8f, 0x3c,
+  0xfe, 0x3c, 0x9a, 0xa9, 0x05, 0xe4, 0x3c, 0x24, 0x35, 0xeb, 0xf9, 0xb5, 0xf0, 0x62, 0x1e, 0x79,
+  0x9b, 0xcf, 0x50, 0xe4, 0x08, 0xad, 0xa1, 0x7a, 0x17, 0x44, 0x9d, 0x6e, 0xd6, 0x95, 0xdd, 0x07,
+  0xc5, 0x03, 0xa1, 0x1d, 0xb9, 0xfb, 0x3c, 0x48, 0x60, 0x10, 0x3e, 0xdf, 0x3f, 0xfe, 0xfc, 0x92,
+  0x47, 0x58, 0xc0, 0xa7, 0x5e, 0x0a, 0xa1, 0x5d, 0x06, 0x67, 0xaf, 0x71, 0x10, 0x53, 0xef, 0xbe,
+  0x49, 0xd3, 0x1f, 0xd0, 0x10, 0xcc, 0x80, 0xa7, 0xe7, 0xd1, 0xe0, 0x4b, 0xae, 0x8c, 0x1c, 0x1c,
+  0x58, 0x53, 0x31, 0x5b, 0xa0, 0x6d, 0x4b, 0x8d, 0x46, 0xac, 0xef, 0x90, 0x6f, 0xf2, 0x96, 0x6e,
+  0xd6, 0x4f, 0x53, 0x9d, 0x33, 0xcb, 0x27, 0xb7, 0x4c, 0x37, 0x9a, 0x7f, 0x77, 0xff, 0x00, 0x58,
+  0x57, 0x07, 0xa9, 0xff, 0x04, 0x00, 0x00
+};
+
+const uint8_t DASHBOARD_SCRIPT_GZIP[] PROGMEM = {
+  0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0x7d, 0x57, 0x7b, 0x4f, 0xdb, 0x48,
+  0x10, 0xff, 0x3f, 0x9f, 0x62, 0x4f, 0x87, 0xe4, 0x4d, 0x09, 0x26, 0x09, 0x94, 0x56, 0xa4, 0xb9,
+  0x2a, 0x25, 0xa1, 0x70, 0xc7, 0x4b, 0x49, 0xb8, 0xea, 0xc4, 0x45, 0xb0, 0xb1, 0xd7, 0xc4, 0x87,
+  0xb3, 0x6b, 0xd9, 0xeb, 0x84, 0x88, 0xe6, 0xbb, 0xdf, 0xec, 0x2b, 0x5e, 0x07, 0xa8, 0x84, 0x88,
+  0x3d, 0xaf, 0x9d, 0xf9, 0xcd, 0x63, 0xc7, 0xfb, 0xfb, 0xe8, 0x22, 0x5e, 0x50, 0x94, 0x51, 0x12,
+  0xc6, 0xec, 0x11, 0x45, 0x19, 0x9f, 0xa3, 0x7d, 0xba, 0xa0, 0x4c, 0xe4, 0x0d, 0x34, 0x8b, 0x73,
+  0xc1, 0xb3, 0x95, 0xa1, 0x26, 0xfc, 0xd1, 0x67, 0xe1, 0x7f, 0x39, 0x67, 0x88, 0xb0, 0x10, 0xe5,
+  0x54, 0x08, 0x50, 0xc9, 0x15, 0xb7, 0xb6, 0xbf, 0x8f, 0xf6, 0x2d, 0xc5, 0x47, 0x03, 0x69, 0x00,
+  0x18, 0x64, 0x4e, 0x73, 0x14, 0x90, 0x0c, 0x6c, 0x88, 0x19, 0x45, 0xdf, 0x2e, 0x06, 0xf7, 0xb7,
+  0xb7, 0xe7, 0xfd, 0xfb, 0xcb, 0x41, 0x6f, 0x74, 0x3b, 0x1c, 0x5c, 0x0e, 0xae, 0xc6, 0x28, 0x21,
+  0x2b, 0x5e, 0x08, 0xbf, 0xe6, 0x15, 0x39, 0x45, 0xb9, 0xc8, 0xe2, 0x40, 0x78, 0x9d, 0x5a, 0x2d,
+  0xe0, 0x2c, 0x17, 0xe8, 0x74, 0xd8, 0xbb, 0x1c, 0xdc, 0x9f, 0x0d, 0x7a, 0xfd, 0xc1, 0xf0, 0xfe,
+  0x62, 0x70, 0xf5, 0x7d, 0x7c, 0x86, 0xba, 0xa8, 0xdd, 0x31, 0xec, 0xe1, 0xe0, 0xe4, 0x7a, 0xd8,
+  0x2f, 0x19, 0xad, 0x23, 0xcb, 0xe9, 0x7d, 0x1f, 0x0f, 0xaf, 0xaf, 0xee, 0x47, 0x27, 0xbd, 0x8b,
+  0x81, 0x64, 0x34, 0x9b, 0x96, 0x33, 0x1a, 0xf7, 0xc6, 0x03, 0xeb, 0x41, 0x1f, 0x78, 0x07, 0x15,
+  0xce, 0x08, 0x28, 0x77, 0xde, 0x48, 0x90, 0x4c, 0xc6, 0xe2, 0x35, 0x90, 0xf7, 0x83, 0x64, 0x73,
+  0x89, 0x4d, 0x91, 0xca, 0xb7, 0x0b, 0x4e, 0x42, 0x44, 0x50, 0x4e, 0xe6, 0x69, 0x42, 0x25, 0xe1,
+  0x92, 0x92, 0xbc, 0xc8, 0xa4, 0xec, 0xc4, 0x1a, 0x3a, 0x3b, 0x1f, 0x8d, 0xaf, 0x87, 0xff, 0xdc,
+  0x6b, 0xf7, 0xa4, 0xc5, 0x76, 0x79, 0x7e, 0xc9, 0x3c, 0x1d, 0x0e, 0x46, 0x67, 0xf7, 0x97, 0x92,
+  0x7f, 0xd0, 0x6c, 0x4a, 0x09, 0x09, 0xe3, 0x15, 0x80, 0xd6, 0x00, 0x54, 0xa6, 0x34, 0x51, 0x38,
+  0xc7, 0x2c, 0x2d, 0x04, 0x00, 0x43, 0x53, 0xc4, 0x23, 0x04, 0xa9, 0x91, 0x09, 0x89, 0x69, 0x12,
+  0x96, 0x80, 0x23, 0x41, 0x9e, 0x68, 0x6e, 0xa3, 0x18, 0x8c, 0xc7, 0xe7, 0x57, 0xdf, 0x55, 0x1c,
+  0x35, 0x04, 0xb1, 0x4c, 0x13, 0x2a, 0x6d, 0x4a, 0x5f, 0xcd, 0x2f, 0x2b, 0x92, 0x64, 0xd2, 0x50,
+  0xcc, 0x84, 0x86, 0xdf, 0xb2, 0xf8, 0x71, 0x26, 0x18, 0xcd, 0x73, 0x15, 0x1f, 0x60, 0x32, 0x75,
+  0x29, 0x2d, 0x23, 0x19, 0x33, 0x41, 0xb3, 0x9c, 0x06, 0x22, 0xe6, 0xec, 0x86, 0xc3, 0x9b, 0x94,
+  0x3e, 0x77, 0x88, 0x28, 0x35, 0x54, 0xab, 0x11, 0xd2, 0x45, 0x4c, 0x24, 0x47, 0x4a, 0xf6, 0xdd,
+  0x17, 0xc2, 0x56, 0x9e, 0x11, 0x0a, 0x38, 0x8d, 0xa2, 0x38, 0x88, 0xa1, 0x60, 0x9a, 0x92, 0x75,
+  0x52, 0xbe, 0xa3, 0xe6, 0xfb, 0xb2, 0xad, 0x6d, 0xd9, 0xd6, 0xfb, 0xb2, 0xed, 0x6d, 0xd9, 0xf6,
+  0xfb, 0xb2, 0x07, 0xdb, 0xb2, 0x07, 0x5b, 0xb2, 0x71, 0x76, 0x1d, 0x45, 0x00, 0xbc, 0x8a, 0x7e,
+  0x08, 0x29, 0xb1, 0x2f, 0x8e, 0x0c, 0x79, 0x14, 0x19, 0x67, 0x7d, 0xe8, 0xa9, 0x29, 0x64, 0x50,
+  0x32, 0x7b, 0x8a, 0x82, 0x42, 0x87, 0x54, 0xb1, 0xe9, 0xca, 0x82, 0x55, 0x47, 0xce, 0x82, 0xc9,
+  0xb8, 0x88, 0xa3, 0xd5, 0x19, 0x85, 0xba, 0x9c, 0x52, 0xa2, 0x4e, 0xdc, 0xbc, 0x20, 0x9c, 0xd7,
+  0x8d, 0xe8, 0x64, 0xd3, 0x3a, 0x3b, 0x50, 0x00, 0x38, 0x0e, 0xeb, 0xa8, 0xfb, 0x07, 0x0a, 0x79,
+  0x50, 0xcc, 0x21, 0x1a, 0xff, 0x91, 0x8a, 0x41, 0x42, 0xe5, 0xe3, 0xb7, 0xd5, 0x79, 0x28, 0xd9,
+  0x20, 0x1f, 0x15, 0x4c, 0x27, 0x30, 0xa4, 0x01, 0x0f, 0xe9, 0xa9, 0x6c, 0x5b, 0x1c, 0x12, 0x41,
+  0xea, 0xe8, 0x05, 0xce, 0xd6, 0xe6, 0xa6, 0x2b, 0x01, 0xbd, 0xdc, 0x45, 0xb7, 0x90, 0xe3, 0xcf,
+  0xbd, 0x2c, 0x23, 0x2b, 0x5f, 0x36, 0x3e, 0x26, 0x82, 0x4f, 0xb5, 0x70, 0x03, 0xe1, 0x40, 0x9d,
+  0x16, 0xf8, 0xc1, 0x8c, 0x64, 0x27, 0x60, 0xaa, 0x27, 0x70, 0xb3, 0x0e, 0x47, 0x58, 0x23, 0x8b,
+  0x98, 0x2e, 0xc1, 0x06, 0x83, 0xff, 0x7d, 0x50, 0xf9, 0x1b, 0x5e, 0xb1, 0x32, 0xec, 0x4f, 0x8b,
+  0x28, 0xa2, 0x99, 0x23, 0x9a, 0x81, 0x2f, 0x59, 0x28, 0x4f, 0xbc, 0x9b, 0x48, 0x6a, 0xc4, 0x33,
+  0x84, 0x13, 0x2a, 0x50, 0x0c, 0xa4, 0x66, 0x07, 0x7e, 0xbe, 0x68, 0x9f, 0xee, 0x5a, 0x13, 0x78,
+  0xdb, 0xdd, 0xd5, 0xce, 0x5a, 0x75, 0x9d, 0x17, 0x10, 0x7d, 0x6b, 0x82, 0xec, 0x82, 0xf6, 0x87,
+  0xea, 0xf0, 0xe8, 0x28, 0x5d, 0x73, 0xa8, 0x9f, 0x16, 0xf9, 0x0c, 0x6b, 0x73, 0x40, 0x24, 0xcb,
+  0xf3, 0xe1, 0xb1, 0xf2, 0x5d, 0xe2, 0x27, 0x01, 0x38, 0x68, 0x63, 0x73, 0xc0, 0x2e, 0xfa, 0xdc,
+  0x40, 0x22, 0x2b, 0x68, 0xbd, 0x61, 0xc4, 0x75, 0xf2, 0x4b, 0x79, 0x68, 0x91, 0xd6, 0x51, 0x29,
+  0xde, 0x6a, 0x1b, 0x79, 0xb4, 0x5f, 0x19, 0x52, 0x56, 0x3d, 0x17, 0x44, 0xd0, 0x63, 0x13, 0x5a,
+  0xa9, 0x75, 0x38, 0xd1, 0x02, 0x6b, 0x05, 0xd1, 0xba, 0x26, 0x7d, 0x15, 0x45, 0xc6, 0xac, 0xcb,
+  0x9d, 0xda, 0xda, 0x49, 0x64, 0xc4, 0x93, 0x84, 0x2f, 0xd5, 0x14, 0xce, 0xb1, 0x9b, 0x45, 0x3d,
+  0xd9, 0x4d, 0x0a, 0x14, 0x7f, 0xc4, 0x8b, 0x2c, 0xa0, 0xd8, 0x33, 0x43, 0xdf, 0x53, 0xf6, 0xf5,
+  0xb3, 0x4f, 0xc2, 0x50, 0xc9, 0x5c, 0xc0, 0x3d, 0x40, 0x19, 0xcd, 0xb0, 0x37, 0x57, 0xc3, 0x4e,
+  0x15, 0x10, 0x14, 0x1c, 0x56, 0x72, 0x2a, 0xe7, 0x2e, 0xf6, 0x65, 0xea, 0xdc, 0x82, 0x52, 0xb2,
+  0xbe, 0xaa, 0x14, 0x0d, 0x76, 0x1c, 0x21, 0x6c, 0x01, 0x4f, 0x28, 0x7b, 0x14, 0x33, 0xd4, 0xed,
+  0x42, 0x6e, 0xeb, 0x26, 0x34, 0xa8, 0xcc, 0xd2, 0x66, 0x02, 0xa8, 0xe4, 0x32, 0x9f, 0x46, 0xe3,
+  0x6e, 0x4b, 0x73, 0x0f, 0xaa, 0x5f, 0x9b, 0xdd, 0xc1, 0xa6, 0xff, 0xbc, 0xba, 0x2f, 0xe8, 0xb3,
+  0x38, 0xe1, 0x30, 0xa3, 0x98, 0x54, 0xd5, 0x36, 0x7c, 0x85, 0xb0, 0x3a, 0x6a, 0xeb, 0x2a, 0xf8,
+  0x6a, 0x25, 0xb4, 0xbe, 0x2f, 0xf8, 0x69, 0xfc, 0x4c, 0x43, 0xdc, 0xaa, 0xa3, 0x63, 0xe4, 0xed,
+  0xed, 0x79, 0x9b, 0x03, 0x94, 0x89, 0x57, 0xf6, 0xf5, 0xfd, 0x71, 0xe7, 0x1e, 0x33, 0x41, 0x3f,
+  0x7f, 0x22, 0xef, 0x96, 0x3d, 0x31, 0xbe, 0x64, 0x4a, 0x7f, 0xed, 0x02, 0xcc, 0x01, 0xd4, 0x0c,
+  0x0a, 0x1b, 0x3a, 0x55, 0xa3, 0xf8, 0xbe, 0x71, 0x6f, 0x08, 0x01, 0x33, 0x26, 0x47, 0x2d, 0x5c,
+  0x35, 0x1d, 0xb4, 0xae, 0x66, 0x3c, 0x84, 0x2a, 0x3d, 0xd3, 0xd7, 0x35, 0x56, 0x73, 0x38, 0x77,
+  0xd3, 0x1e, 0x10, 0xb6, 0x20, 0x32, 0x21, 0x60, 0xde, 0x5c, 0xea, 0x9e, 0xdb, 0x6b, 0x72, 0x30,
+  0x03, 0x77, 0x19, 0xb3, 0x90, 0x2f, 0x7d, 0x39, 0xb7, 0x03, 0x7a, 0x03, 0xb1, 0x27, 0x43, 0xc5,
+  0x81, 0x18, 0x5a, 0x4a, 0x5a, 0x99, 0xf1, 0x97, 0x71, 0x28, 0x73, 0x65, 0x5f, 0x83, 0x44, 0x0e,
+  0xca, 0x1f, 0x8a, 0xf8, 0x41, 0xdb, 0x72, 0x84, 0x67, 0x54, 0xde, 0x25, 0xdb, 0xd2, 0x67, 0x9a,
+  0xba, 0x11, 0x2f, 0x3d, 0x95, 0x01, 0x3f, 0x3b, 0xf2, 0xd0, 0x41, 0x27, 0x9a, 0x86, 0xbd, 0x76,
+  0xb8, 0xf1, 0x5a, 0x12, 0xc0, 0x16, 0x4c, 0x40, 0xc0, 0x05, 0xa6, 0x4c, 0x03, 0xc1, 0x9f, 0xeb,
+  0x5f, 0xa3, 0xea, 0x80, 0xd2, 0x93, 0x15, 0xa7, 0xc1, 0xb1, 0x65, 0xf3, 0x05, 0xb5, 0x2b, 0xe5,
+  0x66, 0x8a, 0x8d, 0x2f, 0x75, 0xb1, 0x5d, 0x12, 0x31, 0xf3, 0xe1, 0xf2, 0xc7, 0xbe, 0xef, 0x5b,
+  0x54, 0xf7, 0x0c, 0x16, 0x4a, 0x72, 0x06, 0xb6, 0x5d, 0x51, 0xf2, 0xec, 0x8a, 0xee, 0xba, 0xa2,
+  0xcf, 0x6a, 0x1e, 0xab, 0x34, 0xe3, 0x18, 0x9a, 0x7f, 0xcb, 0x13, 0x30, 0x5b, 0xaf, 0x03, 0x20,
+  0x6e, 0x0c, 0xa5, 0xf2, 0x4a, 0x2a, 0x2f, 0x48, 0x22, 0xe7, 0x86, 0x9c, 0xb0, 0x15, 0x6c, 0xf7,
+  0x10, 0xd6, 0x3c, 0x78, 0xd2, 0xae, 0xcb, 0xe1, 0x82, 0xad, 0x6f, 0x1b, 0xa2, 0x63, 0x5e, 0x6b,
+  0xda, 0x90, 0x15, 0x98, 0xb0, 0x7a, 0xf1, 0x27, 0x3a, 0x12, 0xab, 0x84, 0xca, 0x72, 0xfb, 0xfd,
+  0xf3, 0xf4, 0x23, 0x69, 0x4f, 0x3d, 0x17, 0xef, 0x24, 0x66, 0xf4, 0x87, 0x49, 0x7e, 0xbb, 0x92,
+  0x6b, 0x23, 0x30, 0xa5, 0x8f, 0x31, 0xbb, 0x01, 0x24, 0xb0, 0xc2, 0xdb, 0x44, 0x08, 0xa3, 0x7b,
+  0x40, 0x82, 0x99, 0x71, 0xb2, 0x81, 0x36, 0x20, 0xa8, 0x76, 0x87, 0xb6, 0xb3, 0xea, 0x73, 0xbe,
+  0xa0, 0x63, 0x8e, 0x9f, 0x01, 0xa6, 0x06, 0x5a, 0x99, 0x78, 0x65, 0xf3, 0xb9, 0x0e, 0xbc, 0x16,
+  0xa8, 0x57, 0x8a, 0x42, 0xc7, 0x21, 0x1d, 0x70, 0x88, 0x51, 0x9c, 0x24, 0x65, 0x68, 0x9f, 0xc8,
+  0xd1, 0xd1, 0xc7, 0x4f, 0x95, 0xd0, 0x22, 0xae, 0xba, 0xec, 0x61, 0xe7, 0xa5, 0xb5, 0x89, 0x6c,
+  0x9d, 0x3e, 0xa3, 0x7c, 0x05, 0xa3, 0x6f, 0xbe, 0x57, 0xc4, 0x0f, 0x9d, 0x2d, 0x73, 0x63, 0x59,
+  0x92, 0x06, 0xe3, 0xcd, 0xa8, 0x68, 0x82, 0x5f, 0x87, 0x70, 0x13, 0x1f, 0x5a, 0x1b, 0xf5, 0x37,
+  0xd5, 0x74, 0x42, 0xb6, 0xb5, 0xb6, 0xb3, 0x7a, 0x58, 0x57, 0x3d, 0x4e, 0xf2, 0x15, 0x0b, 0xd0,
+  0xa6, 0xd3, 0x13, 0x58, 0x40, 0x6d, 0xa7, 0xeb, 0x1e, 0x17, 0xb0, 0x11, 0x56, 0xe7, 0x6f, 0x9e,
+  0xc2, 0x83, 0x8c, 0x95, 0x2c, 0x49, 0x0c, 0x8b, 0x38, 0x15, 0x00, 0xff, 0x83, 0xb3, 0xc1, 0x7f,
+  0x4d, 0x48, 0x2e, 0xba, 0x3b, 0x2f, 0x5b, 0x9b, 0xea, 0xfa, 0xc1, 0xcc, 0x66, 0x6d, 0xc8, 0x74,
+  0xa2, 0x36, 0x62, 0xad, 0xaa, 0xb9, 0x84, 0x8d, 0x9c, 0x3b, 0x76, 0x34, 0xfa, 0x69, 0x12, 0x43,
+  0xa7, 0xfe, 0x2b, 0xa7, 0x2f, 0x84, 0x0b, 0xdb, 0x21, 0xc6, 0x32, 0x6b, 0x2a, 0xe5, 0xea, 0x01,
+  0x9a, 0x24, 0x75, 0x68, 0x7f, 0x8e, 0xae, 0xaf, 0xfc, 0x94, 0xc0, 0x12, 0xa9, 0x69, 0x66, 0xf8,
+  0xea, 0x9c, 0xae, 0x01, 0x13, 0x70, 0x1d, 0x2e, 0x1a, 0x39, 0x26, 0xed, 0x0d, 0x0f, 0x4b, 0xf2,
+  0x5f, 0x34, 0x15, 0xa8, 0x60, 0x22, 0x4e, 0xd4, 0x87, 0x05, 0x93, 0x8e, 0x66, 0x34, 0x02, 0x1f,
+  0x67, 0xea, 0x7a, 0x7c, 0x1b, 0xb6, 0x91, 0xd9, 0x97, 0x2b, 0x57, 0xe2, 0x66, 0x89, 0xb6, 0x81,
+  0x62, 0x17, 0x34, 0x6f, 0xb3, 0x64, 0x7b, 0xf5, 0xba, 0x2f, 0xa1, 0xd3, 0xa1, 0xc3, 0x20, 0x65,
+  0x72, 0x99, 0xde, 0x1e, 0xd3, 0x9b, 0x6f, 0x20, 0xb3, 0x75, 0x3b, 0x53, 0x05, 0xda, 0x60, 0xae,
+  0x47, 0x70, 0x69, 0xd2, 0x6c, 0x36, 0x73, 0x3f, 0xa3, 0x69, 0x42, 0x02, 0x7a, 0x32, 0x8b, 0x93,
+  0x30, 0xa3, 0x6a, 0xe0, 0xd8, 0x45, 0x5e, 0x03, 0x76, 0xc7, 0xca, 0xef, 0x82, 0x86, 0xfa, 0x1c,
+  0x98, 0xbc, 0xba, 0x78, 0xf5, 0xa7, 0x42, 0xb7, 0x5c, 0xf7, 0x02, 0xf8, 0xae, 0x13, 0xd4, 0x6c,
+  0x7c, 0xd8, 0x53, 0x7c, 0xcf, 0x5e, 0xbf, 0xf2, 0xc5, 0x97, 0x56, 0xe5, 0x3a, 0xa0, 0x5c, 0x2d,
+  0xc9, 0x7a, 0x9c, 0x94, 0xe1, 0xa8, 0xd3, 0x27, 0xe5, 0xbd, 0xad, 0x3e, 0x47, 0x7e, 0x83, 0xf6,
+  0x95, 0x9f, 0x12, 0x36, 0x2f, 0x56, 0x59, 0xac, 0x52, 0xd5, 0x67, 0xac, 0x98, 0x4f, 0x69, 0x66,
+  0x6e, 0x4d, 0xcb, 0x54, 0x9a, 0x5d, 0x15, 0x80, 0x66, 0xac, 0xdd, 0x6b, 0x3e, 0xe3, 0xcb, 0x5f,
+  0xf8, 0xaf, 0x82, 0xb7, 0xfe, 0x83, 0xa8, 0x4f, 0xd2, 0x94, 0xb2, 0x10, 0x1b, 0x50, 0xd4, 0x01,
+  0x96, 0x6b, 0xb6, 0x23, 0xbe, 0xd4, 0x97, 0xee, 0x9b, 0xad, 0x94, 0x93, 0x05, 0xdd, 0xd4, 0x84,
+  0xd9, 0x65, 0x5e, 0xec, 0xed, 0xec, 0xa7, 0x99, 0xfa, 0xed, 0xd3, 0x88, 0x14, 0x89, 0xa9, 0xf8,
+  0x5f, 0x36, 0x98, 0x53, 0x2b, 0x0d, 0xb8, 0xca, 0xe7, 0x54, 0xcc, 0x78, 0x08, 0x9b, 0xc3, 0xcd,
+  0xf5, 0x68, 0x0c, 0x94, 0x29, 0x0f, 0x57, 0xc7, 0x6a, 0xf1, 0xba, 0x1d, 0x5e, 0x8c, 0xe0, 0xe6,
+  0x0a, 0x66, 0x37, 0x04, 0x56, 0xa3, 0x1c, 0x4b, 0xda, 0x29, 0x54, 0x81, 0xdc, 0x89, 0x71, 0xa5,
+  0x3e, 0x60, 0xfa, 0xad, 0x6d, 0xbd, 0x49, 0x6f, 0xc3, 0x57, 0x05, 0xb7, 0x69, 0x4b, 0xfe, 0x04,
+  0x93, 0xd4, 0x1b, 0x29, 0x21, 0x18, 0x99, 0xef, 0x36, 0xad, 0x5e, 0xbb, 0x36, 0x4a, 0x75, 0x99,
+  0xe3, 0x71, 0x3c, 0xa7, 0xf0, 0x11, 0x8e, 0xdd, 0x26, 0x69, 0xa0, 0x8f, 0xcd, 0xa6, 0x86, 0xad,
+  0xe2, 0xd2, 0x1b, 0x5b, 0x61, 0x5e, 0x4c, 0xe7, 0xb1, 0x5c, 0x08, 0x5d, 0x40, 0x41, 0xb5, 0xba,
+  0x86, 0x76, 0x6a, 0x95, 0xd1, 0xd5, 0xa9, 0xe5, 0x6a, 0x39, 0xa6, 0x19, 0x14, 0x1b, 0x76, 0x58,
+  0x8d, 0x37, 0x3e, 0x91, 0x8d, 0x72, 0xd9, 0xc0, 0x9d, 0xda, 0xff, 0xda, 0x00, 0xb8, 0x83, 0xbb,
+  0x10, 0x00, 0x00
+};
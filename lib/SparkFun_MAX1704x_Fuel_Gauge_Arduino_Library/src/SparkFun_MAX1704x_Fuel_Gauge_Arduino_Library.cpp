@@ -166,9 +166,11 @@ uint8_t SFE_MAX1704X::quickStart()
 
 float SFE_MAX1704X::getVoltage()
 {
-  uint16_t vCell;
-  vCell = read16(MAX17043_VCELL);
+  return convertVoltage(read16(MAX17043_VCELL));
+}
 
+float SFE_MAX1704X::convertVoltage(uint16_t vCell)
+{
   if (_device <= MAX1704X_MAX17044)
   {
     // On the MAX17043/44: vCell is a 12-bit register where each bit represents:
@@ -194,15 +196,30 @@ float SFE_MAX1704X::getVoltage()
 
 float SFE_MAX1704X::getSOC()
 {
-  uint16_t soc;
+  return convertSOC(read16(MAX17043_SOC));
+}
+
+float SFE_MAX1704X::convertSOC(uint16_t soc)
+{
   float percent;
-  soc = read16(MAX17043_SOC);
   percent = (float)((soc & 0xFF00) >> 8);
   percent += ((float)(soc & 0x00FF)) / 256.0;
 
   return percent;
 }
 
+uint8_t SFE_MAX1704X::readAll(sfe_max1704x_snapshot_t &snapshot)
+{
+  uint16_t registers[2]; // VCELL, SOC
+  uint8_t result = readRegisters(MAX17043_VCELL, registers, 2);
+  if (result != 0)
+    return (result);
+
+  snapshot.voltage = convertVoltage(registers[0]);
+  snapshot.soc = convertSOC(registers[1]);
+  return (0);
+}
+
 uint16_t SFE_MAX1704X::getVersion()
 {
   return read16(MAX17043_VERSION);
@@ -922,15 +939,8 @@ uint16_t SFE_MAX1704X::read16(uint8_t address)
 
   while ((success == false) && (retries > 0))
   {
-    _i2cPort->beginTransmission(MAX1704x_ADDRESS);
-    _i2cPort->write(address);
-    _i2cPort->endTransmission(false); // Don't release the bus
-
-    if (_i2cPort->requestFrom(MAX1704x_ADDRESS, 2) == 2)
+    if (readRegister(address, result) == 0)
     {
-      uint8_t msb = _i2cPort->read();
-      uint8_t lsb = _i2cPort->read();
-      result = ((uint16_t)msb << 8) | lsb;
       success = true;
     }
     else
@@ -956,3 +966,31 @@ uint16_t SFE_MAX1704X::read16(uint8_t address)
 
   return (result);
 }
+
+uint8_t SFE_MAX1704X::readRegister(uint8_t address, uint16_t &value)
+{
+  return readRegisters(address, &value, 1);
+}
+
+uint8_t SFE_MAX1704X::readRegisters(uint8_t address, uint16_t *values, uint8_t count)
+{
+  if ((count == 0) || (count > MAX1704x_BURST_MAX_REGISTERS))
+    return (MAX17043_GENERIC_ERROR);
+
+  _i2cPort->beginTransmission(MAX1704x_ADDRESS);
+  _i2cPort->write(address);
+  uint8_t result = _i2cPort->endTransmission(false); // Don't release the bus
+  if (result != 0)
+    return (result);
+
+  if (_i2cPort->requestFrom(MAX1704x_ADDRESS, count * 2) != count * 2)
+    return (MAX17043_GENERIC_ERROR);
+
+  for (uint8_t i = 0; i < count; i++)
+  {
+    uint8_t msb = _i2cPort->read();
+    uint8_t lsb = _i2cPort->read();
+    values[i] = ((uint16_t)msb << 8) | lsb;
+  }
+  return (0);
+}
@@ -118,6 +118,16 @@ typedef enum {
 ////////////////////////////////
 #define MAX1704x_ADDRESS 0x36 // Unshifted I2C address. Becomes 0x6C for write and 0x6D for read.
 
+//////////////////////////////
+// MAX1704x Reading Snapshot //
+//////////////////////////////
+// Filled by readAll() from VCELL and SOC, which sit next to each other and
+// are read in one transaction.
+typedef struct {
+  float voltage; // as getVoltage()
+  float soc;     // as getSOC()
+} sfe_max1704x_snapshot_t;
+
 // Generic error:
 // Wire.endTransmission will return:
 // 0:success
@@ -128,6 +138,10 @@ typedef enum {
 // So, let's use "5" as a generic error value
 #define MAX17043_GENERIC_ERROR 5
 
+// Registers read by one readRegisters() call, well within the 32 byte receive
+// buffer of the smallest Wire implementations
+#define MAX1704x_BURST_MAX_REGISTERS 16
+
 class SFE_MAX1704X
 {
 public:
@@ -166,6 +180,18 @@ public:
   // full charge.
   float getSOC();
 
+  // convertVoltage([vCell]) / convertSOC([soc]) - Convert raw VCELL and SOC
+  // register values, as read with readRegister(), without touching the bus.
+  float convertVoltage(uint16_t vCell);
+  float convertSOC(uint16_t soc);
+
+  // readAll([snapshot]) - Read VCELL and SOC together in a single burst, half
+  // the bus time of getVoltage() followed by getSOC(). Like readRegister()
+  // it makes a single attempt.
+  // Input: [snapshot] - Filled with the voltage and SOC on success.
+  // Output: 0 on success, positive integer on fail.
+  uint8_t readAll(sfe_max1704x_snapshot_t &snapshot);
+
   // getVersion() - Get the MAX17043's production version number.
   // Output: 3 on success
   uint16_t getVersion();
@@ -381,6 +407,23 @@ public:
   // Output: A 16-bit value read from the device's address will be returned.
   uint16_t read16(uint8_t address);
 
+  // readRegister([address], [value]) - Read 16-bits from the requested address
+  // in a single attempt. Unlike read16() it never retries or delays, so a
+  // caller polling from a time critical loop can schedule its own retries.
+  // Input: [address] - An 8-bit address to be read from.
+  //        [value] - Set to the 16-bit value read on success.
+  // Output: 0 on success, positive integer on fail.
+  uint8_t readRegister(uint8_t address, uint16_t &value);
+
+  // readRegisters([address], [values], [count]) - Read [count] consecutive
+  // 16-bit registers starting at [address] in one I2C transaction, relying on
+  // the IC's register address auto-increment. Single attempt, no delays.
+  // Input: [address] - The 8-bit address of the first register.
+  //        [values] - Set to the [count] values read on success.
+  //        [count] - Number of registers, at most MAX1704x_BURST_MAX_REGISTERS.
+  // Output: 0 on success, positive integer on fail.
+  uint8_t readRegisters(uint8_t address, uint16_t *values, uint8_t count);
+
 private:
   //Variables
   TwoWire *_i2cPort; //The generic connection to user's chosen I2C hardware
@@ -1,14 +1,23 @@
 // VERSION 1.0.0
 #include <ArduinoBLE.h>
+#include <utility/ATT.h>
+#include <utility/HCI.h>
 #include <EEPROM.h>
 #include <ElegantOTA.h>
+#include <LittleFS.h>
+#include <PubSubClient.h>
 #include <SparkFun_MAX1704x_Fuel_Gauge_Arduino_Library.h>
 #include <SparkFun_Qwiic_OLED.h>
+#include <Update.h>
 #include <WebServer.h>
 #include <WiFi.h>
 #include <WiFiClient.h>
 #include <Wire.h>
 #include <__version.h>
+#include <dashboard.h>
+#include <lwip/sockets.h>
+#include <rom/crc.h>
+#include <rom/miniz.h>
 #include <res/qw_fnt_31x48.h>
 #include <res/qw_fnt_5x7.h>
 #include <res/qw_fnt_7segment.h>
@@ -21,6 +30,56 @@
 
 #define MEASUREMENT_INTERVAL_MS 200
 
+#define BOOT_POWER_SETTLE_MS 100     // OLED and sensor power up time
+#define BOOT_RADIO_TASK_STACK 8192  // bytes
+#define BOOT_RADIO_TASK_CORE 0      // loop() runs on core 1
+
+#define BLE_TASK_STACK 8192                 // bytes
+#define BLE_TASK_PRIORITY 2                 // above loop()
+#define BLE_TASK_CORE 0
+#define BLE_TASK_POLL_INTERVAL_MS 2         // longest wait between BLE.poll() calls when idle
+#define BLE_SAMPLE_QUEUE_LENGTH 16          // samples waiting for the BLE task
+#define BLE_LATENCY_REPORT_INTERVAL_MS 10000
+
+#define SETTINGS_TASK_STACK 4096  // bytes
+#define SETTINGS_TASK_PRIORITY 1  // below the BLE task
+#define SETTINGS_TASK_CORE 0
+
+#define LOG_TASK_STACK 4096         // bytes
+#define LOG_TASK_PRIORITY 1         // below the BLE task
+#define LOG_TASK_CORE 0
+#define LOG_TASK_POLL_MS 100        // longest wait before a requested erase
+#define LOG_QUEUE_LENGTH 64         // records waiting for the log task
+#define LOG_TASK_BATCH_RECORDS 16   // queued records written at a time
+
+#define WEB_TASK_STACK 8192             // bytes
+#define WEB_TASK_PRIORITY 1             // below the BLE task
+#define WEB_TASK_CORE 0
+#define WEB_TASK_POLL_INTERVAL_MS 5     // longest wait between handleClient() calls
+#define WEB_IDLE_TIMEOUT_MS 180000      // WiFi off after this long without a station
+#define WEB_TASK_OFF_INTERVAL_MS 100    // wait between checks for a WiFi request while off
+#define OTA_PROGRESS_INTERVAL_MS 1000
+
+#define BLE_PROFILE_FAST 0
+#define BLE_PROFILE_SLOW 1
+#define BLE_PROFILE_COUNT 2
+#define BLE_PROFILE_NONE 0xff
+#define BLE_PROFILE_SETTLE_MS 2000  // leave the central's parameters alone during service discovery
+#define BLE_PROFILE_IDLE_MS 5000    // stay fast this long after streaming or a download ends
+#define BLE_PROFILE_RETRY_MS 1000   // before asking again for a profile the controller refused
+
+#define ADVERTISING_COMPANY_ID 0xFFFF     // no assigned company ID; 0xFFFF is reserved for this use
+#define ADVERTISING_PAYLOAD_VERSION 1
+#define ADVERTISING_MIN_INTERVAL_MS 1000  // refresh the payload at most this often
+#define ADVERTISING_BATTERY_UNKNOWN 0xff
+
+// WiFi is off from boot. Holding the board's BOOT button, or writing
+// WIFI_STATE_ON to BLE_UUID_WIFI, brings up the soft AP and the web server.
+#define WIFI_BUTTON_PIN 0         // BOOT, only sampled by the ROM at reset
+#define WIFI_BUTTON_HOLD_MS 3000  // long press toggles WiFi
+#define WIFI_STATE_OFF 0
+#define WIFI_STATE_ON 1
+
 #define PIN_RESET 9
 #define DC_JUMPER 1
 
@@ -28,6 +87,18 @@
 #define BLE_UUID_PARTICLE_SENSOR "C32AFDBA-E9F2-453E-9612-85FBF4108AB2"
 #define BLE_UUID_AGTRON "CE216811-0AD9-4AFF-AE29-8B171093A95F"
 #define BLE_UUID_METER_STATE "8ACE2828-996F-48E4-8E9C-8284678B4B57"
+#define BLE_UUID_MEASUREMENT "2F1A7C3E-5B8D-4E6A-9C21-7D4B3A6E8F10"
+#define BLE_UUID_RAW_STREAM "6C0E2B4A-1D3F-4A5B-8E7C-9F2D1B3A5C40"
+#define BLE_UUID_RAW_STREAM_RATE "A4D3C2B1-7E6F-4B8A-9D0C-3E2F1A4B5C61"
+#define BLE_UUID_BLE_LATENCY "F1B2C3D4-5A6B-4C7D-8E9F-0A1B2C3D4E5F"
+#define BLE_UUID_CONNECTION_STATS "F1B2C3D4-5A6B-4C7D-8E9F-0A1B2C3D4E60"
+#define BLE_UUID_WIFI "F1B2C3D4-5A6B-4C7D-8E9F-0A1B2C3D4E61"
+#define BLE_UUID_METRICS "F1B2C3D4-5A6B-4C7D-8E9F-0A1B2C3D4E62"
+
+#define BLE_UUID_LOG_SERVICE "7E3A9C10-4B2D-4F6E-8A1B-5C9D2E7F3A01"
+#define BLE_UUID_LOG_INFO "7E3A9C11-4B2D-4F6E-8A1B-5C9D2E7F3A01"
+#define BLE_UUID_LOG_CONTROL "7E3A9C12-4B2D-4F6E-8A1B-5C9D2E7F3A01"
+#define BLE_UUID_LOG_DATA "7E3A9C13-4B2D-4F6E-8A1B-5C9D2E7F3A01"
 
 #define BLE_UUID_DEVICE_INFOMATION_SERVICE "180A"
 #define BLE_UUID_FIRMWARE_REVISION "2A26"
@@ -42,6 +113,11 @@
 #define BLE_UUID_COEFFICIENT_3 "54A41301-4278-4F2B-A42E-9A5576298DA3"
 #define BLE_UUID_IR_OFFSET "15DFB217-B7B8-41B3-97F7-8FD154021F29"
 #define BLE_UUID_AUTO_CALIBRATION "86B7E111-4D13-448E-91C6-428ED0734CD1"
+#define BLE_UUID_AGTRON_DEADBAND "3B9E5D21-6A4C-4F8E-B2D7-1C5A9E3F7B82"
+#define BLE_UUID_IR_DEADBAND "E7A41C96-2D5B-4E3F-8A6C-0B9D7F2E4A13"
+#define BLE_UUID_NOTIFY_HEARTBEAT "5D8F2A3C-9B1E-4C7D-A6F0-2E4B8C1D9A75"
+#define BLE_UUID_SETTINGS_BLOB "0C7B4E2A-8F3D-4A1C-B5E9-6D2F8A0C3E94"
+#define BLE_UUID_SETTINGS_SAVE "0C7B4E2B-8F3D-4A1C-B5E9-6D2F8A0C3E94"
 
 #define BLE_UUID_BLE_NAME "CDE44FD7-4C1E-42A0-8368-531DC87F6B56"
 #define BLE_UUID_UNBLOCK_LEVEL "B8BEFA0C-FFDD-4096-9ACD-208657B4B73C"
@@ -51,10 +127,350 @@
 #define STATE_READY 2
 #define STATE_MEASURED 3
 
+#define BLE_ATT_DEFAULT_MTU 23
+#define BLE_ATT_NOTIFY_OVERHEAD 3
+#define BLE_CONNECTION_HANDLE_NONE 0xffff
+
 // -- End Constant Values --
 
+// -- Fuel Gauge constants --
+
+// updateFuelGuage() runs from loop() on the sensor's I2C bus and makes at most
+// one single-attempt transaction per pass. Nothing waits on the gauge: a
+// failed read is tried again after a backoff that doubles up to
+// FUEL_GUAGE_BACKOFF_MAX_MS, and readers only ever see the cached values.
+#define FUEL_GUAGE_POLL_INTERVAL_MS 10000
+#define FUEL_GUAGE_QUICK_START_MS 1000    // until the first SOC estimate after a quick start
+#define FUEL_GUAGE_BACKOFF_MIN_MS 100
+#define FUEL_GUAGE_BACKOFF_MAX_MS 60000
+#define FUEL_GUAGE_STALE_MS 60000         // cached values dropped after this long without a reading
+
+#define FUEL_GUAGE_STATE_DETECT 0       // read VERSION until the gauge answers
+#define FUEL_GUAGE_STATE_QUICK_START 1  // cold boot only, the gauge stays powered through a reset
+#define FUEL_GUAGE_STATE_READ 2         // VCELL and SOC in one burst
+
+// -- End Fuel Gauge constants --
+
+// -- Measurement Frame constants --
+
+// Frame sent on BLE_UUID_MEASUREMENT, little endian:
+//   uint8 version, uint8 record count, then count x MeasurementRecord
+#define MEASUREMENT_FRAME_VERSION 1
+#define MEASUREMENT_FRAME_HEADER_LENGTH 2
+#define MEASUREMENT_BATCH_MAX_RECORDS 15       // 242 bytes, fits a 247 byte MTU
+#define MEASUREMENT_BATCH_MAX_AGE_MS 1000      // oldest record waits at most this long
+#define MEASUREMENT_AGTRON_SCALE 100           // Agtron is sent as centi-Agtron
+#define MEASUREMENT_SETTLE_SAMPLES 4           // filter settles after this many samples
+#define MEASUREMENT_IR_SATURATION 262143       // 18 bit ADC full scale
+
+#define MEASUREMENT_FLAG_SAMPLE_LOADED 0x01
+#define MEASUREMENT_FLAG_SATURATED 0x02
+#define MEASUREMENT_FLAG_SETTLING 0x04
+#define MEASUREMENT_FLAG_LATE 0x08  // sample taken more than one interval late
+
+struct __attribute__((packed)) MeasurementRecord {
+  uint32_t sequence;
+  uint32_t timestamp;  // millis()
+  uint32_t rawIR;
+  int16_t agtron;      // Agtron * MEASUREMENT_AGTRON_SCALE
+  uint8_t state;
+  uint8_t flags;
+};
+
+#define MEASUREMENT_FRAME_MAX_LENGTH (MEASUREMENT_FRAME_HEADER_LENGTH + MEASUREMENT_BATCH_MAX_RECORDS * sizeof(MeasurementRecord))
+
+// Handed from measureSampleJob() to the BLE task
+struct MeasurementSample {
+  uint32_t sequence;
+  uint32_t timestamp;  // millis()
+  uint32_t irLevel;
+  float agtronLevel;
+  uint8_t state;
+  uint8_t flags;
+};
+
+// Read from BLE_UUID_BLE_LATENCY, little endian. A GATT event waits at most
+// one poll gap before BLE.poll() picks it up, and is handled inside the poll.
+struct __attribute__((packed)) BLELatencyStats {
+  uint32_t worstPollGapUs;   // longest time between two BLE.poll() calls
+  uint32_t worstPollUs;      // longest BLE.poll(), including event handlers
+  uint32_t worstResponseUs;  // longest poll gap + poll in one pass
+  uint32_t droppedSamples;   // samples lost because the BLE task fell behind
+};
+
+// Requested with HCI LE Connection Update once the central has settled
+struct BLEConnectionProfile {
+  const char *name;
+  uint16_t minInterval;         // 1.25ms units
+  uint16_t maxInterval;         // 1.25ms units
+  uint16_t latency;             // connection events the peripheral may skip
+  uint16_t supervisionTimeout;  // 10ms units
+};
+
+const BLEConnectionProfile bleConnectionProfiles[BLE_PROFILE_COUNT] = {
+  { "fast", 6, 12, 0, 200 },    // 7.5-15ms, raw streaming and log download
+  { "slow", 80, 160, 4, 600 },  // 100-200ms, idle while connected
+};
+
+// Read from BLE_UUID_CONNECTION_STATS, little endian. The radio wakes once
+// per connection event, so wake-ups per second is what the current draw of a
+// profile scales with; bytes per second is the throughput it delivered.
+struct __attribute__((packed)) BLEProfileStats {
+  uint32_t activeMs;       // connected time spent in this profile
+  uint32_t notifiedBytes;  // notification payload sent in this profile
+  uint32_t radioWakeups;   // estimated from the requested interval and latency
+};
+
+// Manufacturer specific advertising data, little endian, so any number of
+// scanners can follow the meter without connecting. With the flags and the
+// 128-bit service UUID this fills the 31 byte advertising packet; the local
+// name goes in the scan response.
+struct __attribute__((packed)) AdvertisingPayload {
+  uint8_t versionState;  // ADVERTISING_PAYLOAD_VERSION << 4 | STATE_*
+  int16_t agtron;        // latest locked reading, x MEASUREMENT_AGTRON_SCALE
+  uint8_t battery;       // state of charge in %, or ADVERTISING_BATTERY_UNKNOWN
+  uint16_t sequence;     // bumps on every locked reading, 0 before the first
+};
+
+// Handed from updateReadingLock() to the BLE task
+struct LockedReading {
+  float agtronLevel;
+  uint16_t sequence;
+};
+
+struct __attribute__((packed)) BLEConnectionStats {
+  uint8_t profile;  // BLE_PROFILE_*
+  BLEProfileStats profiles[BLE_PROFILE_COUNT];
+};
+
+// -- End Measurement Frame constants --
+
+// -- Live Events constants --
+
+// GET /events streams Server-Sent Events to browsers on the soft AP. Each
+//   event: measurement
+//   data: <measurement frame, base64>
+// carries the same bytes as a BLE_UUID_MEASUREMENT notification, with the
+// records webTask() collected since its previous pass. Sends never wait: a
+// browser whose socket cannot take a whole event is dropped, and reconnects
+// on its own as EventSource does.
+#define EVENTS_MAX_CLIENTS 4
+#define EVENTS_QUEUE_LENGTH 16     // samples waiting for webTask()
+#define EVENTS_KEEPALIVE_MS 15000  // comment sent to idle browsers
+#define EVENTS_MAX_LENGTH (32 + (MEASUREMENT_FRAME_MAX_LENGTH + 2) / 3 * 4)
+
+// -- End Live Events constants --
+
+// -- Log Export constants --
+
+// GET /log.csv and /log.ndjson stream the measurement log from flash with
+// chunked transfer encoding, LOG_EXPORT_CHUNK_RECORDS records at a time, so
+// memory use is the same for any log size. Optional arguments narrow it down:
+//   session=<n>             records of one session
+//   from=<unix>, to=<unix>  from the first synced record at or after from up
+//                           to the first one at or after to
+//   start=<index>           resume from a record index
+//   last=<n>                only the newest n of those records
+// Every line carries its record index. "Range: records=<first>-[<last>]"
+// resumes the same way and is answered with 206 and
+// "Content-Range: records <first>-<last>/<count>". Byte ranges are ignored,
+// as the length of the text is not known up front.
+#define LOG_EXPORT_CHUNK_RECORDS 16
+#define LOG_EXPORT_LINE_MAX_LENGTH 128
+#define LOG_EXPORT_CSV_HEADER "index,time,time_synced,session,profile,raw_ir,agtron\n"
+
+// -- End Log Export constants --
+
+// -- Dashboard constants --
+
+// GET / serves web/index.html, which loads web/dashboard.js from
+// DASHBOARD_SCRIPT_PATH. compress_dashboard.py gzips both into
+// include/dashboard.h at build time and they are sent from flash as they are.
+// The page is revalidated against its ETag on every load, so a firmware
+// update never leaves a stale copy behind; the script's path changes with its
+// content, so it is cached for good.
+#define DASHBOARD_INDEX_CACHE_CONTROL "no-cache"
+#define DASHBOARD_SCRIPT_CACHE_CONTROL "public, max-age=31536000, immutable"
+
+// GET /settings returns the settings as a JSON object. POST /settings takes
+// any of its fields as form arguments; the result is checked as a settings
+// blob and applied by bleTask() as a BLE_UUID_SETTINGS_BLOB write would be.
+#define DASHBOARD_SETTINGS_MAX_LENGTH 768
+#define DASHBOARD_SETTINGS_FLOAT_LIMIT 1000000.0f  // calibration values stay within +/- this
+#define DASHBOARD_AGTRON_DEADBAND_MAX 100.0f  // the whole Agtron scale
+
+// -- End Dashboard constants --
+
+// -- Compressed OTA constants --
+
+// POST /update.gz takes a gzip compressed firmware image as a file upload and
+// inflates it straight into the OTA partition as it arrives, with the ROM's
+// tinfl and a TINFL_LZ_DICT_SIZE dictionary that only exists during the
+// upload. The CRC-32 and length in the gzip trailer are checked against what
+// was inflated before Update.end() switches the boot partition; anything
+// else aborts the update and the running firmware stays. The gzip header has
+// to fit in the first upload buffer, as any file name short enough to type
+// does.
+#define OTA_GZIP_ID_1 0x1f
+#define OTA_GZIP_ID_2 0x8b
+#define OTA_GZIP_METHOD_DEFLATE 8
+#define OTA_GZIP_HEADER_LENGTH 10
+#define OTA_GZIP_TRAILER_LENGTH 8  // uint32 CRC-32, uint32 inflated length
+#define OTA_GZIP_FLAG_HCRC 0x02
+#define OTA_GZIP_FLAG_EXTRA 0x04
+#define OTA_GZIP_FLAG_NAME 0x08
+#define OTA_GZIP_FLAG_COMMENT 0x10
+#define OTA_RESTART_DELAY_MS 1000  // lets the response reach the browser
+
+struct GzipUpdate {
+  tinfl_decompressor *inflator;  // NULL when no upload is in progress
+  uint8_t *dictionary;
+  size_t dictionaryOffset;
+  bool isHeaderRead;
+  bool isInflated;
+  bool isUpdated;
+  const char *error;  // NULL unless the update failed
+  uint8_t trailer[OTA_GZIP_TRAILER_LENGTH];
+  uint8_t trailerLength;
+  uint32_t crc;
+  uint32_t uploadedBytes;
+  uint32_t inflatedBytes;
+  unsigned long startMillis;
+  unsigned long elapsedMillis;
+  unsigned long flashMicros;  // spent in Update.write()
+};
+
+// -- End Compressed OTA constants --
+
+// -- MQTT constants --
+
+// Built with the esp32dev_mqtt environment, which takes mqtt_host from
+// config/secret.ini next to wifi_ssid and wifi_password, webTask() keeps a
+// station connection to the roastery network and publishes locked readings
+// to MQTT_HOST on MQTT_TOPIC_PREFIX/<BLE name>/readings, as the NDJSON lines
+// /log.ndjson serves, up to MQTT_BATCH_RECORDS per message.
+// The measurement log is the offline queue: MQTT_CURSOR_PATH keeps the index
+// of the first record not yet published, so readings taken while the broker
+// was out of reach, or before a restart, go out once it is back. The cursor
+// is saved every MQTT_CURSOR_SAVE_RECORDS records or
+// MQTT_CURSOR_SAVE_INTERVAL_MS, so a restart publishes at most that many
+// again rather than wearing the flash on every message. Records the log
+// dropped before they went out, and torn ones, are skipped. To watch from the
+// dev box:
+//   mosquitto -v
+//   mosquitto_sub -h <dev box> -t 'roastmeter/#' -v
+#ifndef WIFI_SSID
+#define WIFI_SSID ""
+#endif
+#ifndef WIFI_PASSWORD
+#define WIFI_PASSWORD ""
+#endif
+#ifndef MQTT_HOST
+#define MQTT_HOST ""  // esp32dev leaves MQTT off
+#endif
+#define MQTT_PORT 1883
+#define MQTT_TOPIC_PREFIX "roastmeter"
+#define MQTT_CURSOR_PATH "/mqtt.cur"
+#define MQTT_CURSOR_SAVE_RECORDS 256
+#define MQTT_CURSOR_SAVE_INTERVAL_MS 60000
+#define MQTT_BATCH_RECORDS 16
+#define MQTT_BATCH_INTERVAL_MS 5000       // a partial batch waits this long after the previous one
+#define MQTT_RECONNECT_INTERVAL_MS 10000  // between failed broker connects
+#define MQTT_SOCKET_TIMEOUT_S 2           // bounds how long a dead broker holds up webTask()
+#define MQTT_KEEP_ALIVE_S 30
+
+struct __attribute__((packed)) MqttCursor {
+  uint32_t index;  // first log record not yet published
+  uint16_t crc;    // crc16 of the above
+};
+
+// -- End MQTT constants --
+
+// -- Metrics constants --
+
+// Device health, served as Prometheus text on /metrics and read from
+// BLE_UUID_METRICS. Every counter has a single writer, a 32-bit store the
+// other tasks read without a lock, so counting never waits on a collector;
+// only taking the snapshot reads the heap and queue state. Counters wrap at
+// 2^32, which rate() reads as a counter reset.
+#define METRICS_VERSION 1
+#define METRICS_BLE_INTERVAL_MS 1000  // refresh of the characteristic
+#define METRICS_FAMILY_MAX_LENGTH 256  // HELP, TYPE and sample of one metric, sent as a chunk
+
+// Counted where they happen, see the writer of each
+struct MetricsCounters {
+  volatile uint32_t loopCount;          // loop()
+  volatile uint32_t sampleCount;        // loop(), samples taken by measureSampleJob()
+  volatile uint32_t jitterUsTotal;      // loop(), lateness of those samples
+  volatile uint32_t worstJitterUs;      // loop()
+  volatile uint32_t i2cErrors;          // loop(), failed sensor, FIFO and fuel gauge transactions
+  volatile uint32_t worstBLEBacklog;    // bleTask(), samples waiting for it
+  volatile uint32_t settingsCommits;    // under settingsMutex
+  volatile uint32_t logRecordsWritten;  // logTask()
+};
+
+// Read from BLE_UUID_METRICS, little endian. Refreshed every
+// METRICS_BLE_INTERVAL_MS.
+struct __attribute__((packed)) DeviceMetrics {
+  uint8_t version;  // METRICS_VERSION
+  uint32_t uptimeS;
+  uint32_t loopCount;
+  uint32_t sampleCount;
+  uint32_t jitterUsTotal;
+  uint32_t worstJitterUs;
+  uint32_t droppedBLESamples;     // bleSampleQueue was full
+  uint32_t droppedEventsSamples;  // eventsSampleQueue was full
+  uint32_t droppedRawStreamFrames;
+  uint32_t i2cErrors;
+  uint32_t freeHeap;
+  uint32_t largestFreeBlock;
+  uint32_t minimumFreeHeap;  // since boot
+  uint16_t bleBacklog;       // samples waiting for bleTask()
+  uint16_t worstBLEBacklog;
+  uint32_t settingsCommits;
+  uint32_t logRecordsWritten;
+  uint16_t batteryMillivolts;  // 0 until the fuel gauge is read
+  uint8_t batterySOC;          // %, or ADVERTISING_BATTERY_UNKNOWN
+};
+
+// -- End Metrics constants --
+
+// -- Raw Stream constants --
+
+// Frame sent on BLE_UUID_RAW_STREAM, little endian:
+//   uint8 version, uint8 flags, uint16 sequence of the first sample,
+//   uint8 sample count, uint24 first sample, then count - 1 zigzag varint
+//   deltas from the previous sample.
+// Sequence numbers count sensor samples, including ones lost to a FIFO
+// overflow or a dropped frame, so a receiver detects a gap when a frame does
+// not start at the previous sequence + count.
+#define RAW_STREAM_FRAME_VERSION 1
+#define RAW_STREAM_FRAME_HEADER_LENGTH 8
+#define RAW_STREAM_FRAME_MAX_LENGTH 244  // 247 byte MTU - 3
+#define RAW_STREAM_FRAME_MAX_AGE_MS 50
+#define RAW_STREAM_QUEUE_LENGTH 8        // frames waiting for the radio
+#define RAW_STREAM_SAMPLE_AVERAGE 1
+
+#define RAW_STREAM_FLAG_GAP 0x01  // samples were lost before this frame
+
+#define MAX30105_I2C_ADDRESS 0x57
+#define MAX30105_FIFO_WRITE_PTR 0x04
+#define MAX30105_FIFO_OVERFLOW 0x05
+#define MAX30105_FIFO_READ_PTR 0x06
+#define MAX30105_FIFO_DATA 0x07
+#define MAX30105_FIFO_DEPTH 32
+#define MAX30105_FIFO_CHANNEL_LENGTH 3  // bytes per LED in a sample, which holds one per LED of ledMode
+#define MAX30105_FIFO_IR_CHANNEL 1      // Red, then IR
+#define MAX30105_FIFO_BURST_LENGTH 120  // bytes per read, under the 128 byte Wire buffer
+#define MAX30105_SAMPLE_MASK 0x3FFFF
+
+// -- End Raw Stream constants --
+
 // -- EEPROM constants --
 
+// Layout written by firmware before settings version 1. setupEEPROM() only
+// reads it to migrate a meter to StoredSettings; the defaults still apply.
+
 #define EEPROM_MAX_LENGTH 256                  // 1024 bytes
 #define EEPROM_VALID_IDX 0                     // 1 byte
 #define EEPROM_VALID_CODE (0xAA)               // uint8
@@ -74,19 +490,217 @@
 #define EEPROM_COEFFICIENT_3_DEFAULT 0         // float 32 bit 4 bytes
 #define EEPROM_IR_OFFSET_IDX 23                // 1 byte
 #define EEPROM_IR_OFFSET_DEFAULT 0             // float 32 bit 4 bytes
+#define EEPROM_AGTRON_DEADBAND_DEFAULT 0.5f    // float 32 bit 4 bytes
+#define EEPROM_IR_DEADBAND_DEFAULT 200         // uint16
+#define EEPROM_NOTIFY_HEARTBEAT_DEFAULT 5      // uint16 seconds
 #define EEPROM_BLE_NAME_IDX 128                // 64 byte - 1 byte length + 63 ASCII
 
 // -- End EEPROM constants
 
+// -- Measurement Log constants --
+
+// Locked readings are appended as fixed size records to segment files in
+// LOG_DIRECTORY, each named after the index of its first record in hex and
+// holding up to LOG_SEGMENT_RECORDS records, so a record is found from its
+// index without reading anything else. Every segment but the newest is full.
+// Once LOG_MAX_SEGMENTS are kept, or the file system runs low, the oldest
+// segment is deleted; record indexes keep counting up regardless.
+//
+// A LogSegment entry per segment is kept in RAM as a sparse index by session
+// and synced time, and entries of full segments are saved to LOG_INDEX_PATH,
+// so boot only reads the newest segment and range lookups only read the
+// segments at the ends of the range. Sessions only go up, as do synced
+// timestamps; uptime timestamps are left out of time lookups.
+//
+// Bulk download: write LOG_COMMAND_START_TRANSFER + uint32 record index to
+// BLE_UUID_LOG_CONTROL, then every BLE_UUID_LOG_DATA notification carries
+//   uint32 index of the first record, uint8 record count, count x LogRecord
+// up to the negotiated MTU. A chunk with a count of 0 ends the transfer. After
+// a disconnect the central resumes by starting again from the next index it
+// has not received. LOG_COMMAND_START_SESSION_TRANSFER and
+// LOG_COMMAND_START_TIME_TRANSFER send just the records of one session or
+// time span the same way. LOG_COMMAND_ERASE drops every record but indexes
+// carry on from where they were, so a resumed download or the MQTT cursor
+// never meets the same index for a different record.
+#define LOG_DIRECTORY "/log"
+#define LOG_INDEX_PATH "/log.idx"
+#define LOG_SEGMENT_RECORDS 256          // 4KB, one LittleFS block
+#define LOG_MAX_SEGMENTS 128             // 32768 readings
+#define LOG_MIN_FREE_BYTES 16384         // drop the oldest segment below this
+#define LOG_SCAN_RECORDS 16              // records read at a time when scanning
+#define LOG_VERSION 2
+#define LOG_DATA_HEADER_LENGTH 5
+#define LOG_DATA_MAX_LENGTH 244  // 247 byte MTU - 3
+#define LOG_CONTROL_MAX_LENGTH 9
+
+#define LOG_COMMAND_START_TRANSFER 0x01          // + uint32 record index
+#define LOG_COMMAND_STOP_TRANSFER 0x02
+#define LOG_COMMAND_SET_TIME 0x03                // + uint32 unix time
+#define LOG_COMMAND_SET_PROFILE 0x04             // + uint8 profile
+#define LOG_COMMAND_ERASE 0x05
+#define LOG_COMMAND_START_SESSION_TRANSFER 0x06  // + uint16 session
+#define LOG_COMMAND_START_TIME_TRANSFER 0x07     // + uint32 from, uint32 to unix time
+
+#define LOG_FLAG_TIME_SYNCED 0x01  // timestamp is unix time, otherwise uptime
+
+#define LOCK_WINDOW_SAMPLES 5
+#define LOCK_TOLERANCE 0.5f  // Agtron
+
+struct __attribute__((packed)) LogRecord {
+  uint32_t timestamp;  // seconds, see LOG_FLAG_TIME_SYNCED
+  uint32_t rawIR;
+  int16_t agtron;      // Agtron * MEASUREMENT_AGTRON_SCALE
+  uint16_t session;    // increments every boot
+  uint8_t profile;     // set by the central, 0 when unset
+  uint8_t flags;
+  uint16_t crc;        // crc16 of the bytes above
+};
+
+struct __attribute__((packed)) LogInfo {
+  uint8_t version;
+  uint8_t recordSize;
+  uint16_t session;
+  uint32_t recordCount;  // index the next record will get
+  uint32_t firstIndex;   // oldest record still kept
+};
+
+struct __attribute__((packed)) LogSegment {
+  uint32_t firstIndex;
+  uint16_t recordCount;
+  uint16_t firstSession;
+  uint16_t lastSession;
+  uint32_t firstSyncedTime;  // 0 when the segment has no synced records
+  uint32_t lastSyncedTime;
+};
+
+// -- End Measurement Log constants --
+
+// -- Settings Blob constants --
+
+// All settings in one value on BLE_UUID_SETTINGS_BLOB, little endian. The CRC
+// is CRC-16/CCITT-FALSE over every byte after the crc field. A write is only
+// applied when version, length and CRC all match, and is committed to flash
+// straight away in a single EEPROM commit.
+#define SETTINGS_BLOB_VERSION 1
+#define SETTINGS_BLOB_HEADER_LENGTH 4
+#define SETTINGS_BLE_NAME_LENGTH 64  // NUL padded, 63 characters max
+
+struct __attribute__((packed)) SettingsBlob {
+  uint8_t version;
+  uint8_t length;  // sizeof(SettingsBlob)
+  uint16_t crc;
+  uint8_t ledBrightness;
+  uint8_t intersectionPoint;
+  float deviation;
+  float coefficient[4];
+  float irOffset;
+  float agtronDeadband;
+  uint16_t irDeadband;
+  uint16_t notifyHeartbeat;
+  char bleName[SETTINGS_BLE_NAME_LENGTH];
+};
+
+// -- End Settings Blob constants --
+
+// -- Settings Store constants --
+
+// Every setting is kept in one StoredSettings record, little endian. The CRC
+// is CRC-16/CCITT-FALSE over the length - header bytes after the header,
+// sequence included. Fields are only ever appended: a record written by
+// older firmware is shorter and the missing fields keep their defaults, a
+// longer one from newer firmware is read up to the fields this version knows.
+// SETTINGS_STORE_VERSION goes up with each change.
+//
+// The record sits at EEPROM_SETTINGS_IDX. EEPROM.commit() stores the whole
+// EEPROM image as one NVS blob, and NVS keeps the previous blob until the new
+// one is written in full, so a commit cut short by a reset leaves the last
+// committed record in place.
+#define EEPROM_SETTINGS_IDX 0
+#define SETTINGS_STORE_MAGIC 0x53        // 'S', never EEPROM_VALID_CODE
+#define SETTINGS_STORE_VERSION 1
+#define SETTINGS_STORE_HEADER_LENGTH 5
+#define SETTINGS_STORE_MAX_LENGTH 128    // bytes reserved for the record
+
+// Settings are staged in RAM and committed to flash by settingsTask(),
+// which erases a whole sector each time.
+#define SETTINGS_COMMIT_QUIET_MS 3000      // commit once writes stop for this long
+#define SETTINGS_COMMIT_POLL_MS 100
+#define SETTINGS_LOW_BATTERY_VOLTAGE 3.5f  // commit at once below this
+
+struct __attribute__((packed)) StoredSettings {
+  uint8_t magic;    // SETTINGS_STORE_MAGIC
+  uint8_t version;  // SETTINGS_STORE_VERSION of the firmware that wrote it
+  uint8_t length;   // sizeof(StoredSettings) of the firmware that wrote it
+  uint16_t crc;
+  uint32_t sequence;  // one more than the record it replaces, counts commits
+  uint8_t ledBrightness;
+  uint8_t intersectionPoint;
+  float deviation;
+  float coefficient[4];
+  float irOffset;
+  float agtronDeadband;
+  uint16_t irDeadband;
+  uint16_t notifyHeartbeat;
+  char bleName[SETTINGS_BLE_NAME_LENGTH];  // NUL terminated
+};
+
+static_assert(sizeof(StoredSettings) <= SETTINGS_STORE_MAX_LENGTH, "StoredSettings outgrew its EEPROM space");
+static_assert(EEPROM_SETTINGS_IDX + SETTINGS_STORE_MAX_LENGTH <= EEPROM_MAX_LENGTH, "Settings outgrew the EEPROM");
+
+// -- End Settings Store constants --
+
+// -- Warm Boot constants --
+
+// The committed settings record and the sensor configuration are mirrored in
+// RTC memory, which keeps its contents through every reset but a power loss
+// or brownout. After a software, watchdog or panic reset, or a wake from deep
+// sleep, setup() takes the settings from there, skips the power settle delay
+// and the splash screen, and leaves the sensor as it is when its snapshot
+// matches the configuration about to be applied. Anything that does not
+// validate means a cold boot. WARM_BOOT_VERSION goes up whenever
+// WarmBootState or StoredSettings change, so firmware after an OTA update
+// never reads a copy laid out by the previous one.
+#define WARM_BOOT_MAGIC 0x574D4252  // "RBMW"
+#define WARM_BOOT_VERSION 2
+
+struct __attribute__((packed)) SensorConfig {
+  uint8_t ledBrightness;
+  uint8_t sampleAverage;
+  uint8_t ledMode;
+  uint16_t sampleRate;
+  uint16_t pulseWidth;
+  uint16_t adcRange;
+};
+
+struct __attribute__((packed)) WarmBootState {
+  uint32_t magic;  // WARM_BOOT_MAGIC
+  uint8_t version;
+  uint16_t length;  // sizeof(WarmBootState)
+  uint16_t crc;     // crc16 of the bytes after this field
+  bool isSettingsCached;
+  StoredSettings settings;  // as read back from the EEPROM
+  bool isSensorConfigured;  // false while the sensor is being set up
+  SensorConfig sensorConfig;
+};
+
+// -- End Warm Boot constants --
+
 // -- Global Variables --
 
 uint32_t unblockedValue = 30000;  // Average IR at power up
 
-float fuelGuageVoltage = 0;     // Variable to keep track of LiPo voltage
+float fuelGuageVoltage = 0;     // Variable to keep track of LiPo voltage, 0 while unknown
 float fuelGuageSOC = 0;         // Variable to keep track of LiPo state-of-charge (SOC)
 bool fuelGuageAlert;            // Variable to keep track of whether alert has been triggered
 float fuelGuageChargeRate = 0;  // Variable to keep track of LiPo charge rate
 
+// Only loop() touches the fuel gauge
+uint8_t fuelGuageState = FUEL_GUAGE_STATE_DETECT;
+unsigned long fuelGuageDueMillis = 0;  // next transaction
+unsigned long fuelGuageBackoffMs = FUEL_GUAGE_BACKOFF_MIN_MS;
+unsigned long fuelGuageReadMillis = 0;  // last complete reading
+bool isFuelGuageFound = false;
+
 MAX30105 particleSensor;
 //QwiicMicroOLED oled;
 QwiicCustomOLED oled;
@@ -113,6 +727,150 @@ void MyAction_onOTAEnd() {
   iCallBackCount = 0;
 }
 
+// Boot orchestration: BLE and OTA are brought up by a background task while
+// the sensor is initialised on the main task, see setup()
+unsigned long bootStartMillis = 0;
+bool isWarmBoot = false;
+RTC_NOINIT_ATTR WarmBootState warmBootState;  // guarded by settingsMutex
+bool isFirstReadingLogged = false;
+volatile bool isBLEReady = false;
+
+// WiFi and the web server belong to webTask(), which only brings them up
+// once isWifiRequested is set. Sensing only stops while it sees a firmware
+// image being flashed.
+volatile bool isWifiRequested = false;
+volatile bool isWifiOn = false;
+bool isWebServerSetup = false;
+unsigned long wifiStartMillis = 0;
+uint8_t publishedWifiState = WIFI_STATE_OFF;  // bleTask() only
+bool isWifiButtonDown = false;                // loop() only
+bool isWifiButtonHandled = false;
+unsigned long wifiButtonDownMillis = 0;
+volatile bool isFirmwareUpdating = false;
+unsigned long otaProgressMillis = 0;
+bool isFirmwareRestartPending = false;
+unsigned long firmwareRestartMillis = 0;
+GzipUpdate gzipUpdate;
+
+// The station uplink and MQTT are run from webTask() too
+WiFiClient mqttWiFiClient;
+PubSubClient mqttClient(mqttWiFiClient);
+bool isMqttEnabled = false;
+bool isStationStarted = false;
+String mqttTopic;
+uint32_t mqttPublishedIndex = 0;  // first log record not yet published
+uint32_t mqttSavedIndex = 0;      // as MQTT_CURSOR_PATH holds it
+unsigned long mqttSavedMillis = 0;
+uint32_t mqttCursorSaveCount = 0;
+unsigned long mqttPublishedMillis = 0;
+unsigned long mqttConnectMillis = 0;
+
+// measureSampleJob() only queues samples for webTask() while a browser
+// follows /events
+QueueHandle_t eventsSampleQueue = NULL;
+WiFiClient eventsClients[EVENTS_MAX_CLIENTS];  // a slot is free while its fd() is -1
+volatile uint8_t eventsClientCount = 0;
+unsigned long eventsSentMillis = 0;
+uint32_t eventsDroppedSamples = 0;
+
+// POST /settings hands a checked blob to bleTask(). GET /settings reads the
+// copy updateSettingsBlobCharacteristic() keeps under settingsMutex.
+SettingsBlob webSettingsBlob;
+volatile bool isWebSettingsPending = false;
+SettingsBlob publishedSettingsBlob;
+
+// ArduinoBLE is not thread safe, so every BLE call is made from bleTask().
+// loop() hands samples and raw stream frames over through queues, and BLE
+// handlers that need the sensor or the log leave a request for loop().
+QueueHandle_t bleSampleQueue = NULL;
+QueueHandle_t rawStreamQueue = NULL;
+volatile uint16_t bleMtu = BLE_ATT_DEFAULT_MTU;
+volatile bool isRawStreamSubscribed = false;
+volatile bool isSensorSetupPending = false;
+volatile int32_t pendingRawStreamRate = -1;  // -1 when there is no request
+volatile bool isLogErasePending = false;
+volatile bool isLogInfoDirty = false;
+BLELatencyStats bleLatencyStats = {0, 0, 0, 0};
+MetricsCounters metricsCounters = {};
+unsigned long measureSampleMicros = 0;  // when measureSampleJob() last took a sample
+
+uint16_t bleCentralHandle = BLE_CONNECTION_HANDLE_NONE;
+
+uint8_t bleProfile = BLE_PROFILE_NONE;  // last profile the controller accepted
+uint8_t bleRefusedProfile = BLE_PROFILE_NONE;
+unsigned long bleProfileRefusedMillis = 0;
+unsigned long bleConnectedMillis = 0;
+unsigned long bleFastActivityMillis = 0;
+unsigned long bleProfileAccountedMillis = 0;
+uint32_t bleNotifiedBytes = 0;
+uint32_t bleProfileAccountedBytes = 0;
+BLEConnectionStats bleConnectionStats;
+
+// BLE handlers stage settings in stagedSettings under settingsMutex and
+// settingsTask() commits them, so a burst of writes costs one sector erase
+// and neither the handlers nor loop() wait on flash. Only settingsTask()
+// touches the EEPROM once setup() is done, so it commits without the mutex.
+SemaphoreHandle_t settingsMutex = NULL;
+StoredSettings stagedSettings;
+volatile bool isSettingsDirty = false;
+volatile bool isSettingsSaveRequested = false;
+volatile unsigned long settingsDirtyMillis = 0;
+uint32_t settingsCommitCount = 0;
+uint32_t settingsSequence = 0;  // of the last committed record
+
+QueueHandle_t lockedReadingQueue = NULL;  // holds only the latest reading
+uint16_t lockedReadingSequence = 0;
+AdvertisingPayload advertisingPayload = { ADVERTISING_PAYLOAD_VERSION << 4, 0, ADVERTISING_BATTERY_UNKNOWN, 0 };
+AdvertisingPayload advertisedPayload;
+unsigned long advertisedMillis = 0;
+
+uint32_t measurementSequence = 0;
+uint8_t measurementFrame[MEASUREMENT_FRAME_MAX_LENGTH];
+uint8_t measurementFrameCount = 0;
+unsigned long measurementFrameStartMillis = 0;
+
+struct RawStreamFrame {
+  uint8_t length;
+  uint8_t data[RAW_STREAM_FRAME_MAX_LENGTH];
+};
+
+uint16_t rawStreamRate = 0;  // Hz, 0 when streaming is off
+uint32_t rawStreamLatestIR = 0;
+uint16_t rawStreamSequence = 0;
+bool isRawStreamGap = false;
+RawStreamFrame rawStreamFrame;  // frame being filled
+uint8_t rawStreamFrameCount = 0;
+uint32_t rawStreamFramePrevious = 0;
+unsigned long rawStreamFrameStartMillis = 0;
+uint32_t rawStreamSentFrames = 0;
+uint32_t rawStreamDroppedFrames = 0;
+
+bool isLogReady = false;
+uint16_t logSession = 0;
+uint8_t logProfile = 0;
+uint32_t logRecordCount = 0;
+uint32_t logFirstIndex = 0;
+// loop() queues records and logTask() writes and erases them, while the BLE
+// and web tasks read. logMutex only covers the index below; logReadMutex is
+// held while a segment is open for reading, so logTask() never removes one
+// under a reader.
+QueueHandle_t logRecordQueue = NULL;
+SemaphoreHandle_t logMutex = NULL;
+SemaphoreHandle_t logReadMutex = NULL;
+LogSegment logSegments[LOG_MAX_SEGMENTS];  // oldest first, changed by logTask() only
+int logSegmentCount = 0;
+File logReadFile;  // segment last read by readLogRecords(), under logReadMutex
+uint32_t logReadFileIndex = 0;
+uint32_t logTimeSyncedUnix = 0;  // 0 until the central sets the time
+unsigned long logTimeSyncedMillis = 0;
+bool isLogTransferring = false;
+uint32_t logTransferIndex = 0;
+uint32_t logTransferEndIndex = 0;
+
+float lockWindow[LOCK_WINDOW_SAMPLES];
+int lockWindowCount = 0;
+bool isReadingLocked = false;
+
 // -- End Global Variables --
 
 // -- Global Setting --
@@ -134,6 +892,12 @@ float coefficient_2 = 0.00284;
 float coefficient_3 = 0;
 float irOffset;
 
+// The variable below use to decide when agtron, particle sensor and meter
+// state are notified
+float agtronDeadband = 0.5;    // !EEPROM setup
+uint16_t irDeadband = 200;     // !EEPROM setup
+uint16_t notifyHeartbeat = 5;  // !EEPROM setup, seconds
+
 // BLE
 String bleName;  // !EEPROM setup
 
@@ -141,24 +905,103 @@ String bleName;  // !EEPROM setup
 
 // -- Setup Headers --
 
-//void setupFuelGuage();
+void bootRadioTask(void *parameter);
+void bleTask(void *parameter);
+void settingsTask(void *parameter);
+void logTask(void *parameter);
+void webTask(void *parameter);
+void connectionProfileJob();
+void requestConnectionProfile(uint8_t profile);
+void accountConnectionProfile();
+void setupFuelGuage();
 void setupEEPROM();
 void setupBLE();
-void setupParticleSensor();
-void setupOTA();
+void setupParticleSensor(bool isConfigKept = false);
+void setupWebServer();
+void setupLog();
+void setupMqtt();
 
 // -- Setup Headers --
 
 // -- Sub Routine Headers --
 
-bool handleWifiAndOTA();
-//void updateFuelGuage(bool force = false);
+void startWiFi();
+void stopWiFi();
+void wifiButtonJob();
+void mqttJob();
+void publishMqttBatch();
+uint32_t loadMqttCursor();
+void saveMqttCursor();
+void checkpointMqttCursor();
+void displayFirmwareUpdate();
+void firmwareUpdateProgress(size_t progress, size_t size);
+void handleGzipUpdateUpload();
+void handleGzipUpdateRequest();
+void startGzipUpdate();
+void writeGzipUpdate(const uint8_t *data, size_t length);
+void finishGzipUpdate();
+void failGzipUpdate(const char *error);
+void releaseGzipUpdate();
+size_t gzipHeaderLength(const uint8_t *data, size_t length);
+void handleEventsRequest();
+void handleLogExportRequest(bool isJson);
+size_t formatLogRecord(char *line, uint32_t index, const LogRecord &record, bool isJson);
+void handleMetricsRequest();
+void sendDashboardAsset(const uint8_t *data, size_t length, const char *contentType, const char *etag, const char *cacheControl);
+void handleSettingsRequest();
+void handleSettingsUpdateRequest();
+bool readSettingsArg(const char *name, long minimum, long maximum, long &value, bool &isValid);
+bool readSettingsFloatArg(const char *name, float minimum, float maximum, float &value, bool &isValid);
+void sendMetric(const char *name, const char *type, const char *help, double value);
+void takeMetricsSnapshot(DeviceMetrics &metrics);
+void eventsJob();
+bool sendEvent(WiFiClient &client, const char *event, size_t length);
+void stopEventsClients();
+size_t base64Encode(const uint8_t *data, size_t length, char *encoded);
+void updateFuelGuage();
+void fuelGuageFailed(uint8_t error);
 void displayStartUp();
+bool updateStartUp();
+void displayStartUpPage(int page);
 void warmUpLED(int duration);
 void measureSampleJob();
 void displayPleaseLoadSample();
 void displaySensorDirty();
 void displayMeasurement(float agtronLevel);
+void postMeasurementSample(uint32_t irLevel, float agtronLevel, uint8_t state, uint8_t flags);
+void applyBLERequests();
+void queueMeasurementRecord(const MeasurementSample &sample);
+void sampleToMeasurementRecord(const MeasurementSample &sample, MeasurementRecord &record);
+void publishMeasurement(float agtronLevel, uint32_t irLevel, uint8_t state);
+void advertisingJob();
+void updateReadingLock(float agtronLevel, uint32_t irLevel, uint8_t flags);
+void appendLogRecord(float agtronLevel, uint32_t irLevel);
+uint32_t writeLogRecords(const LogRecord *records, uint32_t count);
+uint32_t readLogRecords(uint32_t index, LogRecord *records, uint32_t count);
+bool findLogSession(uint16_t session, uint32_t &firstIndex, uint32_t &endIndex);
+bool findLogTime(uint32_t fromTime, uint32_t toTime, uint32_t &firstIndex, uint32_t &endIndex);
+void eraseLog();
+String logSegmentPath(uint32_t firstIndex);
+void indexLogRecord(LogSegment &segment, const LogRecord &record);
+void scanLogSegment(LogSegment &segment);
+uint32_t findInLogSegment(const LogSegment &segment, bool (*isMatch)(const LogRecord &record, uint32_t value), uint32_t value);
+bool isLogRecordInSession(const LogRecord &record, uint32_t session);
+bool isLogRecordAfterSession(const LogRecord &record, uint32_t session);
+bool isLogRecordSyncedSince(const LogRecord &record, uint32_t time);
+void saveLogIndex();
+void dropOldestLogSegment();
+void updateLogInfoCharacteristic();
+void logTransferJob();
+void startLogTransfer(uint32_t firstIndex, uint32_t endIndex);
+void stopLogTransfer();
+void flushMeasurementFrame();
+void startRawStream(uint16_t rate);
+void stopRawStream();
+void rawStreamJob();
+void rawStreamSendJob();
+void drainRawStreamFifo();
+void appendRawStreamSample(uint32_t sample);
+void finishRawStreamFrame();
 
 // -- End Sub Routine Headers --
 
@@ -168,6 +1011,13 @@ BLEService roastMeterService(BLE_UUID_ROAST_METER_SERVICE);
 BLEUnsignedIntCharacteristic particleSensorCharacteristic(BLE_UUID_PARTICLE_SENSOR, BLERead | BLENotify);
 BLEByteCharacteristic agtronCharacteristic(BLE_UUID_AGTRON, BLERead | BLENotify);
 BLEByteCharacteristic meterStateCharacteristic(BLE_UUID_METER_STATE, BLERead | BLENotify);
+BLECharacteristic measurementCharacteristic(BLE_UUID_MEASUREMENT, BLERead | BLENotify, MEASUREMENT_FRAME_MAX_LENGTH);
+BLECharacteristic rawStreamCharacteristic(BLE_UUID_RAW_STREAM, BLENotify, RAW_STREAM_FRAME_MAX_LENGTH);
+BLEUnsignedShortCharacteristic rawStreamRateCharacteristic(BLE_UUID_RAW_STREAM_RATE, BLERead | BLEWrite);
+BLECharacteristic bleLatencyCharacteristic(BLE_UUID_BLE_LATENCY, BLERead, sizeof(BLELatencyStats), true);
+BLECharacteristic connectionStatsCharacteristic(BLE_UUID_CONNECTION_STATS, BLERead, sizeof(BLEConnectionStats), true);
+BLEByteCharacteristic wifiCharacteristic(BLE_UUID_WIFI, BLERead | BLEWrite | BLENotify);
+BLECharacteristic metricsCharacteristic(BLE_UUID_METRICS, BLERead, sizeof(DeviceMetrics), true);
 
 BLEService settingService(BLE_UUID_SETTING_SERVICE);
 
@@ -180,8 +1030,19 @@ BLEFloatCharacteristic coefficient2Characteristic(BLE_UUID_COEFFICIENT_2, BLERea
 BLEFloatCharacteristic coefficient3Characteristic(BLE_UUID_COEFFICIENT_3, BLERead | BLEWrite);
 BLEFloatCharacteristic irOffsetCharacteristic(BLE_UUID_IR_OFFSET, BLERead | BLEWrite);
 BLEBooleanCharacteristic autoCalibrationCharacteristic(BLE_UUID_AUTO_CALIBRATION, BLERead | BLEWrite);
+BLEFloatCharacteristic agtronDeadbandCharacteristic(BLE_UUID_AGTRON_DEADBAND, BLERead | BLEWrite);
+BLEUnsignedShortCharacteristic irDeadbandCharacteristic(BLE_UUID_IR_DEADBAND, BLERead | BLEWrite);
+BLEUnsignedShortCharacteristic notifyHeartbeatCharacteristic(BLE_UUID_NOTIFY_HEARTBEAT, BLERead | BLEWrite);
+BLECharacteristic settingsBlobCharacteristic(BLE_UUID_SETTINGS_BLOB, BLERead | BLEWrite, sizeof(SettingsBlob), true);
+BLEBooleanCharacteristic settingsSaveCharacteristic(BLE_UUID_SETTINGS_SAVE, BLEWrite);
 BLEStringCharacteristic bleNameCharacteristic(BLE_UUID_BLE_NAME, BLERead | BLEWrite, 64);
 
+BLEService logService(BLE_UUID_LOG_SERVICE);
+
+BLECharacteristic logInfoCharacteristic(BLE_UUID_LOG_INFO, BLERead | BLENotify, sizeof(LogInfo), true);
+BLECharacteristic logControlCharacteristic(BLE_UUID_LOG_CONTROL, BLEWrite, LOG_CONTROL_MAX_LENGTH);
+BLECharacteristic logDataCharacteristic(BLE_UUID_LOG_DATA, BLENotify, LOG_DATA_MAX_LENGTH);
+
 BLEService deviceInfomationService(BLE_UUID_DEVICE_INFOMATION_SERVICE);
 
 BLEStringCharacteristic firmwareRevisionCharacteristic(BLE_UUID_FIRMWARE_REVISION, BLERead | BLEWrite, 64);
@@ -202,7 +1063,16 @@ void bleCoefficient2Written(BLEDevice central, BLECharacteristic characteristic)
 void bleCoefficient3Written(BLEDevice central, BLECharacteristic characteristic);
 void bleIROffsetWritten(BLEDevice central, BLECharacteristic characteristic);
 void bleAutoCalibrationWritten(BLEDevice central, BLECharacteristic characteristic);
+void bleAgtronDeadbandWritten(BLEDevice central, BLECharacteristic characteristic);
+void bleIRDeadbandWritten(BLEDevice central, BLECharacteristic characteristic);
+void bleNotifyHeartbeatWritten(BLEDevice central, BLECharacteristic characteristic);
+void bleSettingsBlobWritten(BLEDevice central, BLECharacteristic characteristic);
+void applySettingsBlob(const SettingsBlob &blob);
+void bleSettingsSaveWritten(BLEDevice central, BLECharacteristic characteristic);
 void bleBLENameWritten(BLEDevice central, BLECharacteristic characteristic);
+void bleRawStreamRateWritten(BLEDevice central, BLECharacteristic characteristic);
+void bleLogControlWritten(BLEDevice central, BLECharacteristic characteristic);
+void bleWifiWritten(BLEDevice central, BLECharacteristic characteristic);
 
 // -- End BLE Handler Headers --
 
@@ -210,19 +1080,44 @@ void bleBLENameWritten(BLEDevice central, BLECharacteristic characteristic);
 
 String multiplyChar(char c, int n);
 String stringLastN(String input, int n);
+String bleAddressSuffix();
+void logBootStage(const char *stage, unsigned long stageStartMillis);
 float mapIRToAgtron(int rawIR);
-void writeStringToEEPROM(int addrOffset, const String &strToWrite);
+uint16_t bleConnectionHandle(BLEDevice central);
+uint16_t bleNegotiatedMtu();
 String readStringFromEEPROM(int addrOffset);
+uint16_t crc16(const uint8_t *data, size_t length);
+void settingsToBlob(SettingsBlob &blob);
+bool isSettingsBlobValid(const SettingsBlob &blob, int length);
+void updateSettingsBlobCharacteristic();
+void setDefaultSettings(StoredSettings &settings);
+bool loadStoredSettings(StoredSettings &settings);
+void loadLegacySettings(StoredSettings &settings);
+void settingsToStored(StoredSettings &settings);
+void applyStoredSettings(const StoredSettings &settings);
+void putStoredSettings(StoredSettings &settings);
+void storeSettings(bool isSaveNow = false);
+void commitSettings();
+bool loadWarmBootState();
+void saveWarmBootState();
+void cacheWarmBootSettings();
 
 // -- End Utillity Function Headers --
 
 // -- Main Process --
 void setup() {
+  bootStartMillis = millis();
+  unsigned long stageStartMillis = millis();
+
   Serial.begin(9600);
   Serial.println("setup: serial begin");
 
+  isWarmBoot = loadWarmBootState();
+  Serial.printf("setup: %s boot, reset reason %d\n", isWarmBoot ? "warm" : "cold", esp_reset_reason());
+
   Wire.begin();
-  delay(1000);
+  // The OLED and the sensor stayed powered through a warm reset
+  if (!isWarmBoot) delay(BOOT_POWER_SETTLE_MS);
 
   Serial.println("setup: OLED begin");
   if (oled.begin() == false) {
@@ -231,40 +1126,72 @@ void setup() {
       ;
   }  // Initialize the OLED
   Serial.println("setup: OLED ready");
-  oled.erase();
-  oled.rectangleFill(0, 0, oled.getWidth(), oled.getHeight());
-  oled.display();
-  oled.erase();
-  oled.display();
+  logBootStage("OLED", stageStartMillis);
 
-  //Serial.println("setup: Fuel Guage");
-  //setupFuelGuage();
-  //updateFuelGuage();
+  // Found and read from loop(), never waited for
+  setupFuelGuage();
 
+  stageStartMillis = millis();
   Serial.println("setup: EEPROM begin");
   setupEEPROM();
+  logBootStage("EEPROM", stageStartMillis);
+
+  xTaskCreatePinnedToCore(settingsTask, "settings", SETTINGS_TASK_STACK, NULL, SETTINGS_TASK_PRIORITY, NULL, SETTINGS_TASK_CORE);
+
+  stageStartMillis = millis();
+  Serial.println("setup: measurement log begin");
+  setupLog();
+  logBootStage("measurement log", stageStartMillis);
+
+  xTaskCreatePinnedToCore(logTask, "log", LOG_TASK_STACK, NULL, LOG_TASK_PRIORITY, NULL, LOG_TASK_CORE);
+
+  // Only reads the log and the cursor; webTask() connects later
+  setupMqtt();
+
+  // The splash screen is advanced from loop() by updateStartUp()
+  if (!isWarmBoot) displayStartUp();
 
+  bleSampleQueue = xQueueCreate(BLE_SAMPLE_QUEUE_LENGTH, sizeof(MeasurementSample));
+  rawStreamQueue = xQueueCreate(RAW_STREAM_QUEUE_LENGTH, sizeof(RawStreamFrame));
+  lockedReadingQueue = xQueueCreate(1, sizeof(LockedReading));
+  eventsSampleQueue = xQueueCreate(EVENTS_QUEUE_LENGTH, sizeof(MeasurementSample));
+
+  pinMode(WIFI_BUTTON_PIN, INPUT_PULLUP);
+
+  // BLE only depends on the settings loaded from EEPROM, so it is brought up
+  // on the other core while the sensor is initialised here. WiFi waits for
+  // a request.
   Serial.println("setup: BLE begin");
-  setupBLE();
+  xTaskCreatePinnedToCore(bootRadioTask, "bootRadio", BOOT_RADIO_TASK_STACK, NULL, 1, NULL, BOOT_RADIO_TASK_CORE);
 
   // Initialize sensor
+  stageStartMillis = millis();
   Serial.println("setup: particle sensor begin");
-  setupParticleSensor();
+  setupParticleSensor(isWarmBoot);
+  logBootStage("particle sensor", stageStartMillis);
 
-  Serial.println("setup: OTA server");
-  setupOTA();
-
-  Serial.println("setup: completed");
-  displayStartUp();
+  Serial.printf("setup: completed, %lu bytes of heap free with WiFi off\n", (unsigned long)ESP.getFreeHeap());
   warmUpLED(0);
 }
 
 void loop() {
-  if (handleWifiAndOTA()) return;
+  metricsCounters.loopCount++;
+
+  if (isFirmwareUpdating) {
+    displayFirmwareUpdate();
+    delay(100);
+    return;
+  }
 
-  BLE.poll();
+  applyBLERequests();
 
-  // updateFuelGuage();
+  wifiButtonJob();
+
+  updateFuelGuage();
+
+  rawStreamJob();
+
+  updateStartUp();
 
   measureSampleJob();
 }
@@ -273,135 +1200,310 @@ void loop() {
 
 // -- Setups --
 
-//void setupFuelGuage() {
-  // Set up the MAX17043 LiPo fuel gauge:
-  //if (lipo.begin() == false)  // Connect to the MAX17043 using the default wire port
-  //{
-  //  Serial.println(F("MAX17043 not detected. Please check wiring. Freezing."));
-  //  while (1)
-  //    ;
-  //}
+void bootRadioTask(void *parameter) {
+  unsigned long stageStartMillis = millis();
+  setupBLE();
+  logBootStage("BLE", stageStartMillis);
 
-  // Quick start restarts the MAX17043 in hopes of getting a more accurate
-  // guess for the SOC.
-  //lipo.quickStart();
+  // From here on only bleTask() touches ArduinoBLE
+  xTaskCreatePinnedToCore(bleTask, "ble", BLE_TASK_STACK, NULL, BLE_TASK_PRIORITY, NULL, BLE_TASK_CORE);
+  isBLEReady = true;
 
-  //lipo.isReset(true);
-  //lipo.clearAlert();
+  // From here on only webTask() touches WiFi and the web server
+  xTaskCreatePinnedToCore(webTask, "web", WEB_TASK_STACK, NULL, WEB_TASK_PRIORITY, NULL, WEB_TASK_CORE);
 
-  // We can set an interrupt to alert when the battery SoC gets too low.
-  // We can alert at anywhere between 1% - 32%:
-  //lipo.setThreshold(30);  // Set alert threshold to 20%.
+  vTaskDelete(NULL);
+}
 
-  //updateFuelGuage(true);
-//}
+// Brings WiFi up when requested, serves web and OTA requests alongside
+// sensing, and turns WiFi off again on request or once no station has joined
+// for WEB_IDLE_TIMEOUT_MS
+void webTask(void *parameter) {
+  unsigned long lastStationMillis = millis();
 
-void setupEEPROM() {
-  // Flash Wrapper using EEPROM API
-  EEPROM.begin(EEPROM_MAX_LENGTH);
+  for (;;) {
+    mqttJob();
+
+    if (!isWifiOn) {
+      if (!isWifiRequested) {
+        delay(WEB_TASK_OFF_INTERVAL_MS);
+        continue;
+      }
+
+      startWiFi();
+      lastStationMillis = millis();
+    }
+
+    if (WiFi.softAPgetStationNum() > 0) lastStationMillis = millis();
+
+    server.handleClient();
+    eventsJob();
+
+    bool isUpdating = Update.isRunning();
+    if (isUpdating) {
+      firmwareUpdateProgress(Update.progress(), Update.size());
+    } else if (isFirmwareUpdating) {
+      isFirmwareUpdating = false;
+      MyAction_onOTAEnd();
+    }
+
+    if (isFirmwareRestartPending && millis() - firmwareRestartMillis >= OTA_RESTART_DELAY_MS) {
+      isFirmwareRestartPending = false;
+      Serial.println("Restarting into the new firmware");
+      ESP.restart();
+    }
+
+    if (!isUpdating && !isWifiRequested) {
+      stopWiFi();
+    } else if (!isUpdating && millis() - lastStationMillis > WEB_IDLE_TIMEOUT_MS) {
+      Serial.println("OTA Timeout Closing WiFi and Server");
+      stopWiFi();
+    }
+
+    delay(WEB_TASK_POLL_INTERVAL_MS);
+  }
+}
+
+// Services BLE events at a bounded interval regardless of what loop() is
+// doing, and does all notifications so a slow central never stalls sensing.
+void bleTask(void *parameter) {
+  unsigned long pollEndMicros = micros();
+  unsigned long latencyReportMillis = millis();
+  unsigned long metricsMillis = millis();
+
+  for (;;) {
+    unsigned long pollStartMicros = micros();
+    BLE.poll();
+    unsigned long pollMicros = micros() - pollStartMicros;
+    unsigned long pollGapMicros = pollStartMicros - pollEndMicros;
+
+    bleLatencyStats.worstPollGapUs = max(bleLatencyStats.worstPollGapUs, (uint32_t)pollGapMicros);
+    bleLatencyStats.worstPollUs = max(bleLatencyStats.worstPollUs, (uint32_t)pollMicros);
+    bleLatencyStats.worstResponseUs = max(bleLatencyStats.worstResponseUs, (uint32_t)(pollGapMicros + pollMicros));
+
+    bleMtu = bleNegotiatedMtu();
+    isRawStreamSubscribed = rawStreamCharacteristic.subscribed();
+
+    uint32_t backlog = uxQueueMessagesWaiting(bleSampleQueue);
+    if (backlog > metricsCounters.worstBLEBacklog) metricsCounters.worstBLEBacklog = backlog;
+
+    MeasurementSample sample;
+    while (xQueueReceive(bleSampleQueue, &sample, 0) == pdTRUE) {
+      if (sample.state == STATE_MEASURED) {
+        publishMeasurement(sample.agtronLevel, sample.irLevel, sample.state);
+      } else {
+        publishMeasurement(0, 0, sample.state);
+      }
+      queueMeasurementRecord(sample);
+    }
+
+    rawStreamSendJob();
+
+    logTransferJob();
 
-  // use EEPROM.get(int index, T type) to retrieve
-  // an arbitrary type from flash memory
-  uint8_t eeprom_valid;
-  EEPROM.get(EEPROM_VALID_IDX, eeprom_valid);
+    connectionProfileJob();
 
-  if (eeprom_valid != EEPROM_VALID_CODE) {
-    Serial.println("EEPROM was invalid");
+    advertisingJob();
+
+    uint8_t wifiState = isWifiOn ? WIFI_STATE_ON : WIFI_STATE_OFF;
+    if (wifiState != publishedWifiState) {
+      publishedWifiState = wifiState;
+      wifiCharacteristic.writeValue(wifiState);
+    }
+
+    if (isLogInfoDirty) {
+      isLogInfoDirty = false;
+      updateLogInfoCharacteristic();
+    }
 
-    // use EEPROM.put(int index, T type) to store
-    // a variable in psuedo-eeprom flash memory
-    // use a variable with a type so that EEPROM
-    // knows how much memory to use
-    uint8_t code_to_store = EEPROM_VALID_CODE;
-    EEPROM.put(EEPROM_VALID_IDX, code_to_store);
+    if (isWebSettingsPending) {
+      applySettingsBlob(webSettingsBlob);
+      isWebSettingsPending = false;
+    }
 
-    // store default LED brightness value in EEPROM
-    uint8_t led_brightness_to_store = EEPROM_LED_BRIGHTNESS_DEFAULT;
-    EEPROM.put(EEPROM_LED_BRIGHTNESS_IDX, led_brightness_to_store);
+    if (millis() - metricsMillis >= METRICS_BLE_INTERVAL_MS) {
+      metricsMillis = millis();
+      DeviceMetrics metrics;
+      takeMetricsSnapshot(metrics);
+      metricsCharacteristic.writeValue((const uint8_t *)&metrics, sizeof(DeviceMetrics));
+    }
 
-    // store default intersection point value in EEPROM
-    uint8_t intersection_point_to_store = EEPROM_INTERSECTION_POINT_DEFAULT;
-    EEPROM.put(EEPROM_INTERSECTION_POINT_IDX, intersection_point_to_store);
+    if (millis() - latencyReportMillis >= BLE_LATENCY_REPORT_INTERVAL_MS) {
+      latencyReportMillis = millis();
+      bleLatencyCharacteristic.writeValue((const uint8_t *)&bleLatencyStats, sizeof(BLELatencyStats));
+      Serial.printf("BLE worst poll gap %luus, poll %luus, response %luus, dropped %lu samples\n", (unsigned long)bleLatencyStats.worstPollGapUs,
+                    (unsigned long)bleLatencyStats.worstPollUs, (unsigned long)bleLatencyStats.worstResponseUs, (unsigned long)bleLatencyStats.droppedSamples);
+
+      accountConnectionProfile();
+      connectionStatsCharacteristic.writeValue((const uint8_t *)&bleConnectionStats, sizeof(BLEConnectionStats));
+      for (int i = 0; i < BLE_PROFILE_COUNT; i++) {
+        BLEProfileStats &stats = bleConnectionStats.profiles[i];
+        if (stats.activeMs == 0) continue;
+
+        Serial.printf("BLE profile %s: %lus, %lu B/s, %lu wake-ups/s\n", bleConnectionProfiles[i].name, (unsigned long)(stats.activeMs / 1000),
+                      (unsigned long)(stats.notifiedBytes * 1000ULL / stats.activeMs), (unsigned long)(stats.radioWakeups * 1000ULL / stats.activeMs));
+      }
+    }
 
-    // store default deviation value in EEPROM
-    float deviation_to_store = EEPROM_DEVIATION_DEFAULT;
-    EEPROM.put(EEPROM_DEVIATION_IDX, deviation_to_store);
+    pollEndMicros = micros();
 
-    float coefficient_0_to_store = EEPROM_COEFFICIENT_0_DEFAULT;
-    EEPROM.put(EEPROM_COEFFICIENT_0_IDX, coefficient_0_to_store);
+    // Wakes early when a sample is queued
+    xQueuePeek(bleSampleQueue, &sample, pdMS_TO_TICKS(BLE_TASK_POLL_INTERVAL_MS));
+  }
+}
 
-    float coefficient_1_to_store = EEPROM_COEFFICIENT_1_DEFAULT;
-    EEPROM.put(EEPROM_COEFFICIENT_1_IDX, coefficient_1_to_store);
+// Commits staged settings once writes have stopped for
+// SETTINGS_COMMIT_QUIET_MS, or straight away when a central asks for a save
+// or the battery is about to run out.
+void settingsTask(void *parameter) {
+  for (;;) {
+    vTaskDelay(pdMS_TO_TICKS(SETTINGS_COMMIT_POLL_MS));
 
-    float coefficient_2_to_store = EEPROM_COEFFICIENT_2_DEFAULT;
-    EEPROM.put(EEPROM_COEFFICIENT_2_IDX, coefficient_2_to_store);
+    if (!isSettingsDirty) continue;
 
-    float coefficient_3_to_store = EEPROM_COEFFICIENT_3_DEFAULT;
-    EEPROM.put(EEPROM_COEFFICIENT_3_IDX, coefficient_3_to_store);
+    bool isLowBattery = fuelGuageVoltage > 0 && fuelGuageVoltage < SETTINGS_LOW_BATTERY_VOLTAGE;
+    bool isQuiet = millis() - settingsDirtyMillis >= SETTINGS_COMMIT_QUIET_MS;
+    if (isSettingsSaveRequested || isLowBattery || isQuiet) commitSettings();
+  }
+}
 
-    float ir_offset_to_store = EEPROM_IR_OFFSET_DEFAULT;
-    EEPROM.put(EEPROM_IR_OFFSET_IDX, ir_offset_to_store);
+// Writes the records loop() queues, a few at a time, so a locked reading
+// never waits on flash. Erases the log when a central asks.
+void logTask(void *parameter) {
+  LogRecord records[LOG_TASK_BATCH_RECORDS];
 
-    EEPROM.commit();
+  for (;;) {
+    uint32_t count = 0;
+    if (xQueueReceive(logRecordQueue, &records[0], pdMS_TO_TICKS(LOG_TASK_POLL_MS)) == pdTRUE) {
+      count = 1;
+      while (count < LOG_TASK_BATCH_RECORDS && xQueueReceive(logRecordQueue, &records[count], 0) == pdTRUE) count++;
+    }
+    if (count > 0 && writeLogRecords(records, count) != count) Serial.println("Measurement log append failed");
 
-    // store default BLE name in EEPROM
-    BLE.begin();
-    String ble_name_to_store = "Roast Meter " + stringLastN(BLE.address(), 5);
-    writeStringToEEPROM(EEPROM_BLE_NAME_IDX, ble_name_to_store);
+    if (isLogErasePending) {
+      isLogErasePending = false;
 
-    Serial.println("EEPROM initialized");
+      eraseLog();
+      Serial.println("Measurement log erased");
+    }
   }
+}
+
+// Fast while raw samples are streaming or the log is downloading, slow
+// otherwise. Switching back to slow waits out BLE_PROFILE_IDLE_MS so a
+// client that restarts a download straight away does not bounce profiles.
+void connectionProfileJob() {
+  if (bleCentralHandle == BLE_CONNECTION_HANDLE_NONE) return;
+
+  accountConnectionProfile();
+
+  if (rawStreamRate > 0 || isLogTransferring) bleFastActivityMillis = millis();
+  if (millis() - bleConnectedMillis < BLE_PROFILE_SETTLE_MS) return;
+
+  uint8_t profile = millis() - bleFastActivityMillis < BLE_PROFILE_IDLE_MS ? BLE_PROFILE_FAST : BLE_PROFILE_SLOW;
+  if (profile == bleProfile) return;
+  if (profile == bleRefusedProfile && millis() - bleProfileRefusedMillis < BLE_PROFILE_RETRY_MS) return;
+
+  requestConnectionProfile(profile);
+}
 
-  EEPROM.get(EEPROM_VALID_IDX, eeprom_valid);
-  if (eeprom_valid != EEPROM_VALID_CODE) {
-    Serial.println("EEPROM CAN NOT initialized");
-    while (1) {
-    };
+void requestConnectionProfile(uint8_t profile) {
+  const BLEConnectionProfile &parameters = bleConnectionProfiles[profile];
+
+  // The central may still pick other parameters within the requested range
+  if (HCI.leConnUpdate(bleCentralHandle, parameters.minInterval, parameters.maxInterval, parameters.latency, parameters.supervisionTimeout) != 0) {
+    // The connection keeps its parameters, and its time stays booked against
+    // the profile it is in until connectionProfileJob() asks again
+    Serial.printf("BLE connection profile %s request failed\n", parameters.name);
+    bleRefusedProfile = profile;
+    bleProfileRefusedMillis = millis();
+    return;
   }
+  Serial.printf("BLE connection profile %s requested\n", parameters.name);
 
-  Serial.println("EEPROM is valid");
+  bleRefusedProfile = BLE_PROFILE_NONE;
+  bleProfile = profile;
+  bleConnectionStats.profile = profile;
+}
 
-  // Load setting from EEPROM
+// Books connected time and notified bytes since the last call against the
+// current profile. Time before the first accepted request is left out.
+void accountConnectionProfile() {
+  unsigned long now = millis();
+  uint32_t elapsedMs = now - bleProfileAccountedMillis;
+  uint32_t bytes = bleNotifiedBytes - bleProfileAccountedBytes;
+  bleProfileAccountedMillis = now;
+  bleProfileAccountedBytes = bleNotifiedBytes;
+
+  if (bleProfile >= BLE_PROFILE_COUNT || bleCentralHandle == BLE_CONNECTION_HANDLE_NONE) return;
+
+  const BLEConnectionProfile &parameters = bleConnectionProfiles[bleProfile];
+  BLEProfileStats &stats = bleConnectionStats.profiles[bleProfile];
+  stats.activeMs += elapsedMs;
+  stats.notifiedBytes += bytes;
+
+  // Connection events every maxInterval * 1.25ms, with up to latency of them
+  // skipped while there is nothing to send
+  stats.radioWakeups = (uint64_t)stats.activeMs * 4 / (parameters.maxInterval * 5 * (parameters.latency + 1));
+}
 
-  uint8_t eeprom_led_brightness;
-  EEPROM.get(EEPROM_LED_BRIGHTNESS_IDX, eeprom_led_brightness);
-  ledBrightness = eeprom_led_brightness;
-  Serial.println("Set ledBrightness to " + String(ledBrightness));
+// Only picks the bus; updateFuelGuage() finds the gauge
+void setupFuelGuage() {
+  lipo.setWirePort(Wire);
 
-  uint8_t eeprom_intersection_point;
-  EEPROM.get(EEPROM_INTERSECTION_POINT_IDX, eeprom_intersection_point);
-  intersectionPoint = eeprom_intersection_point;
-  Serial.println("Set intersection point to " + String(intersectionPoint));
+  fuelGuageState = FUEL_GUAGE_STATE_DETECT;
+  fuelGuageDueMillis = millis();
+}
 
-  float eeprom_deviation;
-  EEPROM.get(EEPROM_DEVIATION_IDX, eeprom_deviation);
-  deviation = eeprom_deviation;
-  Serial.print("Set deviation to ");
-  Serial.print(deviation, 4);
-  Serial.println();
+void setupEEPROM() {
+  // Flash Wrapper using EEPROM API
+  EEPROM.begin(EEPROM_MAX_LENGTH);
+  settingsMutex = xSemaphoreCreateMutex();
 
-  EEPROM.get(EEPROM_COEFFICIENT_0_IDX, coefficient_0);
-  Serial.print("Set coefficient_0 to ");
-  Serial.println(coefficient_0, 8);
+  if (isWarmBoot && warmBootState.isSettingsCached) {
+    settingsSequence = warmBootState.settings.sequence;
+    applyStoredSettings(warmBootState.settings);
 
-  EEPROM.get(EEPROM_COEFFICIENT_1_IDX, coefficient_1);
-  Serial.print("Set coefficient_1 to ");
-  Serial.println(coefficient_1, 8);
+    Serial.printf("Settings v%u #%lu cached in RTC memory\n", warmBootState.settings.version, (unsigned long)settingsSequence);
+    return;
+  }
 
-  EEPROM.get(EEPROM_COEFFICIENT_2_IDX, coefficient_2);
-  Serial.print("Set coefficient_2 to ");
-  Serial.println(coefficient_2, 8);
+  unsigned long loadStartMicros = micros();
+  StoredSettings settings;
+  const char *source = "stored";
 
-  EEPROM.get(EEPROM_COEFFICIENT_3_IDX, coefficient_3);
-  Serial.print("Set coefficient_3 to ");
-  Serial.println(coefficient_3, 8);
+  if (loadStoredSettings(settings)) {
+    settingsSequence = settings.sequence;
+  } else {
+    uint8_t eeprom_valid;
+    EEPROM.get(EEPROM_VALID_IDX, eeprom_valid);
 
-  EEPROM.get(EEPROM_IR_OFFSET_IDX, irOffset);
-  Serial.print("Set IR Offset to ");
-  Serial.println(irOffset, 3);
+    if (eeprom_valid == EEPROM_VALID_CODE) {
+      loadLegacySettings(settings);
+      source = "migrated";
+    } else {
+      setDefaultSettings(settings);
+      source = "defaults";
+    }
+  }
+
+  // settingsTask() is not running yet, so commit straight through
+  bool isRewriteNeeded = strcmp(source, "stored") != 0 || settings.version != SETTINGS_STORE_VERSION || settings.length != sizeof(StoredSettings);
+  if (isRewriteNeeded) {
+    stagedSettings = settings;
+    commitSettings();
+  }
+
+  applyStoredSettings(settings);
 
-  bleName = readStringFromEEPROM(EEPROM_BLE_NAME_IDX);
-  Serial.println("Set BLE name to " + String(bleName));
+  xSemaphoreTake(settingsMutex, portMAX_DELAY);
+  cacheWarmBootSettings();
+  xSemaphoreGive(settingsMutex);
+
+  Serial.printf("Settings v%u #%lu %s in %luus: LED %u, intersection %d, deviation %.4f, coefficients %.8f %.8f %.8f %.8f, IR offset %.3f, "
+                "deadband %.2f agtron %u IR, heartbeat %us, BLE name %s\n",
+                settings.version, (unsigned long)settingsSequence, source, micros() - loadStartMicros, ledBrightness, intersectionPoint, deviation, coefficient_0, coefficient_1,
+                coefficient_2, coefficient_3, irOffset, agtronDeadband, irDeadband, notifyHeartbeat, bleName.c_str());
 }
 
 void setupBLE() {
@@ -414,11 +1516,20 @@ void setupBLE() {
   BLE.setDeviceName(bleName.c_str());
   // set the UUID for the service this peripheral advertises
   BLE.setAdvertisedService(roastMeterService);
+  BLE.setManufacturerData(ADVERTISING_COMPANY_ID, (const uint8_t *)&advertisingPayload, sizeof(AdvertisingPayload));
+  advertisedPayload = advertisingPayload;
 
   // add the characteristic to the service
   roastMeterService.addCharacteristic(particleSensorCharacteristic);
   roastMeterService.addCharacteristic(agtronCharacteristic);
   roastMeterService.addCharacteristic(meterStateCharacteristic);
+  roastMeterService.addCharacteristic(measurementCharacteristic);
+  roastMeterService.addCharacteristic(rawStreamCharacteristic);
+  roastMeterService.addCharacteristic(rawStreamRateCharacteristic);
+  roastMeterService.addCharacteristic(bleLatencyCharacteristic);
+  roastMeterService.addCharacteristic(connectionStatsCharacteristic);
+  roastMeterService.addCharacteristic(wifiCharacteristic);
+  roastMeterService.addCharacteristic(metricsCharacteristic);
 
   settingService.addCharacteristic(ledBrightnessLevelCharacteristic);
   settingService.addCharacteristic(intersectionPointCharacteristic);
@@ -429,13 +1540,23 @@ void setupBLE() {
   settingService.addCharacteristic(coefficient3Characteristic);
   settingService.addCharacteristic(irOffsetCharacteristic);
   settingService.addCharacteristic(autoCalibrationCharacteristic);
+  settingService.addCharacteristic(agtronDeadbandCharacteristic);
+  settingService.addCharacteristic(irDeadbandCharacteristic);
+  settingService.addCharacteristic(notifyHeartbeatCharacteristic);
+  settingService.addCharacteristic(settingsBlobCharacteristic);
+  settingService.addCharacteristic(settingsSaveCharacteristic);
   settingService.addCharacteristic(bleNameCharacteristic);
 
+  logService.addCharacteristic(logInfoCharacteristic);
+  logService.addCharacteristic(logControlCharacteristic);
+  logService.addCharacteristic(logDataCharacteristic);
+
   deviceInfomationService.addCharacteristic(firmwareRevisionCharacteristic);
 
   // add service
   BLE.addService(roastMeterService);
   BLE.addService(settingService);
+  BLE.addService(logService);
   BLE.addService(deviceInfomationService);
 
   // assign event handlers for connected, disconnected to peripheral
@@ -457,24 +1578,56 @@ void setupBLE() {
 
   autoCalibrationCharacteristic.setEventHandler(BLEWritten, bleAutoCalibrationWritten);
 
+  agtronDeadbandCharacteristic.setEventHandler(BLEWritten, bleAgtronDeadbandWritten);
+  irDeadbandCharacteristic.setEventHandler(BLEWritten, bleIRDeadbandWritten);
+  notifyHeartbeatCharacteristic.setEventHandler(BLEWritten, bleNotifyHeartbeatWritten);
+
+  settingsBlobCharacteristic.setEventHandler(BLEWritten, bleSettingsBlobWritten);
+  settingsSaveCharacteristic.setEventHandler(BLEWritten, bleSettingsSaveWritten);
+
   bleNameCharacteristic.setEventHandler(BLEWritten, bleBLENameWritten);
 
+  rawStreamRateCharacteristic.setEventHandler(BLEWritten, bleRawStreamRateWritten);
+
+  logControlCharacteristic.setEventHandler(BLEWritten, bleLogControlWritten);
+
+  wifiCharacteristic.setEventHandler(BLEWritten, bleWifiWritten);
+
   // Assign current value and setting for BLE Characteristic
   particleSensorCharacteristic.setValue(0);
   agtronCharacteristic.setValue(0);
   meterStateCharacteristic.setValue(STATE_SETUP);
+  measurementFrame[0] = MEASUREMENT_FRAME_VERSION;
+  measurementFrame[1] = 0;
+  measurementCharacteristic.setValue(measurementFrame, MEASUREMENT_FRAME_HEADER_LENGTH);
+  rawStreamRateCharacteristic.setValue(0);
+  wifiCharacteristic.setValue(publishedWifiState);
+  DeviceMetrics metrics;
+  takeMetricsSnapshot(metrics);
+  metricsCharacteristic.setValue((const uint8_t *)&metrics, sizeof(DeviceMetrics));
+  updateLogInfoCharacteristic();
+  bleLatencyCharacteristic.setValue((const uint8_t *)&bleLatencyStats, sizeof(BLELatencyStats));
+  memset(&bleConnectionStats, 0, sizeof(BLEConnectionStats));
+  bleConnectionStats.profile = BLE_PROFILE_NONE;
+  connectionStatsCharacteristic.setValue((const uint8_t *)&bleConnectionStats, sizeof(BLEConnectionStats));
 
   ledBrightnessLevelCharacteristic.setValue(ledBrightness);
   intersectionPointCharacteristic.setValue(intersectionPoint);
   deviationCharacteristic.setValue(deviation);
   coefficient0Characteristic.setValue(coefficient_0);
-  coefficient0Characteristic.setValue(coefficient_1);
-  coefficient0Characteristic.setValue(coefficient_2);
-  coefficient0Characteristic.setValue(coefficient_3);
+  coefficient1Characteristic.setValue(coefficient_1);
+  coefficient2Characteristic.setValue(coefficient_2);
+  coefficient3Characteristic.setValue(coefficient_3);
   irOffsetCharacteristic.setValue(irOffset);
 
   autoCalibrationCharacteristic.setValue(false);
 
+  agtronDeadbandCharacteristic.setValue(agtronDeadband);
+  irDeadbandCharacteristic.setValue(irDeadband);
+  notifyHeartbeatCharacteristic.setValue(notifyHeartbeat);
+
+  updateSettingsBlobCharacteristic();
+
   bleNameCharacteristic.setValue(bleName);
 
   firmwareRevisionCharacteristic.writeValue(FIRMWARE_REVISION_STRING);
@@ -485,7 +1638,9 @@ void setupBLE() {
   Serial.println(("Bluetooth® device active, waiting for connections..."));
 }
 
-void setupParticleSensor() {
+// With isConfigKept, a sensor whose configuration snapshot in RTC memory
+// matches is left running as it is instead of being reset
+void setupParticleSensor(bool isConfigKept) {
   if (particleSensor.begin(Wire, I2C_SPEED_FAST) == false)  // Use default I2C port, 400kHz speed
   {
     Serial.println("MAX30105 was not found. Please check wiring/power. ");
@@ -493,6 +1648,25 @@ void setupParticleSensor() {
       ;
   }
 
+  SensorConfig config = {ledBrightness, sampleAverage, ledMode, (uint16_t)sampleRate, (uint16_t)pulseWidth, (uint16_t)adcRange};
+
+  xSemaphoreTake(settingsMutex, portMAX_DELAY);
+  isConfigKept = isConfigKept && warmBootState.isSensorConfigured && memcmp(&warmBootState.sensorConfig, &config, sizeof(SensorConfig)) == 0;
+  if (!isConfigKept) {
+    // A reset part way through leaves the snapshot invalid
+    warmBootState.isSensorConfigured = false;
+    saveWarmBootState();
+  }
+  xSemaphoreGive(settingsMutex);
+
+  if (isConfigKept) {
+    // Samples in the FIFO were taken before the reset
+    particleSensor.wakeUp();
+    particleSensor.clearFIFO();
+    Serial.println("Particle sensor kept its configuration");
+    return;
+  }
+
   particleSensor.setup(ledBrightness, sampleAverage, ledMode, sampleRate, pulseWidth, adcRange);  // Configure sensor with these settings
 
   particleSensor.setPulseAmplitudeRed(20);
@@ -500,218 +1674,1851 @@ void setupParticleSensor() {
 
   particleSensor.disableSlots();
   particleSensor.enableSlot(2, 0x02);  // Enable only SLOT_IR_LED = 0x02
-}
 
-void setupOTA() {
-  Serial.println("WIFI SSID: " + bleName);
-  Serial.println("WIFI Password: otaupdate");
-
-  WiFi.mode(WIFI_AP);
-  WiFi.softAP(bleName, "otaupdate");
-  delay(1000);
-  IPAddress IP = IPAddress(10, 10, 10, 1);
-  IPAddress NMask = IPAddress(255, 255, 255, 0);
-  WiFi.softAPConfig(IP, IP, NMask);
-  IPAddress myIP = WiFi.softAPIP();
-  Serial.print("AP IP address: ");
-  Serial.println(myIP);
+  xSemaphoreTake(settingsMutex, portMAX_DELAY);
+  warmBootState.sensorConfig = config;
+  warmBootState.isSensorConfigured = true;
+  saveWarmBootState();
+  xSemaphoreGive(settingsMutex);
+}
 
-  server.on("/", []() {
-    server.send(200, "text/plain", "Hi! This is a sample response.");
+// Routes are registered once, the first time WiFi comes up
+void setupWebServer() {
+  server.on("/", HTTP_GET, []() {
+    sendDashboardAsset(DASHBOARD_INDEX_GZIP, DASHBOARD_INDEX_GZIP_LENGTH, "text/html", DASHBOARD_INDEX_ETAG, DASHBOARD_INDEX_CACHE_CONTROL);
+  });
+  server.on(DASHBOARD_SCRIPT_PATH, HTTP_GET, []() {
+    sendDashboardAsset(DASHBOARD_SCRIPT_GZIP, DASHBOARD_SCRIPT_GZIP_LENGTH, "text/javascript", DASHBOARD_SCRIPT_ETAG, DASHBOARD_SCRIPT_CACHE_CONTROL);
+  });
+  server.on("/settings", HTTP_GET, handleSettingsRequest);
+  server.on("/settings", HTTP_POST, handleSettingsUpdateRequest);
+  server.on("/events", HTTP_GET, handleEventsRequest);
+  server.on("/metrics", HTTP_GET, handleMetricsRequest);
+  server.on("/update.gz", HTTP_POST, handleGzipUpdateRequest, handleGzipUpdateUpload);
+  server.on("/log.csv", HTTP_GET, []() {
+    handleLogExportRequest(false);
+  });
+  server.on("/log.ndjson", HTTP_GET, []() {
+    handleLogExportRequest(true);
   });
 
+  const char *headerKeys[] = {"Range", "If-None-Match"};
+  server.collectHeaders(headerKeys, 2);
+
   ElegantOTA.begin(&server);  // Start ElegantOTA
-  server.begin();
-  Serial.println("HTTP server started");
+
+  // Uploads are read whole inside server.handleClient(), so webTask() only
+  // sees them through this
+  Update.onProgress(firmwareUpdateProgress);
 }
 
-// -- End Setups --
+void setupMqtt() {
+  isMqttEnabled = strlen(WIFI_SSID) > 0 && strlen(MQTT_HOST) > 0;
+  if (!isMqttEnabled) {
+    Serial.println("MQTT not configured, station uplink disabled");
+    return;
+  }
 
-// Sub Routines
+  mqttTopic = String(MQTT_TOPIC_PREFIX "/") + bleName + "/readings";
+  mqttClient.setServer(MQTT_HOST, MQTT_PORT);
+  mqttClient.setSocketTimeout(MQTT_SOCKET_TIMEOUT_S);
+  mqttClient.setKeepAlive(MQTT_KEEP_ALIVE_S);
+  mqttConnectMillis = millis() - MQTT_RECONNECT_INTERVAL_MS;
 
-long lastClientConnectedMillis = millis();
-bool isServerStop = false;
-bool handleWifiAndOTA() {
-  if (WiFi.softAPgetStationNum() > 0) {
-    lastClientConnectedMillis = millis();
+  mqttPublishedIndex = isLogReady ? loadMqttCursor() : 0;
+  mqttSavedIndex = mqttPublishedIndex;
+  mqttSavedMillis = millis();
+  Serial.printf("MQTT publishing to %s on %s from record %lu\n", MQTT_HOST, mqttTopic.c_str(), (unsigned long)mqttPublishedIndex);
+}
 
-    oled.erase();
-    oled.setCursor(3, 0);
-    oled.setFont(QW_FONT_8X16);
-    oled.println("OTA");
-    oled.println("UPDATE");
-    oled.display();
+void setupLog() {
+  if (logMutex == NULL) logMutex = xSemaphoreCreateMutex();
+  if (logReadMutex == NULL) logReadMutex = xSemaphoreCreateMutex();
+  if (logRecordQueue == NULL) logRecordQueue = xQueueCreate(LOG_QUEUE_LENGTH, sizeof(LogRecord));
 
-    server.handleClient();
+  if (!LittleFS.begin(true)) {
+    Serial.println("LittleFS mount failed, measurement log disabled");
+    return;
+  }
+  LittleFS.mkdir(LOG_DIRECTORY);
+
+  logSegmentCount = 0;
+  logRecordCount = 0;
+  logFirstIndex = 0;
+  logSession = 0;
+
+  // Segment files, oldest first
+  File directory = LittleFS.open(LOG_DIRECTORY);
+  if (directory) {
+    for (File file = directory.openNextFile(); file && logSegmentCount < LOG_MAX_SEGMENTS; file = directory.openNextFile()) {
+      char *suffix;
+      uint32_t firstIndex = strtoul(file.name(), &suffix, 16);
+      bool isSegment = strcmp(suffix, ".bin") == 0;
+      file.close();
+      if (!isSegment) continue;
+
+      int i = logSegmentCount++;
+      for (; i > 0 && logSegments[i - 1].firstIndex > firstIndex; i--) logSegments[i] = logSegments[i - 1];
+      memset(&logSegments[i], 0, sizeof(LogSegment));
+      logSegments[i].firstIndex = firstIndex;
+    }
+    directory.close();
+  }
 
-    return true;
+  // Full segments come from the saved index, the rest are read
+  File indexFile = LittleFS.open(LOG_INDEX_PATH, "r");
+  if (indexFile) {
+    LogSegment entry;
+    int i = 0;
+    while (indexFile.read((uint8_t *)&entry, sizeof(LogSegment)) == sizeof(LogSegment)) {
+      while (i < logSegmentCount && logSegments[i].firstIndex < entry.firstIndex) i++;
+      if (i < logSegmentCount && logSegments[i].firstIndex == entry.firstIndex && entry.recordCount == LOG_SEGMENT_RECORDS) logSegments[i] = entry;
+    }
+    indexFile.close();
   }
 
-  if (!isServerStop && millis() - lastClientConnectedMillis > 1000 * 60 * 3) {
-    Serial.println("OTA Timeout Closing WiFi and Server");
-    WiFi.mode(WIFI_OFF);
+  int scannedSegments = 0;
+  bool isIndexStale = false;
+  for (int i = 0; i < logSegmentCount; i++) {
+    if (logSegments[i].recordCount == LOG_SEGMENT_RECORDS) continue;
 
-    isServerStop = true;
+    scanLogSegment(logSegments[i]);
+    scannedSegments++;
+    if (logSegments[i].recordCount == LOG_SEGMENT_RECORDS) isIndexStale = true;
   }
 
-  return false;
-}
+  if (logSegmentCount > 0) {
+    const LogSegment &newest = logSegments[logSegmentCount - 1];
+    logFirstIndex = logSegments[0].firstIndex;
+    logRecordCount = newest.firstIndex + newest.recordCount;
+    if (isIndexStale) saveLogIndex();
+  }
 
-//long lastFuelGuageUpdateMillis = millis();
-//void updateFuelGuage(bool force) {
-  //if (force || millis() - lastFuelGuageUpdateMillis > 10000) {
-    //lastFuelGuageUpdateMillis = millis();
+  for (int i = logSegmentCount - 1; i >= 0; i--) {
+    if (logSegments[i].recordCount == 0) continue;
+    logSession = logSegments[i].lastSession + 1;
+    break;
+  }
 
-    //fuelGuageVoltage = lipo.getVoltage();
-    // lipo.getSOC() returns the estimated state of charge (e.g. 79%)
-    //fuelGuageSOC = lipo.getSOC();
-    // lipo.getAlert() returns a 0 or 1 (0=alert not triggered)
-    //fuelGuageAlert = lipo.getAlert(true);
+  isLogReady = true;
+  Serial.println("Measurement log has records " + String(logFirstIndex) + " to " + String(logRecordCount) + " in " + String(logSegmentCount) +
+                 " segments, " + String(scannedSegments) + " scanned, session " + String(logSession));
+}
 
-    //fuelGuageChargeRate = lipo.getChangeRate();
+// -- End Setups --
 
-    //Serial.print("Fuel Guage Status: ");
-    //Serial.print(fuelGuageVoltage, 2);
-    //Serial.print("V, ");
-    //Serial.print(fuelGuageSOC, 2);
-    //Serial.print("%, Alert Flag = ");
-    //Serial.println(fuelGuageAlert);
-    //Serial.print("%, Charge Rate = ");
-    //Serial.println(fuelGuageChargeRate);
+// Sub Routines
 
-    //if (fuelGuageVoltage <= 3.6) {
-      //Serial.println("Low Battery! Please Charge");
-      //oled.erase();
-      //oled.setCursor(0, 0);
-      //oled.setFont(QW_FONT_8X16);
-      //oled.println("LOW");
-      //oled.print("BATTERY");
-      //oled.setFont(QW_FONT_5X7);
-      //oled.print(fuelGuageVoltage);
-      //oled.print("v ");
-      //oled.display();
+// Keeps the connection open as an event stream for eventsJob()
+void handleEventsRequest() {
+  int slot = 0;
+  while (slot < EVENTS_MAX_CLIENTS && eventsClients[slot].fd() >= 0) slot++;
+  if (slot == EVENTS_MAX_CLIENTS) {
+    server.send(503, "text/plain", "Too many event streams");
+    return;
+  }
 
-      //delay(3000);
-    //}
-  //}
-//}
+  WiFiClient client = server.client();
+  client.setNoDelay(true);
+  client.print("HTTP/1.1 200 OK\r\n"
+               "Content-Type: text/event-stream\r\n"
+               "Cache-Control: no-cache\r\n"
+               "Connection: keep-alive\r\n"
+               "Access-Control-Allow-Origin: *\r\n"
+               "\r\n"
+               "retry: 2000\n\n");
+
+  eventsClients[slot] = client;
+  eventsClientCount++;
+  eventsSentMillis = millis();
+
+  Serial.println("Event stream " + String(slot) + " opened, " + String(eventsClientCount) + " following");
+}
 
-void displayStartUp() {
-  oled.erase();
-  oled.setCursor(3, 0);
-  oled.setFont(QW_FONT_8X16);
-  oled.println("ROAST");
-  oled.println("METER");
-  oled.setFont(QW_FONT_5X7);
-  oled.println(FIRMWARE_REVISION_STRING);
-  oled.display();
+void handleLogExportRequest(bool isJson) {
+  if (!isLogReady) {
+    server.send(503, "text/plain", "Measurement log unavailable");
+    return;
+  }
 
-  delay(3000);
+  uint32_t firstIndex = logFirstIndex;
+  uint32_t endIndex = logRecordCount;
+  uint32_t first, end;
 
-  oled.erase();
-  oled.setCursor(3, 0);
-  oled.setFont(QW_FONT_8X16);
-  oled.print(bleName);
-  oled.display();
+  if (server.hasArg("session")) {
+    if (!findLogSession(strtoul(server.arg("session").c_str(), NULL, 10), first, end)) first = end = endIndex;
+    firstIndex = max(firstIndex, first);
+    endIndex = min(endIndex, end);
+  }
 
-  delay(3000);
+  if (server.hasArg("from") || server.hasArg("to")) {
+    uint32_t fromTime = server.hasArg("from") ? strtoul(server.arg("from").c_str(), NULL, 10) : 0;
+    uint32_t toTime = server.hasArg("to") ? strtoul(server.arg("to").c_str(), NULL, 10) : UINT32_MAX;
+    if (!findLogTime(fromTime, toTime, first, end)) first = end = endIndex;
+    firstIndex = max(firstIndex, first);
+    endIndex = min(endIndex, end);
+  }
 
-  oled.erase();
-  oled.setCursor(3, 0);
-  oled.setFont(QW_FONT_5X7);
-  oled.println("Build By");
-  oled.setFont(QW_FONT_8X16);
-  oled.setCursor(3, 13);
-  oled.print("HORIZON");
-  oled.print("HARVEST");
-  oled.display();
+  bool isResumed = false;
+  if (server.hasArg("start")) {
+    firstIndex = max(firstIndex, (uint32_t)strtoul(server.arg("start").c_str(), NULL, 10));
+    isResumed = true;
+  }
 
-  delay(2000);
-}
+  if (server.hasArg("last")) {
+    uint32_t last = strtoul(server.arg("last").c_str(), NULL, 10);
+    if (firstIndex < endIndex && endIndex - firstIndex > last) firstIndex = endIndex - last;
+  }
 
-void warmUpLED(int duration) {
-  if (duration <= 0)
-    return;
+  bool isRange = false;
+  String range = server.header("Range");
+  if (range.startsWith("records=") && isdigit(range[8])) {
+    char *rangeEnd;
+    first = strtoul(range.c_str() + 8, &rangeEnd, 10);
+    if (*rangeEnd == '-') {
+      isRange = true;
+      firstIndex = max(firstIndex, first);
+      if (isdigit(rangeEnd[1])) endIndex = min(endIndex, (uint32_t)strtoul(rangeEnd + 1, NULL, 10) + 1);
+    }
+  }
 
-  meterStateCharacteristic.writeValue(STATE_WARMUP);
+  if (isRange && firstIndex >= endIndex) {
+    server.sendHeader("Content-Range", "records */" + String(logRecordCount));
+    server.send(416, "text/plain", "Range not satisfiable");
+    return;
+  }
 
-  int countDownSeconds = duration;
-  unsigned long jobTimerStart = millis();
-  unsigned long jobTimer = jobTimerStart;
+  server.sendHeader("Accept-Ranges", "records");
+  if (isRange) server.sendHeader("Content-Range", "records " + String(firstIndex) + "-" + String(endIndex - 1) + "/" + String(logRecordCount));
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(isRange ? 206 : 200, isJson ? "application/x-ndjson" : "text/csv", "");
+
+  unsigned long exportStartMillis = millis();
+  char chunk[LOG_EXPORT_CHUNK_RECORDS * LOG_EXPORT_LINE_MAX_LENGTH];
+  LogRecord records[LOG_EXPORT_CHUNK_RECORDS];
+  uint32_t exported = 0;
+
+  if (!isJson && !isRange && !isResumed) server.sendContent(LOG_EXPORT_CSV_HEADER);
+
+  uint32_t index = firstIndex;
+  while (index < endIndex) {
+    uint32_t count = readLogRecords(index, records, min((uint32_t)LOG_EXPORT_CHUNK_RECORDS, endIndex - index));
+    if (count == 0) {
+      // The oldest segment was dropped while exporting
+      if (index >= logFirstIndex) break;
+      index = logFirstIndex;
+      continue;
+    }
 
-  while (millis() - jobTimerStart <= duration * 1000) {
-    unsigned long elapsed = millis() - jobTimer;
+    size_t length = 0;
+    for (uint32_t i = 0; i < count; i++) {
+      // Torn by a power loss
+      if (crc16((const uint8_t *)&records[i], offsetof(LogRecord, crc)) != records[i].crc) continue;
 
-    if (elapsed > 100) {
-      oled.erase();
-      oled.setCursor(3, 0);
-      oled.setFont(QW_FONT_8X16);
+      length += formatLogRecord(chunk + length, index + i, records[i], isJson);
+      exported++;
+    }
+    index += count;
 
-      countDownSeconds = duration - ((millis() - jobTimerStart) / 1000);
+    server.sendContent(chunk, length);
+    if (!server.client().connected()) break;
 
-      oled.print("Warm Up " + String(countDownSeconds) + "s");
-      oled.display();
+    // Live event streams keep going during a long export
+    eventsJob();
+  }
+  server.sendContent("");
 
-      jobTimer = millis();
-    }
+  Serial.printf("Log export of records %lu to %lu: %lu records in %lums\n", (unsigned long)firstIndex, (unsigned long)index, (unsigned long)exported,
+                millis() - exportStartMillis);
+}
 
-    BLE.poll();
+// One CSV or NDJSON line, at most LOG_EXPORT_LINE_MAX_LENGTH bytes
+size_t formatLogRecord(char *line, uint32_t index, const LogRecord &record, bool isJson) {
+  bool isSynced = record.flags & LOG_FLAG_TIME_SYNCED;
+  float agtron = (float)record.agtron / MEASUREMENT_AGTRON_SCALE;
+
+  int length;
+  if (isJson) {
+    length = snprintf(line, LOG_EXPORT_LINE_MAX_LENGTH, "{\"index\":%lu,\"time\":%lu,\"time_synced\":%s,\"session\":%u,\"profile\":%u,\"raw_ir\":%lu,\"agtron\":%.2f}\n",
+                      (unsigned long)index, (unsigned long)record.timestamp, isSynced ? "true" : "false", record.session, record.profile,
+                      (unsigned long)record.rawIR, agtron);
+  } else {
+    length = snprintf(line, LOG_EXPORT_LINE_MAX_LENGTH, "%lu,%lu,%d,%u,%u,%lu,%.2f\n", (unsigned long)index, (unsigned long)record.timestamp, isSynced,
+                      record.session, record.profile, (unsigned long)record.rawIR, agtron);
   }
+  return min(length, LOG_EXPORT_LINE_MAX_LENGTH - 1);
 }
 
-int irLevelAccumulated;
-unsigned long measureSampleJobTimer = millis();
-void measureSampleJob() {
-  if (millis() - measureSampleJobTimer > MEASUREMENT_INTERVAL_MS) {
-    int irLevel = particleSensor.getIR();
-    long currentDelta = irLevel - unblockedValue;
-    irLevelAccumulated = (irLevelAccumulated * 0.5) + (irLevel * 0.5);
+void handleMetricsRequest() {
+  DeviceMetrics metrics;
+  takeMetricsSnapshot(metrics);
+
+  // Streamed a family at a time, so the response never outgrows a buffer
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(200, "text/plain; version=0.0.4", "");
+
+  char text[METRICS_FAMILY_MAX_LENGTH];
+  int length = snprintf(text, sizeof(text), "# TYPE roastmeter_build_info gauge\nroastmeter_build_info{revision=\"%s\"} 1\n", FIRMWARE_REVISION_STRING);
+  server.sendContent(text, min(length, METRICS_FAMILY_MAX_LENGTH - 1));
+
+  sendMetric("roastmeter_uptime_seconds", "counter", "Time since boot.", metrics.uptimeS);
+  sendMetric("roastmeter_loop_iterations_total", "counter", "Passes through loop().", metrics.loopCount);
+  sendMetric("roastmeter_samples_total", "counter", "Sensor samples taken.", metrics.sampleCount);
+  sendMetric("roastmeter_sample_lateness_seconds_total", "counter", "Summed lateness of samples past their interval.", metrics.jitterUsTotal / 1e6);
+  sendMetric("roastmeter_sample_lateness_max_seconds", "gauge", "Latest a sample has been since boot.", metrics.worstJitterUs / 1e6);
+  sendMetric("roastmeter_ble_dropped_samples_total", "counter", "Samples dropped because the BLE task fell behind.", metrics.droppedBLESamples);
+  sendMetric("roastmeter_events_dropped_samples_total", "counter", "Samples dropped because the web task fell behind.", metrics.droppedEventsSamples);
+  sendMetric("roastmeter_raw_stream_dropped_frames_total", "counter", "Raw stream frames dropped.", metrics.droppedRawStreamFrames);
+  sendMetric("roastmeter_i2c_errors_total", "counter", "Failed I2C transactions (sensor, FIFO, fuel gauge).", metrics.i2cErrors);
+  sendMetric("roastmeter_heap_free_bytes", "gauge", "Free heap.", metrics.freeHeap);
+  sendMetric("roastmeter_heap_largest_free_block_bytes", "gauge", "Largest allocatable heap block.", metrics.largestFreeBlock);
+  sendMetric("roastmeter_heap_min_free_bytes", "gauge", "Lowest free heap since boot.", metrics.minimumFreeHeap);
+  sendMetric("roastmeter_ble_backlog_samples", "gauge", "Samples waiting for the BLE task.", metrics.bleBacklog);
+  sendMetric("roastmeter_ble_backlog_max_samples", "gauge", "Most samples waiting for the BLE task since boot.", metrics.worstBLEBacklog);
+  sendMetric("roastmeter_settings_commits_total", "counter", "EEPROM settings commits.", metrics.settingsCommits);
+  sendMetric("roastmeter_log_records_written_total", "counter", "Records appended to the measurement log.", metrics.logRecordsWritten);
+
+  // Left out until the fuel gauge has been read
+  if (metrics.batteryMillivolts > 0) {
+    sendMetric("roastmeter_battery_volts", "gauge", "Battery voltage.", metrics.batteryMillivolts / 1000.0);
+    sendMetric("roastmeter_battery_charge_percent", "gauge", "Battery state of charge.", metrics.batterySOC);
+  }
 
-    if (currentDelta > 0) {
-      float calibratedAgtronLevel = mapIRToAgtron(irLevelAccumulated);
+  server.sendContent("");
+}
 
-      agtronCharacteristic.writeValue(calibratedAgtronLevel);
-      particleSensorCharacteristic.writeValue((u_int32_t)irLevel);
-      meterStateCharacteristic.writeValue(STATE_MEASURED);
+// A gzipped asset from include/dashboard.h as stored, or 304 when the
+// browser's copy still matches etag
+void sendDashboardAsset(const uint8_t *data, size_t length, const char *contentType, const char *etag, const char *cacheControl) {
+  server.sendHeader("Cache-Control", cacheControl);
+  server.sendHeader("ETag", etag);
+  if (server.header("If-None-Match") == etag) {
+    server.send(304);
+    return;
+  }
 
-      displayMeasurement(calibratedAgtronLevel);
+  server.sendHeader("Content-Encoding", "gzip");
+  server.send_P(200, contentType, (const char *)data, length);
+}
 
-      Serial.println("real: " + String(irLevelAccumulated));
-      Serial.print("agtron: ");
-      Serial.println(calibratedAgtronLevel);
-      Serial.println("===========================");
+void handleSettingsRequest() {
+  SettingsBlob blob;
+  xSemaphoreTake(settingsMutex, portMAX_DELAY);
+  blob = publishedSettingsBlob;
+  xSemaphoreGive(settingsMutex);
+
+  // Quotes, backslashes and control characters escaped, at most 6 bytes each
+  char bleName[SETTINGS_BLE_NAME_LENGTH * 6];
+  size_t nameLength = 0;
+  for (const char *c = blob.bleName; *c && c < blob.bleName + SETTINGS_BLE_NAME_LENGTH; c++) {
+    if (*c == '"' || *c == '\\') {
+      bleName[nameLength++] = '\\';
+      bleName[nameLength++] = *c;
+    } else if ((uint8_t)*c < 0x20) {
+      nameLength += snprintf(bleName + nameLength, sizeof(bleName) - nameLength, "\\u%04x", *c);
     } else {
-      agtronCharacteristic.writeValue(0);
-      particleSensorCharacteristic.writeValue(0);
-      meterStateCharacteristic.writeValue(STATE_READY);
-
-      displayPleaseLoadSample();
+      bleName[nameLength++] = *c;
     }
+  }
+  bleName[nameLength] = '\0';
 
-    measureSampleJobTimer = millis();
+  char json[DASHBOARD_SETTINGS_MAX_LENGTH];
+  snprintf(json, sizeof(json),
+           "{\"ledBrightness\":%u,\"intersectionPoint\":%u,\"deviation\":%.9g,\"coefficient0\":%.9g,\"coefficient1\":%.9g,\"coefficient2\":%.9g,"
+           "\"coefficient3\":%.9g,\"irOffset\":%.9g,\"agtronDeadband\":%.9g,\"irDeadband\":%u,\"notifyHeartbeat\":%u,\"bleName\":\"%s\"}",
+           blob.ledBrightness, blob.intersectionPoint, blob.deviation, blob.coefficient[0], blob.coefficient[1], blob.coefficient[2], blob.coefficient[3],
+           blob.irOffset, blob.agtronDeadband, blob.irDeadband, blob.notifyHeartbeat, bleName);
+
+  server.sendHeader("Cache-Control", "no-store");
+  server.send(200, "application/json", json);
+}
+
+void handleSettingsUpdateRequest() {
+  if (isWebSettingsPending) {
+    server.send(503, "text/plain", "Previous settings not applied yet");
+    return;
+  }
+
+  SettingsBlob blob;
+  xSemaphoreTake(settingsMutex, portMAX_DELAY);
+  blob = publishedSettingsBlob;
+  xSemaphoreGive(settingsMutex);
+
+  long value;
+  bool isValid = true;
+  if (readSettingsArg("ledBrightness", 0, UINT8_MAX, value, isValid)) blob.ledBrightness = value;
+  if (readSettingsArg("intersectionPoint", 0, UINT8_MAX, value, isValid)) blob.intersectionPoint = value;
+  if (readSettingsArg("irDeadband", 0, UINT16_MAX, value, isValid)) blob.irDeadband = value;
+  if (readSettingsArg("notifyHeartbeat", 0, UINT16_MAX, value, isValid)) blob.notifyHeartbeat = value;
+
+  float number;
+  const float limit = DASHBOARD_SETTINGS_FLOAT_LIMIT;
+  if (readSettingsFloatArg("deviation", -limit, limit, number, isValid)) blob.deviation = number;
+  if (readSettingsFloatArg("coefficient0", -limit, limit, number, isValid)) blob.coefficient[0] = number;
+  if (readSettingsFloatArg("coefficient1", -limit, limit, number, isValid)) blob.coefficient[1] = number;
+  if (readSettingsFloatArg("coefficient2", -limit, limit, number, isValid)) blob.coefficient[2] = number;
+  if (readSettingsFloatArg("coefficient3", -limit, limit, number, isValid)) blob.coefficient[3] = number;
+  if (readSettingsFloatArg("irOffset", -limit, limit, number, isValid)) blob.irOffset = number;
+  if (readSettingsFloatArg("agtronDeadband", 0, DASHBOARD_AGTRON_DEADBAND_MAX, number, isValid)) blob.agtronDeadband = number;
+
+  if (server.hasArg("bleName")) {
+    String name = server.arg("bleName");
+    isValid = isValid && name.length() < SETTINGS_BLE_NAME_LENGTH;
+    memset(blob.bleName, 0, SETTINGS_BLE_NAME_LENGTH);
+    strncpy(blob.bleName, name.c_str(), SETTINGS_BLE_NAME_LENGTH - 1);
   }
+
+  blob.crc = crc16((const uint8_t *)&blob + SETTINGS_BLOB_HEADER_LENGTH, sizeof(SettingsBlob) - SETTINGS_BLOB_HEADER_LENGTH);
+  if (!isValid || !isSettingsBlobValid(blob, sizeof(SettingsBlob))) {
+    server.send(400, "text/plain", "Invalid settings");
+    return;
+  }
+
+  webSettingsBlob = blob;
+  isWebSettingsPending = true;
+
+  Serial.println("Settings updated from the web");
+  server.send(202, "text/plain", "Settings saved");
 }
 
-void displayPleaseLoadSample() {
-  oled.erase();
-  oled.setCursor(3, 0);
-  oled.setFont(QW_FONT_8X16);
-  oled.print("Please load sample!");
-  oled.display();
+// False when the argument is missing. One that is not a whole number from
+// minimum to maximum clears isValid.
+bool readSettingsArg(const char *name, long minimum, long maximum, long &value, bool &isValid) {
+  if (!server.hasArg(name)) return false;
+
+  String text = server.arg(name);
+  char *end;
+  value = strtol(text.c_str(), &end, 10);
+  if (text.length() == 0 || *end != '\0' || value < minimum || value > maximum) {
+    isValid = false;
+    return false;
+  }
+  return true;
 }
 
-void displaySensorDirty() {
-  oled.erase();
-  oled.setCursor(3, 0);
-  oled.setFont(QW_FONT_8X16);
-  oled.println("Please");
-  oled.println("Clean");
-  oled.println("Sensor!");
-  oled.display();
+// As readSettingsArg() for a float. NaN and infinity clear isValid too.
+bool readSettingsFloatArg(const char *name, float minimum, float maximum, float &value, bool &isValid) {
+  if (!server.hasArg(name)) return false;
+
+  String text = server.arg(name);
+  char *end;
+  value = strtof(text.c_str(), &end);
+  if (text.length() == 0 || *end != '\0' || !isfinite(value) || value < minimum || value > maximum) {
+    isValid = false;
+    return false;
+  }
+  return true;
 }
 
-String agtronDescription(float agtronLevel) {
-  if (agtronLevel <= 20) return String("Over developed");
+// One metric with its HELP and TYPE lines as a chunk of the response. One
+// that does not fit is left out whole, never sent cut short.
+void sendMetric(const char *name, const char *type, const char *help, double value) {
+  char text[METRICS_FAMILY_MAX_LENGTH];
+  int length = snprintf(text, sizeof(text), "# HELP %s %s\n# TYPE %s %s\n%s %.10g\n", name, help, name, type, name, value);
+  if (length < 0 || length >= (int)sizeof(text)) {
+    Serial.printf("Metric %s left out, longer than %d bytes\n", name, METRICS_FAMILY_MAX_LENGTH);
+    return;
+  }
+
+  server.sendContent(text, length);
+}
+
+void takeMetricsSnapshot(DeviceMetrics &metrics) {
+  metrics.version = METRICS_VERSION;
+  metrics.uptimeS = millis() / 1000;
+  metrics.loopCount = metricsCounters.loopCount;
+  metrics.sampleCount = metricsCounters.sampleCount;
+  metrics.jitterUsTotal = metricsCounters.jitterUsTotal;
+  metrics.worstJitterUs = metricsCounters.worstJitterUs;
+  metrics.droppedBLESamples = bleLatencyStats.droppedSamples;
+  metrics.droppedEventsSamples = eventsDroppedSamples;
+  metrics.droppedRawStreamFrames = rawStreamDroppedFrames;
+  metrics.i2cErrors = metricsCounters.i2cErrors;
+  metrics.freeHeap = ESP.getFreeHeap();
+  metrics.largestFreeBlock = ESP.getMaxAllocHeap();
+  metrics.minimumFreeHeap = ESP.getMinFreeHeap();
+  metrics.bleBacklog = bleSampleQueue != NULL ? uxQueueMessagesWaiting(bleSampleQueue) : 0;
+  metrics.worstBLEBacklog = metricsCounters.worstBLEBacklog;
+  metrics.settingsCommits = metricsCounters.settingsCommits;
+  metrics.logRecordsWritten = metricsCounters.logRecordsWritten;
+  metrics.batteryMillivolts = constrain(lroundf(fuelGuageVoltage * 1000), 0, UINT16_MAX);
+  metrics.batterySOC = fuelGuageVoltage > 0 ? constrain(lroundf(fuelGuageSOC), 0, 100) : ADVERTISING_BATTERY_UNKNOWN;
+}
+
+// Sends the samples queued since the last pass to every browser as one
+// measurement frame
+void eventsJob() {
+  if (eventsClientCount == 0) return;
+
+  uint8_t frame[MEASUREMENT_FRAME_MAX_LENGTH];
+  uint8_t count = 0;
+  MeasurementSample sample;
+  while (count < MEASUREMENT_BATCH_MAX_RECORDS && xQueueReceive(eventsSampleQueue, &sample, 0) == pdTRUE) {
+    MeasurementRecord record;
+    sampleToMeasurementRecord(sample, record);
+    memcpy(frame + MEASUREMENT_FRAME_HEADER_LENGTH + count * sizeof(MeasurementRecord), &record, sizeof(MeasurementRecord));
+    count++;
+  }
+
+  char event[EVENTS_MAX_LENGTH];
+  size_t length = 0;
+  if (count > 0) {
+    frame[0] = MEASUREMENT_FRAME_VERSION;
+    frame[1] = count;
+    length = sprintf(event, "event: measurement\ndata: ");
+    length += base64Encode(frame, MEASUREMENT_FRAME_HEADER_LENGTH + count * sizeof(MeasurementRecord), event + length);
+    length += sprintf(event + length, "\n\n");
+  } else if (millis() - eventsSentMillis >= EVENTS_KEEPALIVE_MS) {
+    length = sprintf(event, ":\n\n");
+  } else {
+    return;
+  }
+  eventsSentMillis = millis();
+
+  for (int slot = 0; slot < EVENTS_MAX_CLIENTS; slot++) {
+    if (eventsClients[slot].fd() < 0) continue;
+    if (sendEvent(eventsClients[slot], event, length)) continue;
+
+    eventsClients[slot].stop();
+    eventsClientCount--;
+    Serial.println("Event stream " + String(slot) + " closed, " + String(eventsClientCount) + " following");
+  }
+}
+
+// All or nothing without waiting: a partly sent event would corrupt the
+// stream, so the caller drops the browser instead
+bool sendEvent(WiFiClient &client, const char *event, size_t length) {
+  return send(client.fd(), event, length, MSG_DONTWAIT | MSG_NOSIGNAL) == (ssize_t)length;
+}
+
+void stopEventsClients() {
+  for (int slot = 0; slot < EVENTS_MAX_CLIENTS; slot++) eventsClients[slot].stop();
+  eventsClientCount = 0;
+}
+
+void startWiFi() {
+  uint32_t freeHeap = ESP.getFreeHeap();
+  wifiStartMillis = millis();
+
+  if (!isWebServerSetup) {
+    setupWebServer();
+    isWebServerSetup = true;
+  }
+
+  Serial.println("WIFI SSID: " + bleName);
+  Serial.println("WIFI Password: otaupdate");
+
+  // Configured before the AP starts, so there is nothing to wait for
+  WiFi.mode(isStationStarted ? WIFI_AP_STA : WIFI_AP);
+  IPAddress IP = IPAddress(10, 10, 10, 1);
+  IPAddress NMask = IPAddress(255, 255, 255, 0);
+  WiFi.softAPConfig(IP, IP, NMask);
+  WiFi.softAP(bleName, "otaupdate");
+  IPAddress myIP = WiFi.softAPIP();
+  Serial.print("AP IP address: ");
+  Serial.println(myIP);
+
+  server.begin();
+  isWifiOn = true;
+  Serial.printf("WiFi on in %lums, using %ld bytes of heap\n", millis() - wifiStartMillis, (long)freeHeap - (long)ESP.getFreeHeap());
+}
+
+void stopWiFi() {
+  uint32_t freeHeap = ESP.getFreeHeap();
+
+  stopEventsClients();
+  server.stop();
+  WiFi.mode(isStationStarted ? WIFI_STA : WIFI_OFF);
+  isWifiRequested = false;
+  isWifiOn = false;
+
+  Serial.printf("WiFi off after %lus on, %ld bytes of heap returned\n", (millis() - wifiStartMillis) / 1000, (long)ESP.getFreeHeap() - (long)freeHeap);
+}
+
+// Keeps the station and broker connections up and publishes what the log
+// has gained since the cursor
+void mqttJob() {
+  if (!isMqttEnabled) return;
+
+  if (!isStationStarted) {
+    WiFi.mode(isWifiOn ? WIFI_AP_STA : WIFI_STA);
+    WiFi.setAutoReconnect(true);
+    WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
+    isStationStarted = true;
+    Serial.println("Station connecting to " WIFI_SSID);
+  }
+  if (WiFi.status() != WL_CONNECTED) return;
+
+  if (!mqttClient.connected()) {
+    if (millis() - mqttConnectMillis < MQTT_RECONNECT_INTERVAL_MS) return;
+    mqttConnectMillis = millis();
+
+    if (!mqttClient.connect(bleName.c_str())) {
+      Serial.printf("MQTT connect to %s failed, state %d\n", MQTT_HOST, mqttClient.state());
+      return;
+    }
+    Serial.printf("MQTT connected to %s, %lu records queued\n", MQTT_HOST, (unsigned long)(logRecordCount - min(mqttPublishedIndex, logRecordCount)));
+  }
+  mqttClient.loop();
+
+  publishMqttBatch();
+}
+
+// Publishes up to MQTT_BATCH_RECORDS logged records in one message, once a
+// batch is full or MQTT_BATCH_INTERVAL_MS after the previous message
+void publishMqttBatch() {
+  // logTask() appends and drops segments meanwhile
+  xSemaphoreTake(logMutex, portMAX_DELAY);
+  uint32_t firstIndex = logFirstIndex;
+  uint32_t endIndex = logRecordCount;
+  xSemaphoreGive(logMutex);
+
+  if (mqttPublishedIndex > endIndex) {
+    // The log was lost with the file system; an erase keeps the indexes
+    mqttPublishedIndex = firstIndex;
+  }
+  if (mqttPublishedIndex < firstIndex) {
+    Serial.printf("MQTT skipped %lu records dropped from the log\n", (unsigned long)(firstIndex - mqttPublishedIndex));
+    mqttPublishedIndex = firstIndex;
+  }
+  checkpointMqttCursor();
+
+  uint32_t pending = endIndex - mqttPublishedIndex;
+  if (pending == 0) return;
+  if (pending < MQTT_BATCH_RECORDS && millis() - mqttPublishedMillis < MQTT_BATCH_INTERVAL_MS) return;
+
+  LogRecord records[MQTT_BATCH_RECORDS];
+  uint32_t count = readLogRecords(mqttPublishedIndex, records, min(pending, (uint32_t)MQTT_BATCH_RECORDS));
+  if (count == 0) return;
+
+  char payload[MQTT_BATCH_RECORDS * LOG_EXPORT_LINE_MAX_LENGTH];
+  size_t length = 0;
+  uint32_t published = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    // Torn by a power loss
+    if (crc16((const uint8_t *)&records[i], offsetof(LogRecord, crc)) != records[i].crc) continue;
+
+    length += formatLogRecord(payload + length, mqttPublishedIndex + i, records[i], true);
+    published++;
+  }
+
+  // Streamed, so PubSubClient's buffer needs no room for the payload
+  if (length > 0) {
+    if (!mqttClient.beginPublish(mqttTopic.c_str(), length, false) || mqttClient.write((const uint8_t *)payload, length) != length || !mqttClient.endPublish()) {
+      Serial.println("MQTT publish failed");
+      mqttClient.disconnect();
+      return;
+    }
+  }
+
+  mqttPublishedIndex += count;
+  mqttPublishedMillis = millis();
+  checkpointMqttCursor();
+
+  Serial.printf("MQTT published %lu records, skipped %lu, %lu queued\n", (unsigned long)published, (unsigned long)(count - published), (unsigned long)(endIndex - mqttPublishedIndex));
+}
+
+// The first record not yet published, or the oldest logged one when the
+// cursor is missing or unreadable
+uint32_t loadMqttCursor() {
+  MqttCursor cursor;
+  File file = LittleFS.open(MQTT_CURSOR_PATH, "r");
+  if (!file) return logFirstIndex;
+
+  bool isRead = file.read((uint8_t *)&cursor, sizeof(MqttCursor)) == sizeof(MqttCursor);
+  file.close();
+  if (!isRead || cursor.crc != crc16((const uint8_t *)&cursor, offsetof(MqttCursor, crc))) return logFirstIndex;
+
+  return cursor.index;
+}
+
+// Saves the cursor once it is MQTT_CURSOR_SAVE_RECORDS records on, or has
+// moved at all MQTT_CURSOR_SAVE_INTERVAL_MS after the last save
+void checkpointMqttCursor() {
+  if (mqttPublishedIndex == mqttSavedIndex) return;
+
+  // Wraps to a large count when the cursor moved back, saving at once
+  bool isFar = mqttPublishedIndex - mqttSavedIndex >= MQTT_CURSOR_SAVE_RECORDS;
+  if (isFar || millis() - mqttSavedMillis >= MQTT_CURSOR_SAVE_INTERVAL_MS) saveMqttCursor();
+}
+
+void saveMqttCursor() {
+  MqttCursor cursor;
+  cursor.index = mqttPublishedIndex;
+  cursor.crc = crc16((const uint8_t *)&cursor, offsetof(MqttCursor, crc));
+
+  File file = LittleFS.open(MQTT_CURSOR_PATH, "w");
+  if (!file) {
+    Serial.println("MQTT cursor save failed");
+    return;
+  }
+  file.write((const uint8_t *)&cursor, sizeof(MqttCursor));
+  file.close();
+
+  mqttSavedIndex = mqttPublishedIndex;
+  mqttSavedMillis = millis();
+  mqttCursorSaveCount++;
+}
+
+// Holding the button for WIFI_BUTTON_HOLD_MS toggles WiFi, once per press
+void wifiButtonJob() {
+  if (digitalRead(WIFI_BUTTON_PIN) == HIGH) {
+    isWifiButtonDown = false;
+    return;
+  }
+
+  if (!isWifiButtonDown) {
+    isWifiButtonDown = true;
+    isWifiButtonHandled = false;
+    wifiButtonDownMillis = millis();
+    return;
+  }
+
+  if (isWifiButtonHandled || millis() - wifiButtonDownMillis < WIFI_BUTTON_HOLD_MS) return;
+  isWifiButtonHandled = true;
+  isWifiRequested = !isWifiOn;
+  Serial.printf("Button held, WiFi %s\n", isWifiRequested ? "on" : "off");
+}
+
+// Pauses sensing from the first write of any update, ElegantOTA's included
+void firmwareUpdateProgress(size_t progress, size_t size) {
+  if (!isFirmwareUpdating) {
+    isFirmwareUpdating = true;
+    MyAction_onOTAStart();
+    otaProgressMillis = millis();
+  } else if (millis() - otaProgressMillis >= OTA_PROGRESS_INTERVAL_MS) {
+    MyAction_onOTAProgress();
+    otaProgressMillis = millis();
+  }
+}
+
+void handleGzipUpdateUpload() {
+  HTTPUpload &upload = server.upload();
+
+  if (upload.status == UPLOAD_FILE_START) {
+    startGzipUpdate();
+  } else if (upload.status == UPLOAD_FILE_WRITE) {
+    writeGzipUpdate(upload.buf, upload.currentSize);
+  } else if (upload.status == UPLOAD_FILE_END) {
+    finishGzipUpdate();
+  } else {
+    failGzipUpdate("Upload aborted");
+  }
+}
+
+void handleGzipUpdateRequest() {
+  if (!gzipUpdate.isUpdated) {
+    server.send(400, "text/plain", String("Update failed: ") + (gzipUpdate.error ? gzipUpdate.error : "no image uploaded"));
+    return;
+  }
+
+  char report[160];
+  snprintf(report, sizeof(report), "Updated: %lu bytes uploaded, %lu inflated in %lums, upload %.1fKB/s, flash %.1fKB/s. Restarting.",
+           (unsigned long)gzipUpdate.uploadedBytes, (unsigned long)gzipUpdate.inflatedBytes, gzipUpdate.elapsedMillis,
+           gzipUpdate.uploadedBytes / 1.024f / max(gzipUpdate.elapsedMillis, 1UL), gzipUpdate.inflatedBytes * 1000 / 1.024f / max(gzipUpdate.flashMicros, 1UL));
+  server.send(200, "text/plain", report);
+
+  isFirmwareRestartPending = true;
+  firmwareRestartMillis = millis();
+}
+
+void startGzipUpdate() {
+  releaseGzipUpdate();
+  memset(&gzipUpdate, 0, sizeof(GzipUpdate));
+  gzipUpdate.startMillis = millis();
+
+  gzipUpdate.inflator = (tinfl_decompressor *)malloc(sizeof(tinfl_decompressor));
+  gzipUpdate.dictionary = (uint8_t *)malloc(TINFL_LZ_DICT_SIZE);
+  if (gzipUpdate.inflator == NULL || gzipUpdate.dictionary == NULL) {
+    failGzipUpdate("out of memory");
+    return;
+  }
+  tinfl_init(gzipUpdate.inflator);
+
+  if (!Update.begin(UPDATE_SIZE_UNKNOWN)) {
+    failGzipUpdate(Update.errorString());
+    return;
+  }
+
+  Serial.println("Compressed OTA update started");
+}
+
+void writeGzipUpdate(const uint8_t *data, size_t length) {
+  if (gzipUpdate.inflator == NULL) return;
+  gzipUpdate.uploadedBytes += length;
+
+  if (!gzipUpdate.isHeaderRead) {
+    size_t headerLength = gzipHeaderLength(data, length);
+    if (headerLength == 0) {
+      failGzipUpdate("not a gzip image");
+      return;
+    }
+
+    data += headerLength;
+    length -= headerLength;
+    gzipUpdate.isHeaderRead = true;
+  }
+
+  // The dictionary doubles as the output buffer, so every inflated byte is
+  // flashed from there before tinfl wraps around and overwrites it
+  tinfl_status status = TINFL_STATUS_NEEDS_MORE_INPUT;
+  while (!gzipUpdate.isInflated && (length > 0 || status == TINFL_STATUS_HAS_MORE_OUTPUT)) {
+    uint8_t *inflated = gzipUpdate.dictionary + gzipUpdate.dictionaryOffset;
+    size_t inputBytes = length;
+    size_t inflatedBytes = TINFL_LZ_DICT_SIZE - gzipUpdate.dictionaryOffset;
+    status = tinfl_decompress(gzipUpdate.inflator, data, &inputBytes, gzipUpdate.dictionary, inflated, &inflatedBytes, TINFL_FLAG_HAS_MORE_INPUT);
+    data += inputBytes;
+    length -= inputBytes;
+
+    if (inflatedBytes > 0) {
+      unsigned long flashStartMicros = micros();
+      size_t written = Update.write(inflated, inflatedBytes);
+      gzipUpdate.flashMicros += micros() - flashStartMicros;
+      if (written != inflatedBytes) {
+        failGzipUpdate(Update.errorString());
+        return;
+      }
+
+      gzipUpdate.crc = crc32_le(gzipUpdate.crc, inflated, inflatedBytes);
+      gzipUpdate.inflatedBytes += inflatedBytes;
+      gzipUpdate.dictionaryOffset = (gzipUpdate.dictionaryOffset + inflatedBytes) & (TINFL_LZ_DICT_SIZE - 1);
+    }
+
+    if (status == TINFL_STATUS_DONE) {
+      gzipUpdate.isInflated = true;
+    } else if (status < TINFL_STATUS_DONE) {
+      failGzipUpdate("corrupt compressed image");
+      return;
+    }
+  }
+
+  if (gzipUpdate.isInflated) {
+    size_t trailerBytes = min(length, (size_t)(OTA_GZIP_TRAILER_LENGTH - gzipUpdate.trailerLength));
+    memcpy(gzipUpdate.trailer + gzipUpdate.trailerLength, data, trailerBytes);
+    gzipUpdate.trailerLength += trailerBytes;
+  }
+}
+
+void finishGzipUpdate() {
+  if (gzipUpdate.inflator == NULL) return;
+
+  if (!gzipUpdate.isInflated || gzipUpdate.trailerLength < OTA_GZIP_TRAILER_LENGTH) {
+    failGzipUpdate("image is truncated");
+    return;
+  }
+
+  uint32_t crc, inflatedBytes;
+  memcpy(&crc, gzipUpdate.trailer, sizeof(uint32_t));
+  memcpy(&inflatedBytes, gzipUpdate.trailer + sizeof(uint32_t), sizeof(uint32_t));
+  if (crc != gzipUpdate.crc || inflatedBytes != gzipUpdate.inflatedBytes) {
+    failGzipUpdate("checksum mismatch");
+    return;
+  }
+
+  // Only now is the boot partition switched
+  if (!Update.end(true)) {
+    failGzipUpdate(Update.errorString());
+    return;
+  }
+
+  releaseGzipUpdate();
+  gzipUpdate.isUpdated = true;
+  gzipUpdate.elapsedMillis = millis() - gzipUpdate.startMillis;
+
+  Serial.printf("Compressed OTA update of %lu bytes, %lu inflated, took %lums, %lums of it flashing\n", (unsigned long)gzipUpdate.uploadedBytes,
+                (unsigned long)gzipUpdate.inflatedBytes, gzipUpdate.elapsedMillis, gzipUpdate.flashMicros / 1000);
+}
+
+void failGzipUpdate(const char *error) {
+  if (Update.isRunning()) Update.abort();
+  releaseGzipUpdate();
+  gzipUpdate.error = error;
+
+  Serial.printf("Compressed OTA update failed: %s\n", error);
+}
+
+void releaseGzipUpdate() {
+  free(gzipUpdate.inflator);
+  free(gzipUpdate.dictionary);
+  gzipUpdate.inflator = NULL;
+  gzipUpdate.dictionary = NULL;
+}
+
+// Length of the gzip member header at data, or 0 when data does not start
+// with a whole one
+size_t gzipHeaderLength(const uint8_t *data, size_t length) {
+  if (length < OTA_GZIP_HEADER_LENGTH || data[0] != OTA_GZIP_ID_1 || data[1] != OTA_GZIP_ID_2 || data[2] != OTA_GZIP_METHOD_DEFLATE) return 0;
+
+  uint8_t flags = data[3];
+  size_t position = OTA_GZIP_HEADER_LENGTH;
+  if (flags & OTA_GZIP_FLAG_EXTRA) {
+    if (position + 2 > length) return 0;
+    position += 2 + (data[position] | data[position + 1] << 8);
+  }
+  if (flags & OTA_GZIP_FLAG_NAME) {
+    while (position < length && data[position] != 0) position++;
+    position++;
+  }
+  if (flags & OTA_GZIP_FLAG_COMMENT) {
+    while (position < length && data[position] != 0) position++;
+    position++;
+  }
+  if (flags & OTA_GZIP_FLAG_HCRC) position += 2;
+
+  return position <= length ? position : 0;
+}
+
+void displayFirmwareUpdate() {
+  oled.erase();
+  oled.setCursor(3, 0);
+  oled.setFont(QW_FONT_8X16);
+  oled.println("OTA");
+  oled.println("UPDATE");
+  oled.display();
+}
+
+// One step of detect, quick start, read; a reading every
+// FUEL_GUAGE_POLL_INTERVAL_MS
+void updateFuelGuage() {
+  if (fuelGuageVoltage > 0 && millis() - fuelGuageReadMillis >= FUEL_GUAGE_STALE_MS) {
+    fuelGuageVoltage = 0;
+    fuelGuageSOC = 0;
+    Serial.println("Fuel gauge reading is stale, battery unknown");
+  }
+
+  if ((long)(millis() - fuelGuageDueMillis) < 0) return;
+
+  uint16_t value;
+  uint8_t error;
+  switch (fuelGuageState) {
+    case FUEL_GUAGE_STATE_DETECT:
+      error = lipo.readRegister(MAX17043_VERSION, value);
+      if (error != 0) break;
+
+      Serial.printf("Fuel gauge found, version %u\n", value);
+      isFuelGuageFound = true;
+      fuelGuageState = isWarmBoot ? FUEL_GUAGE_STATE_READ : FUEL_GUAGE_STATE_QUICK_START;
+      break;
+
+    case FUEL_GUAGE_STATE_QUICK_START:
+      // Restarts the SOC estimate, which a noisy power up can throw off
+      error = lipo.quickStart();
+      if (error != 0) break;
+
+      fuelGuageState = FUEL_GUAGE_STATE_READ;
+      fuelGuageDueMillis = millis() + FUEL_GUAGE_QUICK_START_MS;
+      break;
+
+    default:
+      sfe_max1704x_snapshot_t snapshot;
+      error = lipo.readAll(snapshot);
+      if (error != 0) break;
+
+      fuelGuageVoltage = snapshot.voltage;
+      fuelGuageSOC = snapshot.soc;
+      fuelGuageReadMillis = millis();
+      fuelGuageDueMillis = millis() + FUEL_GUAGE_POLL_INTERVAL_MS;
+      Serial.printf("Fuel gauge: %.2fV, %.1f%%\n", fuelGuageVoltage, fuelGuageSOC);
+      break;
+  }
+
+  if (error != 0) {
+    fuelGuageFailed(error);
+  } else {
+    fuelGuageBackoffMs = FUEL_GUAGE_BACKOFF_MIN_MS;
+  }
+}
+
+// Tries the same step again later instead of waiting on the bus
+void fuelGuageFailed(uint8_t error) {
+  // A board without a gauge never answers, which is not a bus error
+  if (isFuelGuageFound) {
+    metricsCounters.i2cErrors++;
+    Serial.printf("Fuel gauge read failed (%u), retrying in %lums\n", error, fuelGuageBackoffMs);
+  }
+
+  fuelGuageDueMillis = millis() + fuelGuageBackoffMs;
+  fuelGuageBackoffMs = min(fuelGuageBackoffMs * 2, (unsigned long)FUEL_GUAGE_BACKOFF_MAX_MS);
+}
+
+#define STARTUP_PAGE_COUNT 3
+const unsigned long startUpPageDurationMs[STARTUP_PAGE_COUNT] = {3000, 3000, 2000};
+int startUpPage = -1;  // -1 when the splash screen is not showing
+unsigned long startUpPageMillis = 0;
+
+void displayStartUp() {
+  startUpPage = 0;
+  startUpPageMillis = millis();
+  displayStartUpPage(startUpPage);
+}
+
+// Returns true while the splash screen is still showing
+bool updateStartUp() {
+  if (startUpPage < 0) return false;
+  if (millis() - startUpPageMillis < startUpPageDurationMs[startUpPage]) return true;
+
+  startUpPage++;
+  if (startUpPage >= STARTUP_PAGE_COUNT) {
+    startUpPage = -1;
+    return false;
+  }
+
+  startUpPageMillis = millis();
+  displayStartUpPage(startUpPage);
+  return true;
+}
+
+void displayStartUpPage(int page) {
+  oled.erase();
+  oled.setCursor(3, 0);
+
+  if (page == 0) {
+    oled.setFont(QW_FONT_8X16);
+    oled.println("ROAST");
+    oled.println("METER");
+    oled.setFont(QW_FONT_5X7);
+    oled.println(FIRMWARE_REVISION_STRING);
+  } else if (page == 1) {
+    oled.setFont(QW_FONT_8X16);
+    oled.print(bleName);
+  } else {
+    oled.setFont(QW_FONT_5X7);
+    oled.println("Build By");
+    oled.setFont(QW_FONT_8X16);
+    oled.setCursor(3, 13);
+    oled.print("HORIZON");
+    oled.print("HARVEST");
+  }
+
+  oled.display();
+}
+
+void warmUpLED(int duration) {
+  if (duration <= 0)
+    return;
+
+  postMeasurementSample(0, 0, STATE_WARMUP, 0);
+
+  int countDownSeconds = duration;
+  unsigned long jobTimerStart = millis();
+  unsigned long jobTimer = jobTimerStart;
+
+  while (millis() - jobTimerStart <= duration * 1000) {
+    unsigned long elapsed = millis() - jobTimer;
+
+    if (elapsed > 100) {
+      oled.erase();
+      oled.setCursor(3, 0);
+      oled.setFont(QW_FONT_8X16);
+
+      countDownSeconds = duration - ((millis() - jobTimerStart) / 1000);
+
+      oled.print("Warm Up " + String(countDownSeconds) + "s");
+      oled.display();
+
+      jobTimer = millis();
+    }
+  }
+}
+
+int irLevelAccumulated;
+int loadedSampleCount = 0;
+unsigned long measureSampleJobTimer = millis();
+void measureSampleJob() {
+  unsigned long elapsed = millis() - measureSampleJobTimer;
+  if (elapsed > MEASUREMENT_INTERVAL_MS) {
+    // While streaming, rawStreamJob() owns the sensor FIFO
+    int irLevel = rawStreamRate > 0 ? rawStreamLatestIR : particleSensor.getIR();
+    // getIR() gives 0 when the sensor did not answer
+    if (irLevel == 0 && rawStreamRate == 0) metricsCounters.i2cErrors++;
+
+    unsigned long sampleMicros = micros();
+    if (measureSampleMicros != 0) {
+      uint32_t jitterUs = max((long)(sampleMicros - measureSampleMicros) - MEASUREMENT_INTERVAL_MS * 1000L, 0L);
+      metricsCounters.jitterUsTotal += jitterUs;
+      if (jitterUs > metricsCounters.worstJitterUs) metricsCounters.worstJitterUs = jitterUs;
+    }
+    measureSampleMicros = sampleMicros;
+    metricsCounters.sampleCount++;
+
+    long currentDelta = irLevel - unblockedValue;
+    irLevelAccumulated = (irLevelAccumulated * 0.5) + (irLevel * 0.5);
+
+    if (!isFirstReadingLogged) {
+      logBootStage("first reading", bootStartMillis);
+      isFirstReadingLogged = true;
+    }
+
+    uint8_t flags = 0;
+    if (irLevel >= MEASUREMENT_IR_SATURATION) flags |= MEASUREMENT_FLAG_SATURATED;
+    if (elapsed > 2 * MEASUREMENT_INTERVAL_MS) flags |= MEASUREMENT_FLAG_LATE;
+
+    if (currentDelta > 0) {
+      float calibratedAgtronLevel = mapIRToAgtron(irLevelAccumulated);
+
+      flags |= MEASUREMENT_FLAG_SAMPLE_LOADED;
+      if (loadedSampleCount < MEASUREMENT_SETTLE_SAMPLES) {
+        flags |= MEASUREMENT_FLAG_SETTLING;
+        loadedSampleCount++;
+      }
+
+      postMeasurementSample(irLevel, calibratedAgtronLevel, STATE_MEASURED, flags);
+
+      updateReadingLock(calibratedAgtronLevel, irLevel, flags);
+
+      // A loaded sample always takes over the splash screen
+      startUpPage = -1;
+      displayMeasurement(calibratedAgtronLevel);
+
+      Serial.println("real: " + String(irLevelAccumulated));
+      Serial.print("agtron: ");
+      Serial.println(calibratedAgtronLevel);
+      Serial.println("===========================");
+    } else {
+      postMeasurementSample(irLevel, 0, STATE_READY, flags);
+
+      loadedSampleCount = 0;
+      lockWindowCount = 0;
+      isReadingLocked = false;
+
+      if (startUpPage < 0) displayPleaseLoadSample();
+    }
+
+    measureSampleJobTimer = millis();
+  }
+}
+
+// Never blocks: when the BLE task falls behind the sample is dropped, which
+// shows up as a gap in the measurement record sequence.
+void postMeasurementSample(uint32_t irLevel, float agtronLevel, uint8_t state, uint8_t flags) {
+  MeasurementSample sample;
+  sample.sequence = measurementSequence++;
+  sample.timestamp = millis();
+  sample.irLevel = irLevel;
+  sample.agtronLevel = agtronLevel;
+  sample.state = state;
+  sample.flags = flags;
+
+  if (eventsClientCount > 0 && xQueueSend(eventsSampleQueue, &sample, 0) != pdTRUE) {
+    eventsDroppedSamples++;
+  }
+
+  if (!isBLEReady) return;
+
+  if (xQueueSend(bleSampleQueue, &sample, 0) != pdTRUE) {
+    bleLatencyStats.droppedSamples++;
+  }
+}
+
+// Runs the requests BLE handlers left for loop(), which owns the sensor
+void applyBLERequests() {
+  if (isSensorSetupPending) {
+    isSensorSetupPending = false;
+    setupParticleSensor();
+  }
+
+  int32_t rate = pendingRawStreamRate;
+  if (rate >= 0) {
+    pendingRawStreamRate = -1;
+
+    if (rate == 0) {
+      stopRawStream();
+    } else {
+      startRawStream(rate);
+    }
+  }
+}
+
+float publishedAgtronLevel = 0;
+uint32_t publishedIRLevel = 0;
+uint8_t publishedState = STATE_SETUP;
+unsigned long publishedMillis = 0;
+bool isPublishForced = true;
+
+// Only notifies a characteristic when its value moved past the deadband or
+// the state changed, plus everything once per heartbeat as a keep-alive.
+void publishMeasurement(float agtronLevel, uint32_t irLevel, uint8_t state) {
+  bool isHeartbeat = isPublishForced || millis() - publishedMillis >= notifyHeartbeat * 1000UL;
+  bool isStateChanged = state != publishedState;
+  bool isPublished = false;
+
+  if (isHeartbeat || isStateChanged || fabs(agtronLevel - publishedAgtronLevel) >= agtronDeadband) {
+    agtronCharacteristic.writeValue(agtronLevel);
+    publishedAgtronLevel = agtronLevel;
+    isPublished = true;
+  }
+
+  if (isHeartbeat || isStateChanged || abs((long)irLevel - (long)publishedIRLevel) >= irDeadband) {
+    particleSensorCharacteristic.writeValue(irLevel);
+    publishedIRLevel = irLevel;
+    isPublished = true;
+  }
+
+  if (isHeartbeat || isStateChanged) {
+    meterStateCharacteristic.writeValue(state);
+    publishedState = state;
+  }
+
+  if (isPublished) {
+    publishedMillis = millis();
+    isPublishForced = false;
+  }
+}
+
+// Re-advertises when the payload changed, at most once per
+// ADVERTISING_MIN_INTERVAL_MS; a change inside that window goes out with the
+// next pass. Advertising continues while a central is connected.
+void advertisingJob() {
+  LockedReading reading;
+  if (xQueueReceive(lockedReadingQueue, &reading, 0) == pdTRUE) {
+    advertisingPayload.agtron = constrain(lroundf(reading.agtronLevel * MEASUREMENT_AGTRON_SCALE), INT16_MIN, INT16_MAX);
+    advertisingPayload.sequence = reading.sequence;
+  }
+
+  advertisingPayload.versionState = ADVERTISING_PAYLOAD_VERSION << 4 | (publishedState & 0x0f);
+  // The fuel gauge has not been read while the voltage is still 0
+  advertisingPayload.battery = fuelGuageVoltage > 0 ? constrain(lroundf(fuelGuageSOC), 0, 100) : ADVERTISING_BATTERY_UNKNOWN;
+
+  if (memcmp(&advertisingPayload, &advertisedPayload, sizeof(AdvertisingPayload)) == 0) return;
+  if (millis() - advertisedMillis < ADVERTISING_MIN_INTERVAL_MS) return;
+
+  BLE.setManufacturerData(ADVERTISING_COMPANY_ID, (const uint8_t *)&advertisingPayload, sizeof(AdvertisingPayload));
+  BLE.advertise();
+
+  advertisedPayload = advertisingPayload;
+  advertisedMillis = millis();
+}
+
+// A reading is locked, and logged, once per loaded sample when the last
+// LOCK_WINDOW_SAMPLES settled readings agree within LOCK_TOLERANCE.
+void updateReadingLock(float agtronLevel, uint32_t irLevel, uint8_t flags) {
+  if (isReadingLocked || (flags & MEASUREMENT_FLAG_SETTLING)) return;
+
+  lockWindow[lockWindowCount % LOCK_WINDOW_SAMPLES] = agtronLevel;
+  lockWindowCount++;
+  if (lockWindowCount < LOCK_WINDOW_SAMPLES) return;
+
+  float lowest = lockWindow[0];
+  float highest = lockWindow[0];
+  float sum = 0;
+  for (int i = 0; i < LOCK_WINDOW_SAMPLES; i++) {
+    lowest = min(lowest, lockWindow[i]);
+    highest = max(highest, lockWindow[i]);
+    sum += lockWindow[i];
+  }
+  if (highest - lowest > LOCK_TOLERANCE) return;
+
+  isReadingLocked = true;
+  float lockedAgtronLevel = sum / LOCK_WINDOW_SAMPLES;
+
+  Serial.print("Reading locked, agtron: ");
+  Serial.println(lockedAgtronLevel);
+
+  appendLogRecord(lockedAgtronLevel, irLevel);
+
+  LockedReading reading;
+  reading.agtronLevel = lockedAgtronLevel;
+  reading.sequence = ++lockedReadingSequence;
+  xQueueOverwrite(lockedReadingQueue, &reading);
+}
+
+void appendLogRecord(float agtronLevel, uint32_t irLevel) {
+  if (!isLogReady) return;
+
+  LogRecord record;
+  record.flags = 0;
+  if (logTimeSyncedUnix > 0) {
+    record.timestamp = logTimeSyncedUnix + (millis() - logTimeSyncedMillis) / 1000;
+    record.flags |= LOG_FLAG_TIME_SYNCED;
+  } else {
+    record.timestamp = millis() / 1000;
+  }
+  record.rawIR = irLevel;
+  record.agtron = constrain(lroundf(agtronLevel * MEASUREMENT_AGTRON_SCALE), INT16_MIN, INT16_MAX);
+  record.session = logSession;
+  record.profile = logProfile;
+  record.crc = crc16((const uint8_t *)&record, offsetof(LogRecord, crc));
+
+  if (xQueueSend(logRecordQueue, &record, 0) != pdTRUE) Serial.println("Measurement log queue full, record dropped");
+}
+
+// Appends to the newest segment, starting a new one when it is full. Each
+// write only touches the newest segment, whatever the size of the log.
+// Only logTask() writes, so the file is written without logMutex: readers
+// never look past the record count published under it. Returns how many
+// records were written.
+uint32_t writeLogRecords(const LogRecord *records, uint32_t count) {
+  uint32_t written = 0;
+  while (written < count) {
+    if (logSegmentCount == 0 || logSegments[logSegmentCount - 1].recordCount >= LOG_SEGMENT_RECORDS) {
+      while (logSegmentCount > 0 && (logSegmentCount >= LOG_MAX_SEGMENTS || LittleFS.totalBytes() - LittleFS.usedBytes() < LOG_MIN_FREE_BYTES)) {
+        dropOldestLogSegment();
+      }
+
+      LogSegment segment;
+      memset(&segment, 0, sizeof(LogSegment));
+      segment.firstIndex = logRecordCount;
+
+      xSemaphoreTake(logMutex, portMAX_DELAY);
+      logSegments[logSegmentCount++] = segment;
+      if (logSegmentCount == 1) logFirstIndex = logRecordCount;
+      xSemaphoreGive(logMutex);
+    }
+
+    LogSegment &segment = logSegments[logSegmentCount - 1];
+    uint32_t batch = min(count - written, (uint32_t)(LOG_SEGMENT_RECORDS - segment.recordCount));
+
+    // Not opened with "a", which would ignore the seek: appends have to stay
+    // on a record boundary after a torn write
+    File file = LittleFS.open(logSegmentPath(segment.firstIndex), segment.recordCount == 0 ? "w" : "r+", true);
+    bool isWritten = file && file.seek(segment.recordCount * sizeof(LogRecord)) &&
+                     file.write((const uint8_t *)(records + written), batch * sizeof(LogRecord)) == batch * sizeof(LogRecord);
+    file.close();
+    if (!isWritten) break;
+
+    xSemaphoreTake(logMutex, portMAX_DELAY);
+    for (uint32_t i = 0; i < batch; i++) indexLogRecord(segment, records[written + i]);
+    logRecordCount += batch;
+    xSemaphoreGive(logMutex);
+    written += batch;
+
+    if (segment.recordCount == LOG_SEGMENT_RECORDS) saveLogIndex();
+  }
+  metricsCounters.logRecordsWritten += written;
+
+  if (written > 0) isLogInfoDirty = true;
+  return written;
+}
+
+// Reads up to count records from index on, stopping at the end of its
+// segment. Returns how many were read, 0 when the segment was dropped
+// meanwhile.
+uint32_t readLogRecords(uint32_t index, LogRecord *records, uint32_t count) {
+  xSemaphoreTake(logMutex, portMAX_DELAY);
+
+  // Newest segment starting at or before index
+  int low = 0;
+  int high = logSegmentCount - 1;
+  while (low < high) {
+    int middle = (low + high + 1) / 2;
+    if (logSegments[middle].firstIndex <= index) {
+      low = middle;
+    } else {
+      high = middle - 1;
+    }
+  }
+
+  bool isFound = logSegmentCount > 0 && index >= logSegments[low].firstIndex && index < logSegments[low].firstIndex + logSegments[low].recordCount;
+  LogSegment segment;
+  if (isFound) segment = logSegments[low];
+
+  xSemaphoreGive(logMutex);
+  if (!isFound) return 0;
+
+  uint32_t offset = index - segment.firstIndex;
+  count = min(count, segment.recordCount - offset);
+  uint32_t read = 0;
+
+  xSemaphoreTake(logReadMutex, portMAX_DELAY);
+
+  // Reopened when appends made it outgrow the cached handle
+  if (!logReadFile || logReadFileIndex != segment.firstIndex || logReadFile.size() < (offset + count) * sizeof(LogRecord)) {
+    logReadFile.close();
+    logReadFile = LittleFS.open(logSegmentPath(segment.firstIndex), "r");
+    logReadFileIndex = segment.firstIndex;
+  }
+
+  if (logReadFile && logReadFile.seek(offset * sizeof(LogRecord))) {
+    read = logReadFile.read((uint8_t *)records, count * sizeof(LogRecord)) / sizeof(LogRecord);
+  }
+
+  xSemaphoreGive(logReadMutex);
+  return read;
+}
+
+// Finds the records of one session, as [firstIndex, endIndex). Only the
+// segments where the session starts and ends are read.
+bool findLogSession(uint16_t session, uint32_t &firstIndex, uint32_t &endIndex) {
+  LogSegment first, last;
+  bool isFirstFound = false;
+  bool isLastFound = false;
+
+  xSemaphoreTake(logMutex, portMAX_DELAY);
+
+  endIndex = logRecordCount;
+  for (int i = 0; i < logSegmentCount; i++) {
+    const LogSegment &segment = logSegments[i];
+    if (segment.recordCount == 0 || segment.lastSession < session) continue;
+
+    if (!isFirstFound) {
+      if (segment.firstSession > session) break;
+      first = segment;
+      isFirstFound = true;
+    }
+    if (segment.lastSession > session) {
+      last = segment;
+      isLastFound = true;
+      break;
+    }
+  }
+
+  xSemaphoreGive(logMutex);
+
+  firstIndex = isFirstFound ? findInLogSegment(first, isLogRecordInSession, session) : UINT32_MAX;
+  if (isLastFound) endIndex = findInLogSegment(last, isLogRecordAfterSession, session);
+  return firstIndex < endIndex;
+}
+
+// Finds the records from the first synced one at or after fromTime up to the
+// first synced one at or after toTime, as [firstIndex, endIndex)
+bool findLogTime(uint32_t fromTime, uint32_t toTime, uint32_t &firstIndex, uint32_t &endIndex) {
+  LogSegment first, last;
+  bool isFirstFound = false;
+  bool isLastFound = false;
+
+  xSemaphoreTake(logMutex, portMAX_DELAY);
+
+  endIndex = logRecordCount;
+  for (int i = 0; i < logSegmentCount; i++) {
+    const LogSegment &segment = logSegments[i];
+    if (segment.firstSyncedTime == 0 || segment.lastSyncedTime < fromTime) continue;
+
+    if (!isFirstFound) {
+      first = segment;
+      isFirstFound = true;
+    }
+    if (segment.lastSyncedTime >= toTime) {
+      last = segment;
+      isLastFound = true;
+      break;
+    }
+  }
+
+  xSemaphoreGive(logMutex);
+
+  firstIndex = isFirstFound ? findInLogSegment(first, isLogRecordSyncedSince, fromTime) : UINT32_MAX;
+  if (isLastFound) endIndex = findInLogSegment(last, isLogRecordSyncedSince, toTime);
+  return firstIndex < endIndex;
+}
+
+// Called from logTask(). Leaves an empty segment at the next index, which
+// setupLog() reads back as the end of the log.
+void eraseLog() {
+  uint32_t nextIndex = logRecordCount;
+
+  // First, so a power loss part way still boots past the erased records
+  File file = LittleFS.open(logSegmentPath(nextIndex), "w", true);
+  file.close();
+
+  xSemaphoreTake(logReadMutex, portMAX_DELAY);
+  logReadFile.close();
+
+  // Index next, so a power loss part way leaves segments that get rescanned
+  LittleFS.remove(LOG_INDEX_PATH);
+  for (int i = 0; i < logSegmentCount; i++) {
+    if (logSegments[i].firstIndex != nextIndex) LittleFS.remove(logSegmentPath(logSegments[i].firstIndex));
+  }
+  xSemaphoreGive(logReadMutex);
+
+  xSemaphoreTake(logMutex, portMAX_DELAY);
+  memset(&logSegments[0], 0, sizeof(LogSegment));
+  logSegments[0].firstIndex = nextIndex;
+  logSegmentCount = 1;
+  logFirstIndex = nextIndex;
+  xSemaphoreGive(logMutex);
+
+  isLogInfoDirty = true;
+}
+
+void updateLogInfoCharacteristic() {
+  LogInfo info;
+  info.version = LOG_VERSION;
+  info.recordSize = sizeof(LogRecord);
+  info.session = logSession;
+  info.recordCount = logRecordCount;
+  info.firstIndex = logFirstIndex;
+
+  logInfoCharacteristic.writeValue((const uint8_t *)&info, sizeof(LogInfo));
+}
+
+// Sends one chunk per pass, like rawStreamJob(), so a transfer never holds up
+// the measurement.
+void logTransferJob() {
+  if (!isLogTransferring) return;
+  if (!logDataCharacteristic.subscribed()) {
+    stopLogTransfer();
+    return;
+  }
+
+  // Records dropped with the oldest segment are skipped
+  logTransferIndex = max(logTransferIndex, logFirstIndex);
+
+  uint8_t chunk[LOG_DATA_MAX_LENGTH];
+  int chunkLimit = min((int)LOG_DATA_MAX_LENGTH, bleNegotiatedMtu() - BLE_ATT_NOTIFY_OVERHEAD);
+  uint32_t endIndex = min(logTransferEndIndex, logRecordCount);
+  uint32_t count = logTransferIndex < endIndex ? min((uint32_t)((chunkLimit - LOG_DATA_HEADER_LENGTH) / sizeof(LogRecord)), endIndex - logTransferIndex) : 0;
+
+  memcpy(chunk, &logTransferIndex, sizeof(uint32_t));
+  if (count > 0) count = readLogRecords(logTransferIndex, (LogRecord *)(chunk + LOG_DATA_HEADER_LENGTH), count);
+  chunk[4] = count;
+
+  logDataCharacteristic.writeValue(chunk, LOG_DATA_HEADER_LENGTH + count * sizeof(LogRecord));
+  bleNotifiedBytes += LOG_DATA_HEADER_LENGTH + count * sizeof(LogRecord);
+  logTransferIndex += count;
+
+  // The empty chunk that was just sent marks the end of the transfer
+  if (count == 0) stopLogTransfer();
+}
+
+// Sends records [firstIndex, endIndex) from logTransferJob(); an endIndex of
+// UINT32_MAX follows records appended during the transfer
+void startLogTransfer(uint32_t firstIndex, uint32_t endIndex) {
+  stopLogTransfer();
+  if (!isLogReady) return;
+
+  logTransferIndex = min(firstIndex, logRecordCount);
+  logTransferEndIndex = endIndex;
+  isLogTransferring = true;
+
+  Serial.println("Log transfer started at record " + String(logTransferIndex) + " of " + String(logRecordCount));
+}
+
+void stopLogTransfer() {
+  if (!isLogTransferring) return;
+
+  Serial.println("Log transfer stopped at record " + String(logTransferIndex));
+
+  isLogTransferring = false;
+
+  xSemaphoreTake(logReadMutex, portMAX_DELAY);
+  logReadFile.close();
+  xSemaphoreGive(logReadMutex);
+}
+
+String logSegmentPath(uint32_t firstIndex) {
+  char path[24];
+  snprintf(path, sizeof(path), LOG_DIRECTORY "/%08lx.bin", (unsigned long)firstIndex);
+
+  return String(path);
+}
+
+void indexLogRecord(LogSegment &segment, const LogRecord &record) {
+  if (segment.recordCount == 0) segment.firstSession = record.session;
+  segment.lastSession = record.session;
+
+  if (record.flags & LOG_FLAG_TIME_SYNCED) {
+    if (segment.firstSyncedTime == 0) segment.firstSyncedTime = record.timestamp;
+    segment.lastSyncedTime = record.timestamp;
+  }
+
+  segment.recordCount++;
+}
+
+// Rebuilds the index entry of a segment from its file. A record torn by a
+// power loss during the last append is dropped.
+void scanLogSegment(LogSegment &segment) {
+  uint32_t firstIndex = segment.firstIndex;
+  memset(&segment, 0, sizeof(LogSegment));
+  segment.firstIndex = firstIndex;
+
+  File file = LittleFS.open(logSegmentPath(firstIndex), "r");
+  if (!file) return;
+
+  LogRecord records[LOG_SCAN_RECORDS];
+  uint32_t remaining = min((uint32_t)(file.size() / sizeof(LogRecord)), (uint32_t)LOG_SEGMENT_RECORDS);
+  while (remaining > 0) {
+    uint32_t count = file.read((uint8_t *)records, min(remaining, (uint32_t)LOG_SCAN_RECORDS) * sizeof(LogRecord)) / sizeof(LogRecord);
+    if (count == 0) break;
+
+    for (uint32_t i = 0; i < count; i++) indexLogRecord(segment, records[i]);
+    remaining -= count;
+  }
+  file.close();
+}
+
+// Index of the first record in the segment that isMatch() accepts, or
+// UINT32_MAX
+uint32_t findInLogSegment(const LogSegment &segment, bool (*isMatch)(const LogRecord &record, uint32_t value), uint32_t value) {
+  xSemaphoreTake(logReadMutex, portMAX_DELAY);
+
+  uint32_t found = UINT32_MAX;
+  File file = LittleFS.open(logSegmentPath(segment.firstIndex), "r");
+  LogRecord records[LOG_SCAN_RECORDS];
+  uint32_t index = segment.firstIndex;
+  while (file && found == UINT32_MAX && index < segment.firstIndex + segment.recordCount) {
+    uint32_t count = file.read((uint8_t *)records, sizeof(records)) / sizeof(LogRecord);
+    if (count == 0) break;
+
+    for (uint32_t i = 0; i < count && found == UINT32_MAX; i++, index++) {
+      if (isMatch(records[i], value)) found = index;
+    }
+  }
+  file.close();
+
+  xSemaphoreGive(logReadMutex);
+  return found;
+}
+
+bool isLogRecordInSession(const LogRecord &record, uint32_t session) {
+  return record.session == session;
+}
+
+bool isLogRecordAfterSession(const LogRecord &record, uint32_t session) {
+  return record.session > session;
+}
+
+bool isLogRecordSyncedSince(const LogRecord &record, uint32_t time) {
+  return (record.flags & LOG_FLAG_TIME_SYNCED) && record.timestamp >= time;
+}
+
+// Saves the entries of the full segments, which never change again
+void saveLogIndex() {
+  File file = LittleFS.open(LOG_INDEX_PATH, "w");
+  if (!file) return;
+
+  for (int i = 0; i < logSegmentCount; i++) {
+    if (logSegments[i].recordCount == LOG_SEGMENT_RECORDS) file.write((const uint8_t *)&logSegments[i], sizeof(LogSegment));
+  }
+  file.close();
+}
+
+// Called from logTask()
+void dropOldestLogSegment() {
+  LogSegment oldest = logSegments[0];
+
+  xSemaphoreTake(logMutex, portMAX_DELAY);
+  logSegmentCount--;
+  memmove(logSegments, logSegments + 1, logSegmentCount * sizeof(LogSegment));
+  logFirstIndex = logSegmentCount > 0 ? logSegments[0].firstIndex : logRecordCount;
+  xSemaphoreGive(logMutex);
+
+  // A reader that looked the segment up before finds the file gone
+  xSemaphoreTake(logReadMutex, portMAX_DELAY);
+  if (logReadFile && logReadFileIndex == oldest.firstIndex) logReadFile.close();
+  LittleFS.remove(logSegmentPath(oldest.firstIndex));
+  xSemaphoreGive(logReadMutex);
+
+  Serial.println("Measurement log dropped records " + String(oldest.firstIndex) + " to " + String(oldest.firstIndex + oldest.recordCount));
+
+  saveLogIndex();
+  isLogInfoDirty = true;
+}
+
+// Records are batched into one notification until the frame is full for the
+// negotiated MTU, the state changes or the oldest record gets too old.
+void queueMeasurementRecord(const MeasurementSample &sample) {
+  MeasurementRecord record;
+  sampleToMeasurementRecord(sample, record);
+
+  bool isStateChanged = false;
+  if (measurementFrameCount > 0) {
+    MeasurementRecord previous;
+    memcpy(&previous, measurementFrame + MEASUREMENT_FRAME_HEADER_LENGTH + (measurementFrameCount - 1) * sizeof(MeasurementRecord), sizeof(MeasurementRecord));
+    isStateChanged = previous.state != record.state;
+  } else {
+    measurementFrameStartMillis = record.timestamp;
+  }
+
+  memcpy(measurementFrame + MEASUREMENT_FRAME_HEADER_LENGTH + measurementFrameCount * sizeof(MeasurementRecord), &record, sizeof(MeasurementRecord));
+  measurementFrameCount++;
+
+  int capacity = 1;
+  if (bleCentralHandle != BLE_CONNECTION_HANDLE_NONE) {
+    capacity = (bleNegotiatedMtu() - BLE_ATT_NOTIFY_OVERHEAD - MEASUREMENT_FRAME_HEADER_LENGTH) / sizeof(MeasurementRecord);
+    capacity = constrain(capacity, 1, MEASUREMENT_BATCH_MAX_RECORDS);
+  }
+
+  if (measurementFrameCount >= capacity || isStateChanged || record.timestamp - measurementFrameStartMillis >= MEASUREMENT_BATCH_MAX_AGE_MS) {
+    flushMeasurementFrame();
+  }
+}
+
+void sampleToMeasurementRecord(const MeasurementSample &sample, MeasurementRecord &record) {
+  record.sequence = sample.sequence;
+  record.timestamp = sample.timestamp;
+  record.rawIR = sample.irLevel;
+  record.agtron = constrain(lroundf(sample.agtronLevel * MEASUREMENT_AGTRON_SCALE), INT16_MIN, INT16_MAX);
+  record.state = sample.state;
+  record.flags = sample.flags;
+}
+
+void flushMeasurementFrame() {
+  if (measurementFrameCount == 0) return;
+
+  measurementFrame[0] = MEASUREMENT_FRAME_VERSION;
+  measurementFrame[1] = measurementFrameCount;
+  measurementCharacteristic.writeValue(measurementFrame, MEASUREMENT_FRAME_HEADER_LENGTH + measurementFrameCount * sizeof(MeasurementRecord));
+  bleNotifiedBytes += MEASUREMENT_FRAME_HEADER_LENGTH + measurementFrameCount * sizeof(MeasurementRecord);
+
+  measurementFrameCount = 0;
+}
+
+void startRawStream(uint16_t rate) {
+  Serial.println("Raw stream started at " + String(rate) + "Hz");
+
+  rawStreamRate = rate;
+  sampleAverage = RAW_STREAM_SAMPLE_AVERAGE;
+  sampleRate = rate;
+  setupParticleSensor();
+
+  rawStreamLatestIR = particleSensor.getIR();
+  rawStreamFrameCount = 0;
+  xQueueReset(rawStreamQueue);
+  isRawStreamGap = false;
+}
+
+void stopRawStream() {
+  if (rawStreamRate == 0) return;
+
+  Serial.println("Raw stream stopped, sent " + String(rawStreamSentFrames) + " frames, dropped " + String(rawStreamDroppedFrames));
+
+  rawStreamRate = 0;
+  sampleAverage = 4;
+  sampleRate = 50;
+  setupParticleSensor();
+}
+
+// Acquisition only ever queues frames for the BLE task, so a slow central can
+// never stall the sensor FIFO. When the queue is full the newest frame is
+// dropped and the gap is flagged.
+void rawStreamJob() {
+  if (rawStreamRate == 0) return;
+
+  drainRawStreamFifo();
+
+  if (rawStreamFrameCount > 0 && millis() - rawStreamFrameStartMillis >= RAW_STREAM_FRAME_MAX_AGE_MS) {
+    finishRawStreamFrame();
+  }
+}
+
+void rawStreamSendJob() {
+  RawStreamFrame frame;
+  while (xQueueReceive(rawStreamQueue, &frame, 0) == pdTRUE) {
+    if (!isRawStreamSubscribed) continue;
+
+    rawStreamCharacteristic.writeValue(frame.data, frame.length);
+    bleNotifiedBytes += frame.length;
+    rawStreamSentFrames++;
+  }
+}
+
+// Reads the sensor FIFO directly: the library keeps only four samples, which
+// overflows at stream rates whenever the loop is busy redrawing the OLED.
+void drainRawStreamFifo() {
+  uint8_t overflow = particleSensor.readRegister8(MAX30105_I2C_ADDRESS, MAX30105_FIFO_OVERFLOW);
+  uint8_t readPointer = particleSensor.readRegister8(MAX30105_I2C_ADDRESS, MAX30105_FIFO_READ_PTR);
+  uint8_t writePointer = particleSensor.readRegister8(MAX30105_I2C_ADDRESS, MAX30105_FIFO_WRITE_PTR);
+
+  if (overflow > 0) {
+    // The FIFO is full and rolling over, so every slot holds a sample
+    finishRawStreamFrame();
+    rawStreamSequence += overflow;
+    isRawStreamGap = true;
+  }
+
+  int available = overflow > 0 ? MAX30105_FIFO_DEPTH : (writePointer - readPointer + MAX30105_FIFO_DEPTH) % MAX30105_FIFO_DEPTH;
+
+  // Every sample holds the Red channel ahead of the IR one, only IR is kept
+  int sampleLength = ledMode * MAX30105_FIFO_CHANNEL_LENGTH;
+  int burstSamples = MAX30105_FIFO_BURST_LENGTH / sampleLength;
+
+  while (available > 0) {
+    int count = min(available, burstSamples);
+    available -= count;
+
+    Wire.beginTransmission(MAX30105_I2C_ADDRESS);
+    Wire.write(MAX30105_FIFO_DATA);
+    if (Wire.endTransmission(false) != 0 || Wire.requestFrom(MAX30105_I2C_ADDRESS, count * sampleLength) != count * sampleLength) {
+      metricsCounters.i2cErrors++;
+      return;
+    }
+
+    for (int i = 0; i < count; i++) {
+      uint8_t data[MAX30105_FIFO_CHANNEL_LENGTH * 3];
+      for (int j = 0; j < sampleLength; j++) data[j] = Wire.read();
+
+      const uint8_t *ir = data + MAX30105_FIFO_IR_CHANNEL * MAX30105_FIFO_CHANNEL_LENGTH;
+      uint32_t sample = ((uint32_t)ir[0] << 16 | (uint32_t)ir[1] << 8 | ir[2]) & MAX30105_SAMPLE_MASK;
+
+      appendRawStreamSample(sample);
+      rawStreamLatestIR = sample;
+    }
+  }
+}
+
+void appendRawStreamSample(uint32_t sample) {
+  if (!isRawStreamSubscribed) {
+    rawStreamSequence++;
+    return;
+  }
+
+  uint8_t *data = rawStreamFrame.data;
+
+  if (rawStreamFrameCount == 0) {
+    data[0] = RAW_STREAM_FRAME_VERSION;
+    data[1] = isRawStreamGap ? RAW_STREAM_FLAG_GAP : 0;
+    data[2] = rawStreamSequence & 0xFF;
+    data[3] = rawStreamSequence >> 8;
+    data[5] = sample & 0xFF;
+    data[6] = (sample >> 8) & 0xFF;
+    data[7] = (sample >> 16) & 0xFF;
+    rawStreamFrame.length = RAW_STREAM_FRAME_HEADER_LENGTH;
+    rawStreamFrameStartMillis = millis();
+    isRawStreamGap = false;
+  } else {
+    int32_t delta = (int32_t)sample - (int32_t)rawStreamFramePrevious;
+    uint32_t zigzag = ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31);
+
+    while (zigzag >= 0x80) {
+      data[rawStreamFrame.length++] = (zigzag & 0x7F) | 0x80;
+      zigzag >>= 7;
+    }
+    data[rawStreamFrame.length++] = zigzag;
+  }
+
+  rawStreamFramePrevious = sample;
+  rawStreamFrameCount++;
+  rawStreamSequence++;
+
+  // An 18 bit delta takes at most 3 varint bytes
+  int frameLimit = min((int)RAW_STREAM_FRAME_MAX_LENGTH, bleMtu - BLE_ATT_NOTIFY_OVERHEAD);
+  if (rawStreamFrame.length + 3 > frameLimit || rawStreamFrameCount == 255) {
+    finishRawStreamFrame();
+  }
+}
+
+void finishRawStreamFrame() {
+  if (rawStreamFrameCount == 0) return;
+
+  rawStreamFrame.data[4] = rawStreamFrameCount;
+  rawStreamFrameCount = 0;
+
+  if (xQueueSend(rawStreamQueue, &rawStreamFrame, 0) != pdTRUE) {
+    rawStreamDroppedFrames++;
+    isRawStreamGap = true;
+  }
+}
+
+void displayPleaseLoadSample() {
+  oled.erase();
+  oled.setCursor(3, 0);
+  oled.setFont(QW_FONT_8X16);
+  oled.print("Please load sample!");
+  oled.display();
+}
+
+void displaySensorDirty() {
+  oled.erase();
+  oled.setCursor(3, 0);
+  oled.setFont(QW_FONT_8X16);
+  oled.println("Please");
+  oled.println("Clean");
+  oled.println("Sensor!");
+  oled.display();
+}
+
+String agtronDescription(float agtronLevel) {
+  if (agtronLevel <= 20) return String("Over developed");
   if (agtronLevel <= 30) return String("Very Dark");
   if (agtronLevel < 40) return String("Dark");
   if (agtronLevel < 50) return String("Medium Dark");
@@ -746,12 +3553,32 @@ void blePeripheralConnectHandler(BLEDevice central) {
   // central connected event handler
   Serial.print("BLE Connected event, central: ");
   Serial.println(central.address());
+
+  bleCentralHandle = bleConnectionHandle(central);
+  isPublishForced = true;
+
+  // connectionProfileJob() picks a profile once the central has settled
+  bleProfile = BLE_PROFILE_NONE;
+  bleRefusedProfile = BLE_PROFILE_NONE;
+  bleConnectionStats.profile = BLE_PROFILE_NONE;
+  bleConnectedMillis = millis();
+  bleFastActivityMillis = 0;
 }
 
 void blePeripheralDisconnectHandler(BLEDevice central) {
   // central disconnected event handler
   Serial.print("BLE Disconnected event, central: ");
   Serial.println(central.address());
+
+  accountConnectionProfile();
+  bleCentralHandle = BLE_CONNECTION_HANDLE_NONE;
+  bleProfile = BLE_PROFILE_NONE;
+  bleConnectionStats.profile = BLE_PROFILE_NONE;
+  measurementFrameCount = 0;
+
+  rawStreamRateCharacteristic.setValue(0);
+  pendingRawStreamRate = 0;
+  stopLogTransfer();
 }
 
 void bleLEDBrightnessLevelWritten(BLEDevice central, BLECharacteristic characteristic) {
@@ -760,11 +3587,11 @@ void bleLEDBrightnessLevelWritten(BLEDevice central, BLECharacteristic character
   Serial.print("bleLEDBrightnessLevelWritten event, written: ");
   Serial.println(ledBrightness);
 
-  EEPROM.put(EEPROM_LED_BRIGHTNESS_IDX, ledBrightness);
+  storeSettings();
 
-  EEPROM.commit();
+  updateSettingsBlobCharacteristic();
 
-  setupParticleSensor();
+  isSensorSetupPending = true;
 }
 
 void bleIntersectionPointWritten(BLEDevice central, BLECharacteristic characteristic) {
@@ -773,9 +3600,9 @@ void bleIntersectionPointWritten(BLEDevice central, BLECharacteristic characteri
   Serial.print("bleIntersectionPointWritten event, written: ");
   Serial.println(intersectionPoint);
 
-  EEPROM.put(EEPROM_INTERSECTION_POINT_IDX, intersectionPoint);
+  storeSettings();
 
-  EEPROM.commit();
+  updateSettingsBlobCharacteristic();
 }
 
 void bleDeviationWritten(BLEDevice central, BLECharacteristic characteristic) {
@@ -784,9 +3611,9 @@ void bleDeviationWritten(BLEDevice central, BLECharacteristic characteristic) {
   Serial.print("bleDeviationWritten event, written: ");
   Serial.println(deviation);
 
-  EEPROM.put(EEPROM_DEVIATION_IDX, deviation);
+  storeSettings();
 
-  EEPROM.commit();
+  updateSettingsBlobCharacteristic();
 }
 
 void bleCoefficient0Written(BLEDevice central, BLECharacteristic characteristic) {
@@ -795,31 +3622,31 @@ void bleCoefficient0Written(BLEDevice central, BLECharacteristic characteristic)
   Serial.print("bleCoefficient0Written event, written: ");
   Serial.println(coefficient_0);
 
-  EEPROM.put(EEPROM_COEFFICIENT_0_IDX, coefficient_0);
+  storeSettings();
 
-  EEPROM.commit();
+  updateSettingsBlobCharacteristic();
 }
 
 void bleCoefficient1Written(BLEDevice central, BLECharacteristic characteristic) {
-  coefficient_1 = coefficient0Characteristic.value();
+  coefficient_1 = coefficient1Characteristic.value();
 
   Serial.print("bleCoefficient1Written event, written: ");
   Serial.println(coefficient_1);
 
-  EEPROM.put(EEPROM_COEFFICIENT_1_IDX, coefficient_1);
+  storeSettings();
 
-  EEPROM.commit();
+  updateSettingsBlobCharacteristic();
 }
 
 void bleCoefficient2Written(BLEDevice central, BLECharacteristic characteristic) {
   coefficient_2 = coefficient2Characteristic.value();
 
-  Serial.print("bleCoefficient0Written event, written: ");
+  Serial.print("bleCoefficient2Written event, written: ");
   Serial.println(coefficient_2);
 
-  EEPROM.put(EEPROM_COEFFICIENT_2_IDX, coefficient_2);
+  storeSettings();
 
-  EEPROM.commit();
+  updateSettingsBlobCharacteristic();
 }
 
 void bleCoefficient3Written(BLEDevice central, BLECharacteristic characteristic) {
@@ -828,9 +3655,9 @@ void bleCoefficient3Written(BLEDevice central, BLECharacteristic characteristic)
   Serial.print("bleCoefficient3Written event, written: ");
   Serial.println(coefficient_3);
 
-  EEPROM.put(EEPROM_COEFFICIENT_3_IDX, coefficient_3);
+  storeSettings();
 
-  EEPROM.commit();
+  updateSettingsBlobCharacteristic();
 }
 
 void bleIROffsetWritten(BLEDevice central, BLECharacteristic characteristic) {
@@ -839,9 +3666,9 @@ void bleIROffsetWritten(BLEDevice central, BLECharacteristic characteristic) {
   Serial.print("bleIROffsetWritten event, written: ");
   Serial.println(irOffset);
 
-  EEPROM.put(EEPROM_IR_OFFSET_IDX, irOffset);
+  storeSettings();
 
-  EEPROM.commit();
+  updateSettingsBlobCharacteristic();
 }
 
 void bleAutoCalibrationWritten(BLEDevice central, BLECharacteristic characteristic) {
@@ -850,6 +3677,47 @@ void bleAutoCalibrationWritten(BLEDevice central, BLECharacteristic characterist
   Serial.print("bleAutoCalibrationWritten event, perform Auto Calibration");
 }
 
+void bleAgtronDeadbandWritten(BLEDevice central, BLECharacteristic characteristic) {
+  agtronDeadband = agtronDeadbandCharacteristic.value();
+
+  Serial.print("bleAgtronDeadbandWritten event, written: ");
+  Serial.println(agtronDeadband);
+
+  storeSettings();
+
+  updateSettingsBlobCharacteristic();
+}
+
+void bleIRDeadbandWritten(BLEDevice central, BLECharacteristic characteristic) {
+  irDeadband = irDeadbandCharacteristic.value();
+
+  Serial.print("bleIRDeadbandWritten event, written: ");
+  Serial.println(irDeadband);
+
+  storeSettings();
+
+  updateSettingsBlobCharacteristic();
+}
+
+void bleNotifyHeartbeatWritten(BLEDevice central, BLECharacteristic characteristic) {
+  uint16_t newNotifyHeartbeat = notifyHeartbeatCharacteristic.value();
+
+  if (newNotifyHeartbeat == 0) {
+    Serial.println("bleNotifyHeartbeatWritten event, written rejected!. Heartbeat must be at least 1s.");
+    notifyHeartbeatCharacteristic.setValue(notifyHeartbeat);
+
+    return;
+  }
+
+  notifyHeartbeat = newNotifyHeartbeat;
+  Serial.print("bleNotifyHeartbeatWritten event, written: ");
+  Serial.println(notifyHeartbeat);
+
+  storeSettings();
+
+  updateSettingsBlobCharacteristic();
+}
+
 void bleBLENameWritten(BLEDevice central, BLECharacteristic characteristic) {
   String newBLEName = bleNameCharacteristic.value();
 
@@ -867,7 +3735,143 @@ void bleBLENameWritten(BLEDevice central, BLECharacteristic characteristic) {
   BLE.setLocalName(bleName.c_str());
   BLE.setDeviceName(bleName.c_str());
 
-  writeStringToEEPROM(EEPROM_BLE_NAME_IDX, bleName);
+  storeSettings();
+
+  updateSettingsBlobCharacteristic();
+}
+
+void bleSettingsBlobWritten(BLEDevice central, BLECharacteristic characteristic) {
+  SettingsBlob blob;
+  int length = settingsBlobCharacteristic.valueLength();
+  memcpy(&blob, settingsBlobCharacteristic.value(), min(length, (int)sizeof(SettingsBlob)));
+
+  if (!isSettingsBlobValid(blob, length)) {
+    Serial.println("bleSettingsBlobWritten event, written rejected!. Invalid version, length or CRC.");
+    updateSettingsBlobCharacteristic();
+
+    return;
+  }
+
+  Serial.println("bleSettingsBlobWritten event, written: version " + String(blob.version));
+
+  applySettingsBlob(blob);
+}
+
+// Takes a blob that passed isSettingsBlobValid()
+void applySettingsBlob(const SettingsBlob &blob) {
+  bool isLEDBrightnessChanged = blob.ledBrightness != ledBrightness;
+  String newBLEName = String(blob.bleName);
+
+  ledBrightness = blob.ledBrightness;
+  intersectionPoint = blob.intersectionPoint;
+  deviation = blob.deviation;
+  coefficient_0 = blob.coefficient[0];
+  coefficient_1 = blob.coefficient[1];
+  coefficient_2 = blob.coefficient[2];
+  coefficient_3 = blob.coefficient[3];
+  irOffset = blob.irOffset;
+  agtronDeadband = blob.agtronDeadband;
+  irDeadband = blob.irDeadband;
+  notifyHeartbeat = blob.notifyHeartbeat;
+
+  ledBrightnessLevelCharacteristic.setValue(ledBrightness);
+  intersectionPointCharacteristic.setValue(intersectionPoint);
+  deviationCharacteristic.setValue(deviation);
+  coefficient0Characteristic.setValue(coefficient_0);
+  coefficient1Characteristic.setValue(coefficient_1);
+  coefficient2Characteristic.setValue(coefficient_2);
+  coefficient3Characteristic.setValue(coefficient_3);
+  irOffsetCharacteristic.setValue(irOffset);
+  agtronDeadbandCharacteristic.setValue(agtronDeadband);
+  irDeadbandCharacteristic.setValue(irDeadband);
+  notifyHeartbeatCharacteristic.setValue(notifyHeartbeat);
+
+  if (newBLEName != bleName) {
+    bleName = newBLEName;
+    bleNameCharacteristic.setValue(bleName);
+    BLE.setLocalName(bleName.c_str());
+    BLE.setDeviceName(bleName.c_str());
+  }
+
+  storeSettings(true);  // a blob is a deliberate save, don't wait for the quiet period
+
+  updateSettingsBlobCharacteristic();
+
+  if (isLEDBrightnessChanged) isSensorSetupPending = true;
+}
+
+void bleSettingsSaveWritten(BLEDevice central, BLECharacteristic characteristic) {
+  Serial.println("bleSettingsSaveWritten event, save requested");
+
+  isSettingsSaveRequested = true;
+}
+
+void bleWifiWritten(BLEDevice central, BLECharacteristic characteristic) {
+  uint8_t state = wifiCharacteristic.value();
+
+  Serial.print("bleWifiWritten event, written: ");
+  Serial.println(state);
+
+  // webTask() switches WiFi, and bleTask() notifies once it has
+  isWifiRequested = state != WIFI_STATE_OFF;
+}
+
+void bleRawStreamRateWritten(BLEDevice central, BLECharacteristic characteristic) {
+  uint16_t rate = rawStreamRateCharacteristic.value();
+
+  Serial.print("bleRawStreamRateWritten event, written: ");
+  Serial.println(rate);
+
+  if (rate != 0 && rate != 50 && rate != 100 && rate != 200 && rate != 400) {
+    Serial.println("bleRawStreamRateWritten event, written rejected!. Rate must be 0, 50, 100, 200 or 400.");
+    rawStreamRateCharacteristic.setValue(rawStreamRate);
+
+    return;
+  }
+
+  pendingRawStreamRate = rate;
+}
+
+void bleLogControlWritten(BLEDevice central, BLECharacteristic characteristic) {
+  const uint8_t *command = logControlCharacteristic.value();
+  int length = logControlCharacteristic.valueLength();
+  if (length < 1) return;
+
+  Serial.print("bleLogControlWritten event, command: ");
+  Serial.println(command[0]);
+
+  if (command[0] == LOG_COMMAND_START_TRANSFER && length >= 5) {
+    uint32_t index;
+    memcpy(&index, command + 1, sizeof(uint32_t));
+
+    startLogTransfer(index, UINT32_MAX);
+  } else if (command[0] == LOG_COMMAND_START_SESSION_TRANSFER && length >= 3) {
+    uint16_t session;
+    memcpy(&session, command + 1, sizeof(uint16_t));
+
+    // Nothing found sends just the empty chunk that ends a transfer
+    uint32_t firstIndex, endIndex;
+    if (!findLogSession(session, firstIndex, endIndex)) firstIndex = endIndex = logRecordCount;
+    startLogTransfer(firstIndex, endIndex);
+  } else if (command[0] == LOG_COMMAND_START_TIME_TRANSFER && length >= 9) {
+    uint32_t fromTime, toTime;
+    memcpy(&fromTime, command + 1, sizeof(uint32_t));
+    memcpy(&toTime, command + 5, sizeof(uint32_t));
+
+    uint32_t firstIndex, endIndex;
+    if (!findLogTime(fromTime, toTime, firstIndex, endIndex)) firstIndex = endIndex = logRecordCount;
+    startLogTransfer(firstIndex, endIndex);
+  } else if (command[0] == LOG_COMMAND_STOP_TRANSFER) {
+    stopLogTransfer();
+  } else if (command[0] == LOG_COMMAND_SET_TIME && length >= 5) {
+    memcpy(&logTimeSyncedUnix, command + 1, sizeof(uint32_t));
+    logTimeSyncedMillis = millis();
+  } else if (command[0] == LOG_COMMAND_SET_PROFILE && length >= 2) {
+    logProfile = command[1];
+  } else if (command[0] == LOG_COMMAND_ERASE) {
+    stopLogTransfer();
+    isLogErasePending = true;
+  }
 }
 
 // -- End BLE Handler --
@@ -888,6 +3892,50 @@ String stringLastN(String input, int n) {
   return (n > 0 && inputSize > n) ? input.substring(inputSize - n) : "";
 }
 
+// Same suffix as stringLastN(BLE.address(), 5), without having to start the BLE
+// controller first
+String bleAddressSuffix() {
+  uint8_t mac[6];
+  esp_read_mac(mac, ESP_MAC_BT);
+
+  char suffix[6];
+  snprintf(suffix, sizeof(suffix), "%02x:%02x", mac[4], mac[5]);
+
+  return String(suffix);
+}
+
+// BLEDevice does not expose its connection handle, so look it up by address
+// the same way ATT does. The address type is not exposed either, so both
+// public and random are tried.
+uint16_t bleConnectionHandle(BLEDevice central) {
+  String address = central.address();
+  uint8_t rawAddress[6];
+  for (int i = 0; i < 6; i++) {
+    rawAddress[5 - i] = strtoul(address.substring(i * 3, i * 3 + 2).c_str(), NULL, 16);
+  }
+
+  for (uint8_t addressType = 0; addressType < 2; addressType++) {
+    uint16_t handle = ATT.connectionHandle(addressType, rawAddress);
+    if (handle != BLE_CONNECTION_HANDLE_NONE) return handle;
+  }
+
+  return BLE_CONNECTION_HANDLE_NONE;
+}
+
+// The central may exchange the MTU at any point after connecting, so this is
+// looked up every time rather than cached
+uint16_t bleNegotiatedMtu() {
+  if (bleCentralHandle == BLE_CONNECTION_HANDLE_NONE) return BLE_ATT_DEFAULT_MTU;
+
+  uint16_t mtu = ATT.mtu(bleCentralHandle);
+  return mtu < BLE_ATT_DEFAULT_MTU ? BLE_ATT_DEFAULT_MTU : mtu;
+}
+
+void logBootStage(const char *stage, unsigned long stageStartMillis) {
+  unsigned long now = millis();
+  Serial.printf("boot: %s took %lums (t+%lums)\n", stage, now - stageStartMillis, now - bootStartMillis);
+}
+
 float mapIRToAgtron(int rawIR) {
   float x = (float)rawIR / 1000;
 
@@ -905,18 +3953,6 @@ float mapIRToAgtron(int rawIR) {
 }
 
 // https://roboticsbackend.com/arduino-write-string-in-eeprom/
-void writeStringToEEPROM(int addrOffset, const String &strToWrite) {
-  byte len = strToWrite.length();
-  EEPROM.write(addrOffset, len);
-  for (int i = 0; i < len; i++) {
-    EEPROM.write(addrOffset + 1 + i, strToWrite[i]);
-  }
-
-#ifdef ESP32
-  EEPROM.commit();
-#endif
-}
-
 String readStringFromEEPROM(int addrOffset) {
   int newStrLen = EEPROM.read(addrOffset);
   char data[newStrLen + 1];
@@ -929,4 +3965,297 @@ String readStringFromEEPROM(int addrOffset) {
   return String(data);
 }
 
+// Padded base64 into 4 bytes per 3 of data, not NUL terminated; returns its length
+size_t base64Encode(const uint8_t *data, size_t length, char *encoded) {
+  static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+  size_t encodedLength = 0;
+  for (size_t i = 0; i < length; i += 3) {
+    uint32_t group = data[i] << 16;
+    if (i + 1 < length) group |= data[i + 1] << 8;
+    if (i + 2 < length) group |= data[i + 2];
+
+    encoded[encodedLength++] = alphabet[group >> 18 & 0x3f];
+    encoded[encodedLength++] = alphabet[group >> 12 & 0x3f];
+    encoded[encodedLength++] = i + 1 < length ? alphabet[group >> 6 & 0x3f] : '=';
+    encoded[encodedLength++] = i + 2 < length ? alphabet[group & 0x3f] : '=';
+  }
+  return encodedLength;
+}
+
+// CRC-16/CCITT-FALSE
+uint16_t crc16(const uint8_t *data, size_t length) {
+  uint16_t crc = 0xFFFF;
+  for (size_t i = 0; i < length; i++) {
+    crc ^= (uint16_t)data[i] << 8;
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+  }
+  return crc;
+}
+
+void settingsToBlob(SettingsBlob &blob) {
+  memset(&blob, 0, sizeof(SettingsBlob));
+
+  blob.version = SETTINGS_BLOB_VERSION;
+  blob.length = sizeof(SettingsBlob);
+  blob.ledBrightness = ledBrightness;
+  blob.intersectionPoint = intersectionPoint;
+  blob.deviation = deviation;
+  blob.coefficient[0] = coefficient_0;
+  blob.coefficient[1] = coefficient_1;
+  blob.coefficient[2] = coefficient_2;
+  blob.coefficient[3] = coefficient_3;
+  blob.irOffset = irOffset;
+  blob.agtronDeadband = agtronDeadband;
+  blob.irDeadband = irDeadband;
+  blob.notifyHeartbeat = notifyHeartbeat;
+  strncpy(blob.bleName, bleName.c_str(), SETTINGS_BLE_NAME_LENGTH - 1);
+
+  blob.crc = crc16((const uint8_t *)&blob + SETTINGS_BLOB_HEADER_LENGTH, sizeof(SettingsBlob) - SETTINGS_BLOB_HEADER_LENGTH);
+}
+
+bool isSettingsBlobValid(const SettingsBlob &blob, int length) {
+  if (length != sizeof(SettingsBlob)) return false;
+  if (blob.version != SETTINGS_BLOB_VERSION || blob.length != sizeof(SettingsBlob)) return false;
+  if (blob.crc != crc16((const uint8_t *)&blob + SETTINGS_BLOB_HEADER_LENGTH, sizeof(SettingsBlob) - SETTINGS_BLOB_HEADER_LENGTH)) return false;
+
+  // Same limits as the individual setting characteristics
+  int bleNameLength = strnlen(blob.bleName, SETTINGS_BLE_NAME_LENGTH);
+  if (bleNameLength == 0 || bleNameLength >= SETTINGS_BLE_NAME_LENGTH) return false;
+  if (blob.notifyHeartbeat == 0) return false;
+  if (isnan(blob.agtronDeadband) || blob.agtronDeadband < 0) return false;
+
+  return true;
+}
+
+// Keeps the blob readable by centrals in step with the individual settings
+void updateSettingsBlobCharacteristic() {
+  SettingsBlob blob;
+  settingsToBlob(blob);
+
+  settingsBlobCharacteristic.setValue((const uint8_t *)&blob, sizeof(SettingsBlob));
+
+  xSemaphoreTake(settingsMutex, portMAX_DELAY);
+  publishedSettingsBlob = blob;
+  xSemaphoreGive(settingsMutex);
+}
+
+void setDefaultSettings(StoredSettings &settings) {
+  memset(&settings, 0, sizeof(StoredSettings));
+
+  settings.version = SETTINGS_STORE_VERSION;
+  settings.ledBrightness = EEPROM_LED_BRIGHTNESS_DEFAULT;
+  settings.intersectionPoint = EEPROM_INTERSECTION_POINT_DEFAULT;
+  settings.deviation = EEPROM_DEVIATION_DEFAULT;
+  settings.coefficient[0] = EEPROM_COEFFICIENT_0_DEFAULT;
+  settings.coefficient[1] = EEPROM_COEFFICIENT_1_DEFAULT;
+  settings.coefficient[2] = EEPROM_COEFFICIENT_2_DEFAULT;
+  settings.coefficient[3] = EEPROM_COEFFICIENT_3_DEFAULT;
+  settings.irOffset = EEPROM_IR_OFFSET_DEFAULT;
+  settings.agtronDeadband = EEPROM_AGTRON_DEADBAND_DEFAULT;
+  settings.irDeadband = EEPROM_IR_DEADBAND_DEFAULT;
+  settings.notifyHeartbeat = EEPROM_NOTIFY_HEARTBEAT_DEFAULT;
+
+  String defaultBLEName = "Roast Meter " + bleAddressSuffix();
+  strncpy(settings.bleName, defaultBLEName.c_str(), SETTINGS_BLE_NAME_LENGTH - 1);
+}
+
+// Reads the record straight out of the EEPROM RAM copy. Returns false with
+// settings at the defaults when it holds no valid record.
+bool loadStoredSettings(StoredSettings &settings) {
+  setDefaultSettings(settings);
+
+  const uint8_t *record = EEPROM.getDataPtr() + EEPROM_SETTINGS_IDX;
+  uint8_t length = record[2];
+  uint16_t crc = record[3] | record[4] << 8;
+
+  if (record[0] != SETTINGS_STORE_MAGIC) return false;
+  if (length < SETTINGS_STORE_HEADER_LENGTH || length > SETTINGS_STORE_MAX_LENGTH) return false;
+  if (crc16(record + SETTINGS_STORE_HEADER_LENGTH, length - SETTINGS_STORE_HEADER_LENGTH) != crc) return false;
+
+  memcpy(&settings, record, min((size_t)length, sizeof(StoredSettings)));
+  settings.bleName[SETTINGS_BLE_NAME_LENGTH - 1] = '\0';
+
+  return true;
+}
+
+// Settings version 0: one field per EEPROM_*_IDX offset behind the
+// EEPROM_VALID_CODE marker
+void loadLegacySettings(StoredSettings &settings) {
+  setDefaultSettings(settings);
+  applyStoredSettings(settings);
+
+  uint8_t eeprom_intersection_point;
+  EEPROM.get(EEPROM_LED_BRIGHTNESS_IDX, ledBrightness);
+  EEPROM.get(EEPROM_INTERSECTION_POINT_IDX, eeprom_intersection_point);
+  intersectionPoint = eeprom_intersection_point;
+  EEPROM.get(EEPROM_DEVIATION_IDX, deviation);
+  EEPROM.get(EEPROM_COEFFICIENT_0_IDX, coefficient_0);
+  EEPROM.get(EEPROM_COEFFICIENT_1_IDX, coefficient_1);
+  EEPROM.get(EEPROM_COEFFICIENT_2_IDX, coefficient_2);
+  EEPROM.get(EEPROM_COEFFICIENT_3_IDX, coefficient_3);
+  EEPROM.get(EEPROM_IR_OFFSET_IDX, irOffset);
+
+  if (EEPROM.read(EEPROM_BLE_NAME_IDX) > 0 && EEPROM.read(EEPROM_BLE_NAME_IDX) < SETTINGS_BLE_NAME_LENGTH) {
+    bleName = readStringFromEEPROM(EEPROM_BLE_NAME_IDX);
+  }
+
+  settingsToStored(settings);
+  settings.version = 0;
+}
+
+void settingsToStored(StoredSettings &settings) {
+  memset(&settings, 0, sizeof(StoredSettings));
+
+  settings.ledBrightness = ledBrightness;
+  settings.intersectionPoint = intersectionPoint;
+  settings.deviation = deviation;
+  settings.coefficient[0] = coefficient_0;
+  settings.coefficient[1] = coefficient_1;
+  settings.coefficient[2] = coefficient_2;
+  settings.coefficient[3] = coefficient_3;
+  settings.irOffset = irOffset;
+  settings.agtronDeadband = agtronDeadband;
+  settings.irDeadband = irDeadband;
+  settings.notifyHeartbeat = notifyHeartbeat;
+  strncpy(settings.bleName, bleName.c_str(), SETTINGS_BLE_NAME_LENGTH - 1);
+}
+
+void applyStoredSettings(const StoredSettings &settings) {
+  ledBrightness = settings.ledBrightness;
+  intersectionPoint = settings.intersectionPoint;
+  deviation = settings.deviation;
+  coefficient_0 = settings.coefficient[0];
+  coefficient_1 = settings.coefficient[1];
+  coefficient_2 = settings.coefficient[2];
+  coefficient_3 = settings.coefficient[3];
+  irOffset = settings.irOffset;
+  agtronDeadband = settings.agtronDeadband;
+  irDeadband = settings.irDeadband;
+  notifyHeartbeat = settings.notifyHeartbeat;
+  bleName = String(settings.bleName);
+}
+
+// Seals the record with the current header, the next sequence number and
+// the CRC, and copies it into the EEPROM RAM copy. Only commitSettings()
+// calls it.
+void putStoredSettings(StoredSettings &settings) {
+  settings.magic = SETTINGS_STORE_MAGIC;
+  settings.version = SETTINGS_STORE_VERSION;
+  settings.length = sizeof(StoredSettings);
+  settings.sequence = settingsSequence + 1;
+  settings.crc = crc16((const uint8_t *)&settings + SETTINGS_STORE_HEADER_LENGTH, sizeof(StoredSettings) - SETTINGS_STORE_HEADER_LENGTH);
+
+  EEPROM.put(EEPROM_SETTINGS_IDX, settings);
+}
+
+// Stages the current settings for settingsTask() to commit
+void storeSettings(bool isSaveNow) {
+  StoredSettings settings;
+  settingsToStored(settings);
+
+  xSemaphoreTake(settingsMutex, portMAX_DELAY);
+  stagedSettings = settings;
+  isSettingsDirty = true;
+  settingsDirtyMillis = millis();
+  if (isSaveNow) isSettingsSaveRequested = true;
+  xSemaphoreGive(settingsMutex);
+}
+
+// Writes staged while the commit runs mark the settings dirty again, so
+// settingsTask() commits them next.
+void commitSettings() {
+  StoredSettings settings;
+
+  xSemaphoreTake(settingsMutex, portMAX_DELAY);
+  settings = stagedSettings;
+  isSettingsDirty = false;
+  isSettingsSaveRequested = false;
+  xSemaphoreGive(settingsMutex);
+
+  unsigned long commitStartMillis = millis();
+  putStoredSettings(settings);
+  bool isCommitted = EEPROM.commit();
+
+  xSemaphoreTake(settingsMutex, portMAX_DELAY);
+  if (isCommitted) {
+    metricsCounters.settingsCommits++;
+    settingsSequence++;
+    cacheWarmBootSettings();
+  } else {
+    // Try again on the next quiet period
+    isSettingsDirty = true;
+    settingsDirtyMillis = millis();
+  }
+  xSemaphoreGive(settingsMutex);
+
+  if (!isCommitted) {
+    Serial.println("Settings commit failed");
+    return;
+  }
+
+  settingsCommitCount++;
+  Serial.printf("Settings #%lu committed in %lums, %lu commits since boot\n", (unsigned long)settingsSequence,
+                millis() - commitStartMillis, (unsigned long)settingsCommitCount);
+}
+
+// True when the reset kept RTC memory and it holds a valid WarmBootState
+bool loadWarmBootState() {
+  switch (esp_reset_reason()) {
+    case ESP_RST_SW:
+    case ESP_RST_PANIC:
+    case ESP_RST_INT_WDT:
+    case ESP_RST_TASK_WDT:
+    case ESP_RST_WDT:
+    case ESP_RST_DEEPSLEEP:
+      break;
+    default:
+      warmBootState.magic = 0;
+      return false;
+  }
+
+  const uint8_t *state = (const uint8_t *)&warmBootState;
+  const size_t crcEnd = offsetof(WarmBootState, crc) + sizeof(uint16_t);
+  if (warmBootState.magic != WARM_BOOT_MAGIC || warmBootState.version != WARM_BOOT_VERSION || warmBootState.length != sizeof(WarmBootState) ||
+      crc16(state + crcEnd, sizeof(WarmBootState) - crcEnd) != warmBootState.crc) {
+    warmBootState.magic = 0;
+    return false;
+  }
+
+  // The cached record went through loadStoredSettings(), check it all the same
+  const StoredSettings &settings = warmBootState.settings;
+  if (warmBootState.isSettingsCached &&
+      (settings.magic != SETTINGS_STORE_MAGIC || settings.length != sizeof(StoredSettings) ||
+       crc16((const uint8_t *)&settings + SETTINGS_STORE_HEADER_LENGTH, sizeof(StoredSettings) - SETTINGS_STORE_HEADER_LENGTH) != settings.crc)) {
+    warmBootState.isSettingsCached = false;
+  }
+
+  return true;
+}
+
+// Called with settingsMutex held after changing warmBootState
+void saveWarmBootState() {
+  const size_t crcEnd = offsetof(WarmBootState, crc) + sizeof(uint16_t);
+
+  if (warmBootState.magic != WARM_BOOT_MAGIC) {
+    // Cold boot, RTC memory holds whatever it held at power up
+    memset(&warmBootState, 0, sizeof(WarmBootState));
+    warmBootState.magic = WARM_BOOT_MAGIC;
+  }
+  warmBootState.version = WARM_BOOT_VERSION;
+  warmBootState.length = sizeof(WarmBootState);
+  warmBootState.crc = crc16((const uint8_t *)&warmBootState + crcEnd, sizeof(WarmBootState) - crcEnd);
+}
+
+// Called with settingsMutex held once the EEPROM holds the committed record
+void cacheWarmBootSettings() {
+  // Zeroes the sensor snapshot too when RTC memory held nothing valid
+  if (warmBootState.magic != WARM_BOOT_MAGIC) saveWarmBootState();
+
+  warmBootState.isSettingsCached = loadStoredSettings(warmBootState.settings);
+  saveWarmBootState();
+}
+
 // -- End Utillity Functions --
\ No newline at end of file
@@ -0,0 +1,341 @@
+// Native stand-in for the ESP32 Arduino core, just enough of it to build and
+// run hh_roast_meter_ble.cpp on a Linux host. Time is real: millis() counts
+// from process start and FreeRTOS tasks are threads.
+#pragma once
+
+#include <math.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <type_traits>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define PROGMEM
+#define F(x) (x)
+#define IRAM_ATTR
+#define RTC_NOINIT_ATTR
+#define RTC_DATA_ATTR
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define DEC 10
+#define HEX 16
+#define ESP32 1
+#ifndef ARDUINO
+#define ARDUINO 10819
+#endif
+
+using std::max;
+using std::min;
+
+template <typename T, typename L, typename H>
+T constrain(T value, L low, H high) {
+  return value < low ? (T)low : (value > high ? (T)high : value);
+}
+
+namespace mock {
+
+inline std::chrono::steady_clock::time_point startTime() {
+  static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  return start;
+}
+
+// Level returned by digitalRead(); pins idle high as with INPUT_PULLUP
+inline std::atomic<uint8_t> *pinLevels() {
+  static std::atomic<uint8_t> levels[40];
+  static bool isInitialised = [] {
+    for (auto &level : levels) level = HIGH;
+    return true;
+  }();
+  (void)isInitialised;
+  return levels;
+}
+
+// Serial output is dropped unless MOCK_SERIAL is set in the environment
+inline bool isSerialEcho() {
+  static const bool isEcho = getenv("MOCK_SERIAL") != NULL;
+  return isEcho;
+}
+
+inline std::atomic<int> &restartCount() {
+  static std::atomic<int> count{ 0 };
+  return count;
+}
+
+}  // namespace mock
+
+inline unsigned long millis() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - mock::startTime()).count();
+}
+
+inline unsigned long micros() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - mock::startTime()).count();
+}
+
+inline void delay(unsigned long ms) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+inline void delayMicroseconds(unsigned int us) {
+  std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+inline void yield() {
+  std::this_thread::yield();
+}
+
+inline void pinMode(uint8_t pin, uint8_t mode) {}
+
+inline int digitalRead(uint8_t pin) {
+  return pin < 40 ? mock::pinLevels()[pin].load() : LOW;
+}
+
+inline void digitalWrite(uint8_t pin, uint8_t value) {
+  if (pin < 40) mock::pinLevels()[pin] = value;
+}
+
+class String {
+ public:
+  String() {}
+  String(const char *value) : _value(value ? value : "") {}
+  String(const std::string &value) : _value(value) {}
+  explicit String(char value) : _value(1, value) {}
+  String(int value, unsigned char base = 10) { formatInteger(value, base); }
+  String(unsigned int value, unsigned char base = 10) { formatInteger(value, base); }
+  String(long value, unsigned char base = 10) { formatInteger(value, base); }
+  String(unsigned long value, unsigned char base = 10) { formatInteger(value, base); }
+  String(unsigned char value, unsigned char base = 10) { formatInteger(value, base); }
+  String(float value, unsigned char decimals = 2) { formatFloat(value, decimals); }
+  String(double value, unsigned char decimals = 2) { formatFloat(value, decimals); }
+
+  const char *c_str() const { return _value.c_str(); }
+  unsigned int length() const { return _value.size(); }
+  bool isEmpty() const { return _value.empty(); }
+  void reserve(unsigned int size) { _value.reserve(size); }
+
+  char operator[](unsigned int index) const { return index < _value.size() ? _value[index] : 0; }
+  char charAt(unsigned int index) const { return (*this)[index]; }
+
+  String substring(unsigned int from) const { return from < _value.size() ? String(_value.substr(from)) : String(); }
+  String substring(unsigned int from, unsigned int to) const {
+    return from < _value.size() && to > from ? String(_value.substr(from, to - from)) : String();
+  }
+
+  int indexOf(char c, unsigned int from = 0) const {
+    size_t position = _value.find(c, from);
+    return position == std::string::npos ? -1 : (int)position;
+  }
+  int indexOf(const String &value, unsigned int from = 0) const {
+    size_t position = _value.find(value._value, from);
+    return position == std::string::npos ? -1 : (int)position;
+  }
+
+  long toInt() const { return atol(_value.c_str()); }
+  float toFloat() const { return atof(_value.c_str()); }
+  bool startsWith(const String &prefix) const { return _value.rfind(prefix._value, 0) == 0; }
+  bool endsWith(const String &suffix) const {
+    return _value.size() >= suffix._value.size() && _value.compare(_value.size() - suffix._value.size(), suffix._value.size(), suffix._value) == 0;
+  }
+  bool equals(const String &other) const { return _value == other._value; }
+  bool equalsIgnoreCase(const String &other) const {
+    return _value.size() == other._value.size() && std::equal(_value.begin(), _value.end(), other._value.begin(), [](char a, char b) { return tolower(a) == tolower(b); });
+  }
+
+  void toLowerCase() {
+    for (char &c : _value) c = tolower(c);
+  }
+  void toUpperCase() {
+    for (char &c : _value) c = toupper(c);
+  }
+  void trim() {
+    while (!_value.empty() && isspace((unsigned char)_value.back())) _value.pop_back();
+    size_t start = 0;
+    while (start < _value.size() && isspace((unsigned char)_value[start])) start++;
+    _value.erase(0, start);
+  }
+
+  void getBytes(unsigned char *buffer, unsigned int size) const {
+    if (size == 0) return;
+    size_t length = std::min<size_t>(size - 1, _value.size());
+    memcpy(buffer, _value.data(), length);
+    buffer[length] = 0;
+  }
+
+  String &operator+=(const String &other) {
+    _value += other._value;
+    return *this;
+  }
+  String &operator+=(const char *other) {
+    _value += other;
+    return *this;
+  }
+  String &operator+=(char c) {
+    _value += c;
+    return *this;
+  }
+  bool concat(const String &other) {
+    _value += other._value;
+    return true;
+  }
+  bool concat(const char *other, unsigned int length) {
+    _value.append(other, length);
+    return true;
+  }
+  bool concat(char c) {
+    _value += c;
+    return true;
+  }
+
+  bool operator==(const String &other) const { return _value == other._value; }
+  bool operator==(const char *other) const { return _value == other; }
+  bool operator!=(const String &other) const { return _value != other._value; }
+  bool operator!=(const char *other) const { return _value != other; }
+
+ private:
+  template <typename T>
+  void formatInteger(T value, unsigned char base) {
+    char buffer[40];
+    if (base == HEX) {
+      snprintf(buffer, sizeof(buffer), "%lx", (unsigned long)value);
+    } else if (std::is_signed<T>::value) {
+      snprintf(buffer, sizeof(buffer), "%ld", (long)value);
+    } else {
+      snprintf(buffer, sizeof(buffer), "%lu", (unsigned long)value);
+    }
+    _value = buffer;
+  }
+
+  void formatFloat(double value, unsigned char decimals) {
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), "%.*f", decimals, value);
+    _value = buffer;
+  }
+
+  std::string _value;
+};
+
+inline String operator+(const String &a, const String &b) {
+  String result(a);
+  result += b;
+  return result;
+}
+inline String operator+(const String &a, const char *b) {
+  String result(a);
+  result += b;
+  return result;
+}
+inline String operator+(const char *a, const String &b) {
+  String result(a);
+  result += b;
+  return result;
+}
+inline String operator+(const String &a, char b) {
+  String result(a);
+  result += b;
+  return result;
+}
+
+class Print;
+
+class Printable {
+ public:
+  virtual ~Printable() {}
+  virtual size_t printTo(Print &p) const = 0;
+};
+
+class Print {
+ public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t *buffer, size_t size) {
+    size_t written = 0;
+    while (written < size && write(buffer[written])) written++;
+    return written;
+  }
+  size_t write(const char *value) { return write((const uint8_t *)value, strlen(value)); }
+  size_t write(const char *buffer, size_t size) { return write((const uint8_t *)buffer, size); }
+
+  size_t print(const String &value) { return write(value.c_str()); }
+  size_t print(const char *value) { return write(value); }
+  size_t print(char value) { return write((uint8_t)value); }
+  size_t print(unsigned char value, int base = DEC) { return print(String((unsigned long)value, base)); }
+  size_t print(int value, int base = DEC) { return print(String((long)value, base)); }
+  size_t print(unsigned int value, int base = DEC) { return print(String((unsigned long)value, base)); }
+  size_t print(long value, int base = DEC) { return print(String(value, base)); }
+  size_t print(unsigned long value, int base = DEC) { return print(String(value, base)); }
+  size_t print(double value, int decimals = 2) { return print(String(value, decimals)); }
+  size_t print(const Printable &value) { return value.printTo(*this); }
+
+  template <typename T>
+  size_t println(const T &value) {
+    size_t written = print(value);
+    return written + println();
+  }
+  template <typename T>
+  size_t println(const T &value, int format) {
+    size_t written = print(value, format);
+    return written + println();
+  }
+  size_t println() { return write("\r\n"); }
+
+  size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3))) {
+    char buffer[512];
+    va_list arguments;
+    va_start(arguments, format);
+    int length = vsnprintf(buffer, sizeof(buffer), format, arguments);
+    va_end(arguments);
+    return write((const uint8_t *)buffer, std::min<int>(length, sizeof(buffer) - 1));
+  }
+};
+
+class Stream : public Print {
+ public:
+  virtual int available() { return 0; }
+  virtual int read() { return -1; }
+  virtual int peek() { return -1; }
+  void setTimeout(unsigned long timeout) {}
+};
+
+class HardwareSerial : public Stream {
+ public:
+  void begin(unsigned long baud) {}
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t *buffer, size_t size) override {
+    if (mock::isSerialEcho()) fwrite(buffer, 1, size, stdout);
+    return size;
+  }
+  using Print::write;
+  operator bool() const { return true; }
+};
+
+inline HardwareSerial Serial;
+
+class EspClass {
+ public:
+  uint32_t getFreeHeap() { return 200 * 1024; }
+  uint32_t getMinFreeHeap() { return 180 * 1024; }
+  uint32_t getMaxAllocHeap() { return 110 * 1024; }
+  uint64_t getEfuseMac() { return 0x0000a1b2c3d4e5f6ULL; }
+  // Recorded, as the firmware threads cannot be started again
+  void restart() { mock::restartCount()++; }
+};
+
+inline EspClass ESP;
+
+#include "esp_system.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
@@ -0,0 +1,588 @@
+// Native model of the ArduinoBLE peripheral API with a scriptable central.
+//
+// The firmware side (BLEService, BLECharacteristic, BLE) behaves like the
+// library: handlers run inside BLE.poll(), on whichever task polls. Tests
+// drive a mock::BLECentral from their own thread; every central operation is
+// queued for the next poll and the call returns once it has been handled, so
+// the measured wait and handler times are what a phone would see, minus the
+// radio. Notifications sent to a subscribed central are recorded with their
+// time for rate and throughput checks.
+#pragma once
+
+#include <Arduino.h>
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+enum BLEProperty {
+  BLEBroadcast = 0x01,
+  BLERead = 0x02,
+  BLEWriteWithoutResponse = 0x04,
+  BLEWrite = 0x08,
+  BLENotify = 0x10,
+  BLEIndicate = 0x20,
+};
+
+enum BLEDeviceEvent { BLEConnected = 0, BLEDisconnected, BLEDiscovered, BLEDeviceLastEvent };
+enum BLECharacteristicEvent { BLESubscribed = 0, BLEUnsubscribed, BLEWritten, BLEUpdated = BLEWritten, BLECharacteristicEventLast };
+
+#define BLE_ATT_DEFAULT_MTU_MOCK 23
+
+class BLEDevice {
+ public:
+  BLEDevice() {}
+  BLEDevice(uint8_t addressType, const uint8_t address[6]) : _isValid(true), _addressType(addressType) { memcpy(_address, address, 6); }
+  virtual ~BLEDevice() {}
+
+  virtual void poll() {}
+  virtual bool connected() const;
+  virtual bool disconnect();
+
+  // Most significant byte first, as ArduinoBLE formats it
+  virtual String address() const {
+    char buffer[18];
+    snprintf(buffer, sizeof(buffer), "%02x:%02x:%02x:%02x:%02x:%02x", _address[5], _address[4], _address[3], _address[2], _address[1], _address[0]);
+    return String(buffer);
+  }
+
+  int rssi() { return -50; }
+  operator bool() const { return _isValid; }
+
+ private:
+  bool _isValid = false;
+  uint8_t _addressType = 0;
+  uint8_t _address[6] = {};
+};
+
+class BLECharacteristic;
+typedef void (*BLEDeviceEventHandler)(BLEDevice device);
+typedef void (*BLECharacteristicEventHandler)(BLEDevice device, BLECharacteristic characteristic);
+
+namespace mock {
+
+struct BLELocalCharacteristic {
+  std::string uuid;
+  uint16_t properties = 0;
+  int valueSize = 0;
+  bool isFixedLength = false;
+  std::vector<uint8_t> value;
+  bool isSubscribed = false;
+  bool isWritten = false;
+  BLECharacteristicEventHandler handlers[BLECharacteristicEventLast] = {};
+};
+
+struct BLENotification {
+  std::string uuid;
+  std::vector<uint8_t> value;
+  unsigned long micros;
+};
+
+// Every request, including refused ones, which leave the connection as it was
+struct BLEConnectionUpdate {
+  int status;  // HCI status the request was answered with, 0 when accepted
+  uint16_t handle;
+  uint16_t minInterval;
+  uint16_t maxInterval;
+  uint16_t latency;
+  uint16_t supervisionTimeout;
+};
+
+// Timing of central operations. wait is from the central issuing the
+// operation to BLE.poll() picking it up; handler is the time spent
+// handling it, including the firmware's event handler.
+struct BLEEventStats {
+  uint32_t count = 0;
+  unsigned long worstWaitUs = 0;
+  unsigned long worstHandlerUs = 0;
+  uint64_t totalWaitUs = 0;
+  uint64_t totalHandlerUs = 0;
+};
+
+struct BLEAdvertisement {
+  uint32_t count = 0;  // BLE.advertise() calls
+  std::string localName;
+  std::string advertisedService;
+  uint16_t companyId = 0;
+  std::vector<uint8_t> manufacturerData;
+};
+
+struct BLEEvent {
+  enum Type { CONNECT, DISCONNECT, SUBSCRIBE, UNSUBSCRIBE, READ, WRITE } type;
+  std::string uuid;
+  std::vector<uint8_t> value;
+  uint8_t address[6] = {};
+  uint16_t mtu = BLE_ATT_DEFAULT_MTU_MOCK;
+  unsigned long queuedMicros = 0;
+  bool isDone = false;
+  bool isOk = false;
+};
+
+inline std::string upperCase(std::string value) {
+  for (char &c : value) c = toupper(c);
+  return value;
+}
+
+struct BLEPeripheral {
+  std::mutex mutex;  // guards events, notifications, stats and the advertisement
+  std::condition_variable eventDone;
+  std::deque<std::shared_ptr<BLEEvent>> events;
+
+  std::map<std::string, BLELocalCharacteristic *> characteristics;
+  std::vector<std::string> services;
+  BLEDeviceEventHandler handlers[BLEDeviceLastEvent] = {};
+  bool isBegun = false;
+
+  // Connection state, only touched from BLE.poll()
+  bool isConnected = false;
+  uint8_t address[6] = {};
+  uint16_t mtu = BLE_ATT_DEFAULT_MTU_MOCK;
+
+  std::vector<BLENotification> notifications;
+  std::vector<BLEConnectionUpdate> connectionUpdates;
+  int connectionUpdateStatus = 0;  // answer to the next requests
+  BLEEventStats stats;
+  BLEAdvertisement advertisement;
+
+  BLELocalCharacteristic *find(const std::string &uuid) {
+    auto characteristic = characteristics.find(upperCase(uuid));
+    return characteristic == characteristics.end() ? nullptr : characteristic->second;
+  }
+};
+
+inline BLEPeripheral &blePeripheral() {
+  static BLEPeripheral peripheral;
+  return peripheral;
+}
+
+}  // namespace mock
+
+class BLECharacteristic {
+ public:
+  BLECharacteristic() {}
+
+  BLECharacteristic(const char *uuid, uint16_t properties, int valueSize, bool isFixedLength = false) : _local(new mock::BLELocalCharacteristic()) {
+    _local->uuid = mock::upperCase(uuid);
+    _local->properties = properties;
+    _local->valueSize = valueSize;
+    _local->isFixedLength = isFixedLength;
+    if (isFixedLength) _local->value.resize(valueSize);
+    mock::blePeripheral().characteristics[_local->uuid] = _local;
+  }
+
+  BLECharacteristic(const char *uuid, uint16_t properties, const char *value) : BLECharacteristic(uuid, properties, strlen(value), true) {
+    writeValue(value);
+  }
+
+  virtual ~BLECharacteristic() {}
+
+  const char *uuid() const { return _local ? _local->uuid.c_str() : ""; }
+  uint16_t properties() const { return _local ? _local->properties : 0; }
+  int valueSize() const { return _local ? _local->valueSize : 0; }
+  const uint8_t *value() const { return _local ? _local->value.data() : nullptr; }
+  int valueLength() const { return _local ? _local->value.size() : 0; }
+  uint8_t operator[](int offset) const { return offset < valueLength() ? _local->value[offset] : 0; }
+
+  int readValue(uint8_t *value, int length) {
+    length = min(length, valueLength());
+    memcpy(value, _local->value.data(), length);
+    return length;
+  }
+
+  // Like ArduinoBLE, a value longer than the characteristic is truncated
+  // and a notification carries at most MTU - 3 bytes.
+  int writeValue(const uint8_t value[], int length, bool isWithResponse = true);
+  int writeValue(const char *value, bool isWithResponse = true) { return writeValue((const uint8_t *)value, strlen(value), isWithResponse); }
+  int setValue(const uint8_t value[], int length) { return writeValue(value, length); }
+  int setValue(const char *value) { return writeValue(value); }
+
+  bool written() {
+    bool isWritten = _local && _local->isWritten;
+    if (_local) _local->isWritten = false;
+    return isWritten;
+  }
+
+  bool subscribed() { return _local && _local->isSubscribed; }
+  bool canNotify() { return subscribed(); }
+  int broadcast() { return 1; }
+
+  void setEventHandler(int event, BLECharacteristicEventHandler handler) {
+    if (_local && event < BLECharacteristicEventLast) _local->handlers[event] = handler;
+  }
+
+  operator bool() const { return _local != nullptr; }
+
+  mock::BLELocalCharacteristic *local() const { return _local; }
+
+ private:
+  friend class BLELocalDevice;
+  explicit BLECharacteristic(mock::BLELocalCharacteristic *local) : _local(local) {}
+
+  mock::BLELocalCharacteristic *_local = nullptr;
+};
+
+template <typename T>
+class BLETypedCharacteristic : public BLECharacteristic {
+ public:
+  BLETypedCharacteristic(const char *uuid, unsigned int properties) : BLECharacteristic(uuid, properties, sizeof(T), true) {}
+
+  int writeValue(T value) { return BLECharacteristic::writeValue((const uint8_t *)&value, sizeof(T)); }
+  int setValue(T value) { return writeValue(value); }
+
+  T value() {
+    T value = T();
+    memcpy(&value, BLECharacteristic::value(), min((int)sizeof(T), valueLength()));
+    return value;
+  }
+};
+
+typedef BLETypedCharacteristic<bool> BLEBoolCharacteristic;
+typedef BLETypedCharacteristic<bool> BLEBooleanCharacteristic;
+typedef BLETypedCharacteristic<char> BLECharCharacteristic;
+typedef BLETypedCharacteristic<unsigned char> BLEUnsignedCharCharacteristic;
+typedef BLETypedCharacteristic<byte> BLEByteCharacteristic;
+typedef BLETypedCharacteristic<short> BLEShortCharacteristic;
+typedef BLETypedCharacteristic<unsigned short> BLEUnsignedShortCharacteristic;
+typedef BLETypedCharacteristic<unsigned short> BLEWordCharacteristic;
+typedef BLETypedCharacteristic<int> BLEIntCharacteristic;
+typedef BLETypedCharacteristic<unsigned int> BLEUnsignedIntCharacteristic;
+typedef BLETypedCharacteristic<long> BLELongCharacteristic;
+typedef BLETypedCharacteristic<unsigned long> BLEUnsignedLongCharacteristic;
+typedef BLETypedCharacteristic<float> BLEFloatCharacteristic;
+typedef BLETypedCharacteristic<double> BLEDoubleCharacteristic;
+
+class BLEStringCharacteristic : public BLECharacteristic {
+ public:
+  BLEStringCharacteristic(const char *uuid, uint16_t properties, int valueSize) : BLECharacteristic(uuid, properties, valueSize) {}
+
+  int writeValue(const String &value) { return BLECharacteristic::writeValue((const uint8_t *)value.c_str(), value.length()); }
+  int setValue(const String &value) { return writeValue(value); }
+  String value() const { return String(std::string((const char *)BLECharacteristic::value(), valueLength())); }
+};
+
+class BLEService {
+ public:
+  BLEService() {}
+  BLEService(const char *uuid) : _uuid(mock::upperCase(uuid)) {}
+
+  const char *uuid() const { return _uuid.c_str(); }
+  void addCharacteristic(BLECharacteristic &characteristic) {}
+
+ private:
+  std::string _uuid;
+};
+
+class BLELocalDevice {
+ public:
+  int begin() {
+    mock::blePeripheral().isBegun = true;
+    return 1;
+  }
+
+  void end() { mock::blePeripheral().isBegun = false; }
+
+  // Handles every central operation queued since the last poll
+  void poll();
+  void poll(unsigned long timeout) { poll(); }
+
+  bool connected() const { return mock::blePeripheral().isConnected; }
+  bool disconnect() { return false; }
+  String address() const { return "a1:b2:c3:d4:e5:f8"; }
+  int rssi() { return -50; }
+
+  bool setManufacturerData(const uint8_t manufacturerData[], int manufacturerDataLength) {
+    std::lock_guard<std::mutex> lock(mock::blePeripheral().mutex);
+    mock::blePeripheral().advertisement.manufacturerData.assign(manufacturerData, manufacturerData + manufacturerDataLength);
+    return true;
+  }
+
+  bool setManufacturerData(const uint16_t companyId, const uint8_t manufacturerData[], int manufacturerDataLength) {
+    mock::blePeripheral().advertisement.companyId = companyId;
+    return setManufacturerData(manufacturerData, manufacturerDataLength);
+  }
+
+  bool setLocalName(const char *localName) {
+    std::lock_guard<std::mutex> lock(mock::blePeripheral().mutex);
+    mock::blePeripheral().advertisement.localName = localName;
+    return true;
+  }
+
+  bool setAdvertisedService(const BLEService &service) {
+    std::lock_guard<std::mutex> lock(mock::blePeripheral().mutex);
+    mock::blePeripheral().advertisement.advertisedService = service.uuid();
+    return true;
+  }
+
+  void setDeviceName(const char *deviceName) {}
+  void setAppearance(uint16_t appearance) {}
+  void setConnectable(bool isConnectable) {}
+  void setAdvertisingInterval(uint16_t advertisingInterval) {}
+  void setConnectionInterval(uint16_t minimumConnectionInterval, uint16_t maximumConnectionInterval) {}
+
+  void addService(BLEService &service) { mock::blePeripheral().services.push_back(service.uuid()); }
+
+  int advertise() {
+    std::lock_guard<std::mutex> lock(mock::blePeripheral().mutex);
+    mock::blePeripheral().advertisement.count++;
+    return 1;
+  }
+
+  void stopAdvertise() {}
+
+  BLEDevice central() {
+    mock::BLEPeripheral &peripheral = mock::blePeripheral();
+    return peripheral.isConnected ? BLEDevice(0, peripheral.address) : BLEDevice();
+  }
+
+  void setEventHandler(BLEDeviceEvent event, BLEDeviceEventHandler handler) {
+    if (event < BLEDeviceLastEvent) mock::blePeripheral().handlers[event] = handler;
+  }
+
+ private:
+  void handle(mock::BLEEvent &event);
+};
+
+inline BLELocalDevice BLE;
+
+inline bool BLEDevice::connected() const {
+  return _isValid && mock::blePeripheral().isConnected && memcmp(mock::blePeripheral().address, _address, 6) == 0;
+}
+
+inline bool BLEDevice::disconnect() {
+  return false;
+}
+
+inline int BLECharacteristic::writeValue(const uint8_t value[], int length, bool isWithResponse) {
+  if (!_local) return 0;
+
+  length = min(length, _local->valueSize);
+  _local->value.assign(value, value + length);
+
+  mock::BLEPeripheral &peripheral = mock::blePeripheral();
+  if (peripheral.isConnected && _local->isSubscribed) {
+    int notifyLength = min(length, peripheral.mtu - 3);
+
+    std::lock_guard<std::mutex> lock(peripheral.mutex);
+    peripheral.notifications.push_back({ _local->uuid, std::vector<uint8_t>(value, value + notifyLength), micros() });
+  }
+
+  return 1;
+}
+
+inline void BLELocalDevice::poll() {
+  mock::BLEPeripheral &peripheral = mock::blePeripheral();
+
+  std::deque<std::shared_ptr<mock::BLEEvent>> events;
+  {
+    std::lock_guard<std::mutex> lock(peripheral.mutex);
+    events.swap(peripheral.events);
+  }
+
+  for (auto &event : events) {
+    unsigned long startMicros = micros();
+    handle(*event);
+    unsigned long endMicros = micros();
+
+    std::lock_guard<std::mutex> lock(peripheral.mutex);
+    mock::BLEEventStats &stats = peripheral.stats;
+    stats.count++;
+    stats.worstWaitUs = max(stats.worstWaitUs, startMicros - event->queuedMicros);
+    stats.worstHandlerUs = max(stats.worstHandlerUs, endMicros - startMicros);
+    stats.totalWaitUs += startMicros - event->queuedMicros;
+    stats.totalHandlerUs += endMicros - startMicros;
+
+    event->isDone = true;
+    peripheral.eventDone.notify_all();
+  }
+}
+
+inline void BLELocalDevice::handle(mock::BLEEvent &event) {
+  mock::BLEPeripheral &peripheral = mock::blePeripheral();
+
+  if (event.type == mock::BLEEvent::CONNECT) {
+    if (peripheral.isConnected) return;
+
+    peripheral.isConnected = true;
+    memcpy(peripheral.address, event.address, 6);
+    peripheral.mtu = event.mtu;
+    event.isOk = true;
+    if (peripheral.handlers[BLEConnected]) peripheral.handlers[BLEConnected](BLEDevice(0, peripheral.address));
+    return;
+  }
+
+  if (!peripheral.isConnected) return;
+
+  if (event.type == mock::BLEEvent::DISCONNECT) {
+    for (auto &characteristic : peripheral.characteristics) characteristic.second->isSubscribed = false;
+    peripheral.isConnected = false;
+    event.isOk = true;
+    if (peripheral.handlers[BLEDisconnected]) peripheral.handlers[BLEDisconnected](BLEDevice(0, peripheral.address));
+    return;
+  }
+
+  mock::BLELocalCharacteristic *characteristic = peripheral.find(event.uuid);
+  if (characteristic == nullptr) return;
+
+  BLEDevice central(0, peripheral.address);
+  switch (event.type) {
+    case mock::BLEEvent::SUBSCRIBE:
+    case mock::BLEEvent::UNSUBSCRIBE: {
+      if (!(characteristic->properties & (BLENotify | BLEIndicate))) return;
+      bool isSubscribe = event.type == mock::BLEEvent::SUBSCRIBE;
+      characteristic->isSubscribed = isSubscribe;
+      event.isOk = true;
+
+      BLECharacteristicEventHandler handler = characteristic->handlers[isSubscribe ? BLESubscribed : BLEUnsubscribed];
+      if (handler) handler(central, BLECharacteristic(characteristic));
+      break;
+    }
+
+    case mock::BLEEvent::READ:
+      if (!(characteristic->properties & BLERead)) return;
+      event.value = characteristic->value;
+      event.isOk = true;
+      break;
+
+    case mock::BLEEvent::WRITE:
+      if (!(characteristic->properties & (BLEWrite | BLEWriteWithoutResponse))) return;
+      if ((int)event.value.size() > characteristic->valueSize || (int)event.value.size() > peripheral.mtu - 3) return;
+      if (characteristic->isFixedLength && (int)event.value.size() != characteristic->valueSize) return;
+
+      characteristic->value = event.value;
+      characteristic->isWritten = true;
+      event.isOk = true;
+      if (characteristic->handlers[BLEWritten]) characteristic->handlers[BLEWritten](central, BLECharacteristic(characteristic));
+      break;
+
+    default:
+      break;
+  }
+}
+
+namespace mock {
+
+// A phone, as far as the firmware can tell. Every call blocks until
+// BLE.poll() has handled it and fails after timeoutMs if nothing polls.
+class BLECentral {
+ public:
+  explicit BLECentral(uint16_t mtu = BLE_ATT_DEFAULT_MTU_MOCK, unsigned long timeoutMs = 1000) : _mtu(mtu), _timeoutMs(timeoutMs) {}
+
+  bool connect() {
+    auto event = makeEvent(BLEEvent::CONNECT, "");
+    return run(event);
+  }
+
+  bool disconnect() { return run(makeEvent(BLEEvent::DISCONNECT, "")); }
+  bool subscribe(const char *uuid) { return run(makeEvent(BLEEvent::SUBSCRIBE, uuid)); }
+  bool unsubscribe(const char *uuid) { return run(makeEvent(BLEEvent::UNSUBSCRIBE, uuid)); }
+
+  bool read(const char *uuid, std::vector<uint8_t> &value) {
+    auto event = makeEvent(BLEEvent::READ, uuid);
+    if (!run(event)) return false;
+    value = event->value;
+    return true;
+  }
+
+  template <typename T>
+  bool read(const char *uuid, T &value) {
+    std::vector<uint8_t> bytes;
+    if (!read(uuid, bytes) || bytes.size() != sizeof(T)) return false;
+    memcpy(&value, bytes.data(), sizeof(T));
+    return true;
+  }
+
+  bool write(const char *uuid, const void *value, size_t length) {
+    auto event = makeEvent(BLEEvent::WRITE, uuid);
+    event->value.assign((const uint8_t *)value, (const uint8_t *)value + length);
+    return run(event);
+  }
+
+  template <typename T>
+  bool write(const char *uuid, const T &value) {
+    return write(uuid, &value, sizeof(T));
+  }
+
+  uint16_t mtu() const { return _mtu; }
+
+ private:
+  std::shared_ptr<BLEEvent> makeEvent(BLEEvent::Type type, const char *uuid) {
+    auto event = std::make_shared<BLEEvent>();
+    event->type = type;
+    event->uuid = upperCase(uuid);
+    event->mtu = _mtu;
+    const uint8_t address[6] = { 0x01, 0x00, 0x00, 0x38, 0xc1, 0xa4 };
+    memcpy(event->address, address, 6);
+    return event;
+  }
+
+  bool run(std::shared_ptr<BLEEvent> event) {
+    BLEPeripheral &peripheral = blePeripheral();
+    std::unique_lock<std::mutex> lock(peripheral.mutex);
+
+    event->queuedMicros = micros();
+    peripheral.events.push_back(event);
+
+    if (!peripheral.eventDone.wait_for(lock, std::chrono::milliseconds(_timeoutMs), [&event] { return event->isDone; })) {
+      peripheral.events.erase(std::remove(peripheral.events.begin(), peripheral.events.end(), event), peripheral.events.end());
+      return false;
+    }
+    return event->isOk;
+  }
+
+  uint16_t _mtu;
+  unsigned long _timeoutMs;
+};
+
+// Notifications sent since the last clear, optionally for one characteristic
+inline std::vector<BLENotification> bleNotifications(const char *uuid = nullptr) {
+  BLEPeripheral &peripheral = blePeripheral();
+  std::lock_guard<std::mutex> lock(peripheral.mutex);
+
+  std::vector<BLENotification> notifications;
+  for (auto &notification : peripheral.notifications) {
+    if (uuid == nullptr || notification.uuid == upperCase(uuid)) notifications.push_back(notification);
+  }
+  return notifications;
+}
+
+inline void bleClearNotifications() {
+  std::lock_guard<std::mutex> lock(blePeripheral().mutex);
+  blePeripheral().notifications.clear();
+}
+
+inline BLEEventStats bleEventStats() {
+  std::lock_guard<std::mutex> lock(blePeripheral().mutex);
+  return blePeripheral().stats;
+}
+
+inline void bleResetEventStats() {
+  std::lock_guard<std::mutex> lock(blePeripheral().mutex);
+  blePeripheral().stats = BLEEventStats();
+}
+
+inline std::vector<BLEConnectionUpdate> bleConnectionUpdates() {
+  std::lock_guard<std::mutex> lock(blePeripheral().mutex);
+  return blePeripheral().connectionUpdates;
+}
+
+// Set to an HCI error code, such as 0x0C Command Disallowed, for
+// connection parameter requests to be refused until it is set back to 0
+inline void bleSetConnectionUpdateStatus(int status) {
+  std::lock_guard<std::mutex> lock(blePeripheral().mutex);
+  blePeripheral().connectionUpdateStatus = status;
+}
+
+inline BLEAdvertisement bleAdvertisement() {
+  std::lock_guard<std::mutex> lock(blePeripheral().mutex);
+  return blePeripheral().advertisement;
+}
+
+inline bool bleHasCharacteristic(const char *uuid, uint16_t properties) {
+  BLELocalCharacteristic *characteristic = blePeripheral().find(uuid);
+  return characteristic != nullptr && (characteristic->properties & properties) == properties;
+}
+
+}  // namespace mock
@@ -0,0 +1,56 @@
+// Native EEPROM emulation; counts commits so tests can check write batching,
+// and can hold each commit for commitDelayMs like a sector erase would.
+// Bytes never written read back as 0, as arduino-esp32's EEPROM.begin()
+// zero fills them.
+#pragma once
+
+#include <Arduino.h>
+
+#include <vector>
+
+class EEPROMClass {
+ public:
+  bool begin(size_t size) {
+    if (_data.size() < size) _data.resize(size, 0);
+    return true;
+  }
+
+  uint8_t read(int address) { return address < (int)_data.size() ? _data[address] : 0; }
+
+  void write(int address, uint8_t value) {
+    if (address < (int)_data.size()) _data[address] = value;
+  }
+
+  bool commit() {
+    commits++;
+    if (commitDelayMs > 0) delay(commitDelayMs);
+    return true;
+  }
+
+  uint16_t length() { return _data.size(); }
+  uint8_t *getDataPtr() { return _data.data(); }
+
+  template <typename T>
+  T &get(int address, T &value) {
+    if (address + sizeof(T) <= _data.size()) {
+      memcpy((uint8_t *)&value, _data.data() + address, sizeof(T));
+    } else {
+      memset((uint8_t *)&value, 0, sizeof(T));
+    }
+    return value;
+  }
+
+  template <typename T>
+  const T &put(int address, const T &value) {
+    if (address + sizeof(T) <= _data.size()) memcpy(_data.data() + address, (const uint8_t *)&value, sizeof(T));
+    return value;
+  }
+
+  std::atomic<uint32_t> commits{ 0 };
+  std::atomic<uint32_t> commitDelayMs{ 0 };
+
+ private:
+  std::vector<uint8_t> _data;
+};
+
+inline EEPROMClass EEPROM;
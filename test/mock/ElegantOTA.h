@@ -0,0 +1,10 @@
+#pragma once
+
+#include <WebServer.h>
+
+class ElegantOtaClass {
+ public:
+  void begin(WebServer *server, const char *username = "", const char *password = "") {}
+};
+
+inline ElegantOtaClass ElegantOTA;
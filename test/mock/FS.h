@@ -0,0 +1,269 @@
+// In-memory file system behind the Arduino fs::FS interface. Files are
+// shared between handles like LittleFS, and one lock serialises all access
+// so the loop and the BLE task can hold the same file open.
+//
+// With a backing directory set every change is also written through to real
+// files under it, so benchmarks pay for actual file I/O and a remount picks
+// up what an earlier run left behind.
+#pragma once
+
+#include <Arduino.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace fs {
+
+enum SeekMode { SeekSet = 0, SeekCur = 1, SeekEnd = 2 };
+
+struct FileSystemStats {
+  uint64_t bytesWritten = 0;
+  uint64_t bytesRead = 0;
+  uint32_t opens = 0;
+};
+
+struct FileSystemState {
+  std::recursive_mutex mutex;
+  std::map<std::string, std::shared_ptr<std::vector<uint8_t>>> files;
+  std::string backingDirectory;  // empty when purely in memory
+  FileSystemStats stats;
+
+  std::string backingPath(const std::string &path) { return backingDirectory + path; }
+
+  // Creates the parent directories of a backing file
+  void makeBackingParents(const std::string &path) {
+    std::string backing = backingPath(path);
+    for (size_t slash = backing.find('/', backingDirectory.size() + 1); slash != std::string::npos; slash = backing.find('/', slash + 1)) {
+      ::mkdir(backing.substr(0, slash).c_str(), 0755);
+    }
+  }
+};
+
+struct FileImpl {
+  FileSystemState *state = nullptr;
+  std::string path;
+  std::shared_ptr<std::vector<uint8_t>> data;  // null for a directory
+  std::vector<std::string> entries;            // directory listing
+  size_t entryIndex = 0;
+  size_t position = 0;
+  bool isReadable = false;
+  bool isWritable = false;
+  bool isAppend = false;
+  int backingFd = -1;
+
+  ~FileImpl() {
+    if (backingFd >= 0) ::close(backingFd);
+  }
+};
+
+class File : public Stream {
+ public:
+  File() {}
+  explicit File(std::shared_ptr<FileImpl> impl) : _impl(impl) {}
+
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t *buffer, size_t size) override {
+    if (!_impl || !_impl->data || !_impl->isWritable) return 0;
+    std::lock_guard<std::recursive_mutex> lock(_impl->state->mutex);
+
+    std::vector<uint8_t> &data = *_impl->data;
+    if (_impl->isAppend) _impl->position = data.size();
+    if (data.size() < _impl->position + size) data.resize(_impl->position + size);
+    memcpy(data.data() + _impl->position, buffer, size);
+    _impl->state->stats.bytesWritten += size;
+
+    if (_impl->backingFd >= 0 && ::pwrite(_impl->backingFd, buffer, size, _impl->position) != (ssize_t)size) return 0;
+
+    _impl->position += size;
+    return size;
+  }
+  using Print::write;
+
+  int available() override {
+    if (!_impl || !_impl->data) return 0;
+    std::lock_guard<std::recursive_mutex> lock(_impl->state->mutex);
+    return _impl->data->size() > _impl->position ? _impl->data->size() - _impl->position : 0;
+  }
+
+  int read() override {
+    uint8_t c;
+    return read(&c, 1) == 1 ? c : -1;
+  }
+
+  size_t read(uint8_t *buffer, size_t size) {
+    if (!_impl || !_impl->data || !_impl->isReadable) return 0;
+    std::lock_guard<std::recursive_mutex> lock(_impl->state->mutex);
+
+    std::vector<uint8_t> &data = *_impl->data;
+    if (_impl->position >= data.size()) return 0;
+    size = min(size, data.size() - _impl->position);
+    memcpy(buffer, data.data() + _impl->position, size);
+    _impl->state->stats.bytesRead += size;
+    _impl->position += size;
+    return size;
+  }
+
+  int peek() override {
+    if (!_impl || !_impl->data) return -1;
+    std::lock_guard<std::recursive_mutex> lock(_impl->state->mutex);
+    return _impl->position < _impl->data->size() ? (*_impl->data)[_impl->position] : -1;
+  }
+
+  void flush() {}
+
+  bool seek(uint32_t position, SeekMode mode = SeekSet) {
+    if (!_impl || !_impl->data) return false;
+    std::lock_guard<std::recursive_mutex> lock(_impl->state->mutex);
+
+    size_t base = mode == SeekSet ? 0 : (mode == SeekCur ? _impl->position : _impl->data->size());
+    if (base + position > _impl->data->size()) return false;
+    _impl->position = base + position;
+    return true;
+  }
+
+  size_t position() const { return _impl ? _impl->position : 0; }
+
+  size_t size() const {
+    if (!_impl || !_impl->data) return 0;
+    std::lock_guard<std::recursive_mutex> lock(_impl->state->mutex);
+    return _impl->data->size();
+  }
+
+  void close() { _impl.reset(); }
+  operator bool() const { return (bool)_impl; }
+
+  const char *path() const { return _impl ? _impl->path.c_str() : ""; }
+  const char *name() const {
+    if (!_impl) return "";
+    size_t slash = _impl->path.rfind('/');
+    return _impl->path.c_str() + (slash == std::string::npos ? 0 : slash + 1);
+  }
+
+  bool isDirectory() { return _impl && !_impl->data; }
+
+  File openNextFile(const char *mode = "r");
+
+  void rewindDirectory() {
+    if (_impl) _impl->entryIndex = 0;
+  }
+
+ private:
+  std::shared_ptr<FileImpl> _impl;
+};
+
+class FS {
+ public:
+  File open(const char *path, const char *mode = "r", const bool create = false) {
+    std::lock_guard<std::recursive_mutex> lock(_state.mutex);
+
+    std::shared_ptr<FileImpl> impl = std::make_shared<FileImpl>();
+    impl->state = &_state;
+    impl->path = path;
+
+    auto file = _state.files.find(path);
+    if (mode[0] == 'r' && file == _state.files.end()) {
+      // A path that prefixes existing files opens as a directory
+      std::string prefix = impl->path == "/" ? "/" : impl->path + "/";
+      for (auto &entry : _state.files) {
+        if (entry.first.compare(0, prefix.size(), prefix) != 0) continue;
+        std::string child = entry.first.substr(0, entry.first.find('/', prefix.size()));
+        if (impl->entries.empty() || impl->entries.back() != child) impl->entries.push_back(child);
+      }
+      return impl->entries.empty() ? File() : File(impl);
+    }
+
+    bool isCreated = mode[0] == 'w' || file == _state.files.end();
+    if (isCreated) {
+      _state.files[path] = std::make_shared<std::vector<uint8_t>>();
+      file = _state.files.find(path);
+    }
+
+    impl->data = file->second;
+    impl->isReadable = mode[0] == 'r' || strchr(mode, '+') != NULL;
+    impl->isWritable = mode[0] != 'r' || strchr(mode, '+') != NULL;
+    impl->isAppend = mode[0] == 'a';
+    impl->position = impl->isAppend ? impl->data->size() : 0;
+    _state.stats.opens++;
+
+    if (!_state.backingDirectory.empty() && impl->isWritable) {
+      _state.makeBackingParents(path);
+      impl->backingFd = ::open(_state.backingPath(path).c_str(), O_WRONLY | O_CREAT | (isCreated ? O_TRUNC : 0), 0644);
+    }
+    return File(impl);
+  }
+  File open(const String &path, const char *mode = "r", const bool create = false) { return open(path.c_str(), mode, create); }
+
+  bool exists(const char *path) {
+    std::lock_guard<std::recursive_mutex> lock(_state.mutex);
+    return _state.files.count(path) > 0 || (bool)open(path, "r");
+  }
+  bool exists(const String &path) { return exists(path.c_str()); }
+
+  bool remove(const char *path) {
+    std::lock_guard<std::recursive_mutex> lock(_state.mutex);
+    if (!_state.backingDirectory.empty()) ::unlink(_state.backingPath(path).c_str());
+    return _state.files.erase(path) > 0;
+  }
+  bool remove(const String &path) { return remove(path.c_str()); }
+
+  bool rename(const char *from, const char *to) {
+    std::lock_guard<std::recursive_mutex> lock(_state.mutex);
+    auto file = _state.files.find(from);
+    if (file == _state.files.end()) return false;
+    _state.files[to] = file->second;
+    _state.files.erase(from);
+
+    if (!_state.backingDirectory.empty()) {
+      _state.makeBackingParents(to);
+      ::rename(_state.backingPath(from).c_str(), _state.backingPath(to).c_str());
+    }
+    return true;
+  }
+  bool rename(const String &from, const String &to) { return rename(from.c_str(), to.c_str()); }
+
+  // Directories only exist through the files in them
+  bool mkdir(const char *path) { return true; }
+  bool mkdir(const String &path) { return true; }
+  bool rmdir(const char *path) { return true; }
+  bool rmdir(const String &path) { return true; }
+
+  size_t usedBytes() {
+    std::lock_guard<std::recursive_mutex> lock(_state.mutex);
+    size_t used = 0;
+    for (auto &file : _state.files) used += file.second->size();
+    return used;
+  }
+
+ protected:
+  FileSystemState _state;
+};
+
+inline File File::openNextFile(const char *mode) {
+  if (!_impl || _impl->data || _impl->entryIndex >= _impl->entries.size()) return File();
+  std::lock_guard<std::recursive_mutex> lock(_impl->state->mutex);
+
+  const std::string &path = _impl->entries[_impl->entryIndex++];
+  auto file = _impl->state->files.find(path);
+
+  std::shared_ptr<FileImpl> impl = std::make_shared<FileImpl>();
+  impl->state = _impl->state;
+  impl->path = path;
+  if (file != _impl->state->files.end()) {
+    impl->data = file->second;
+    impl->isReadable = true;
+  }
+  return File(impl);
+}
+
+}  // namespace fs
+
+using fs::File;
+using fs::FS;
+using fs::SeekCur;
+using fs::SeekEnd;
+using fs::SeekSet;
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <Arduino.h>
+
+class IPAddress : public Printable {
+ public:
+  IPAddress() {}
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : _octets{ a, b, c, d } {}
+
+  uint8_t operator[](int index) const { return _octets[index]; }
+
+  String toString() const {
+    char buffer[16];
+    snprintf(buffer, sizeof(buffer), "%u.%u.%u.%u", _octets[0], _octets[1], _octets[2], _octets[3]);
+    return String(buffer);
+  }
+
+  size_t printTo(Print &p) const override { return p.print(toString()); }
+
+ private:
+  uint8_t _octets[4] = {};
+};
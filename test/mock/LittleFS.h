@@ -0,0 +1,64 @@
+// LittleFS backed by the in-memory file system in FS.h
+#pragma once
+
+#include <FS.h>
+#include <ftw.h>
+
+class LittleFSFS : public fs::FS {
+ public:
+  bool begin(bool formatOnFail = false, const char *basePath = "/littlefs", uint8_t maxOpenFiles = 10, const char *partitionLabel = "spiffs") { return true; }
+
+  bool format() {
+    std::lock_guard<std::recursive_mutex> lock(_state.mutex);
+    for (auto &file : _state.files) {
+      if (!_state.backingDirectory.empty()) ::unlink(_state.backingPath(file.first).c_str());
+    }
+    _state.files.clear();
+    return true;
+  }
+
+  size_t totalBytes() { return 1408 * 1024; }
+  void end() {}
+
+  // Writes through to files under directory from now on, after loading what
+  // is already there, as a mount of a flash partition would
+  void mountDirectory(const char *directory) {
+    std::lock_guard<std::recursive_mutex> lock(_state.mutex);
+    _state.files.clear();
+    _state.backingDirectory = directory;
+    ::mkdir(directory, 0755);
+
+    _loading = &_state;
+    nftw(directory, loadBackingFile, 8, FTW_PHYS);
+    _loading = nullptr;
+  }
+
+  fs::FileSystemStats stats() {
+    std::lock_guard<std::recursive_mutex> lock(_state.mutex);
+    return _state.stats;
+  }
+
+  void resetStats() {
+    std::lock_guard<std::recursive_mutex> lock(_state.mutex);
+    _state.stats = fs::FileSystemStats();
+  }
+
+ private:
+  static inline fs::FileSystemState *_loading = nullptr;
+
+  static int loadBackingFile(const char *backing, const struct stat *status, int type, struct FTW *ftw) {
+    if (type != FTW_F) return 0;
+
+    std::shared_ptr<std::vector<uint8_t>> data = std::make_shared<std::vector<uint8_t>>(status->st_size);
+    int fd = ::open(backing, O_RDONLY);
+    if (fd < 0) return 0;
+    ssize_t length = ::read(fd, data->data(), data->size());
+    ::close(fd);
+    data->resize(length < 0 ? 0 : length);
+
+    _loading->files[std::string(backing + _loading->backingDirectory.size())] = data;
+    return 0;
+  }
+};
+
+inline LittleFSFS LittleFS;
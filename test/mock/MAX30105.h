@@ -0,0 +1,161 @@
+// Native model of the MAX30105 particle sensor. The IR and Red levels are set
+// by the test; samples enter the 32 slot FIFO at the configured rate so raw
+// reads of the FIFO registers behave like the chip, including overflow. Each
+// sample holds 3 bytes per LED of the LED mode: Red, then IR, then Green.
+#pragma once
+
+#include <Arduino.h>
+#include <Wire.h>
+
+#include <array>
+#include <deque>
+#include <mutex>
+
+#define I2C_SPEED_STANDARD 100000
+#define I2C_SPEED_FAST 400000
+#define MAX30105_ADDRESS 0x57
+
+namespace mock {
+
+class ParticleSensor : public I2CDevice {
+ public:
+  std::atomic<uint32_t> irLevel{ 30000 };
+  std::atomic<uint32_t> redLevel{ 1000 };
+
+  void configure(int samplesPerSecond, int ledMode) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _samplesPerSecond = samplesPerSecond;
+    _channels = constrain(ledMode, 1, 3);
+    _fifo.clear();
+    _sampleByte = 0;
+    _overflow = 0;
+    _readPointer = 0;
+    _filledMicros = micros();
+  }
+
+  void readRegister(uint8_t reg, uint8_t *data, size_t length) override {
+    std::lock_guard<std::mutex> lock(_mutex);
+    fill();
+
+    for (size_t i = 0; i < length; i++) {
+      switch (reg) {
+        case 0x04:  // FIFO write pointer
+          data[i] = (_readPointer + _fifo.size()) % FIFO_DEPTH;
+          break;
+        case 0x05:  // overflow counter
+          data[i] = _overflow;
+          break;
+        case 0x06:  // FIFO read pointer
+          data[i] = _readPointer;
+          break;
+        case 0x07:  // FIFO data, 3 bytes per LED per sample, does not auto-increment
+          data[i] = fifoByte();
+          continue;
+        case 0xff:  // part ID
+          data[i] = 0x15;
+          break;
+        default:
+          data[i] = 0;
+      }
+      reg++;
+    }
+  }
+
+ private:
+  static const size_t FIFO_DEPTH = 32;
+
+  void fill() {
+    if (_samplesPerSecond <= 0) return;
+
+    unsigned long now = micros();
+    unsigned long period = 1000000UL / _samplesPerSecond;
+    while (now - _filledMicros >= period) {
+      _filledMicros += period;
+      if (_fifo.size() == FIFO_DEPTH) {
+        _fifo.pop_front();
+        _readPointer = (_readPointer + 1) % FIFO_DEPTH;
+        if (_overflow < 0x1f) _overflow++;
+      }
+      _fifo.push_back({ redLevel & 0x3ffff, irLevel & 0x3ffff, 0 });
+    }
+  }
+
+  uint8_t fifoByte() {
+    if (_fifo.empty()) return 0;
+
+    uint32_t channel = _fifo.front()[_sampleByte / 3];
+    uint8_t value = channel >> (16 - 8 * (_sampleByte % 3));
+    if (++_sampleByte == 3 * _channels) {
+      _sampleByte = 0;
+      _fifo.pop_front();
+      _readPointer = (_readPointer + 1) % FIFO_DEPTH;
+      _overflow = 0;
+    }
+    return value;
+  }
+
+  std::mutex _mutex;
+  int _samplesPerSecond = 0;
+  int _channels = 1;
+  std::deque<std::array<uint32_t, 3>> _fifo;
+  uint8_t _overflow = 0;
+  uint8_t _readPointer = 0;
+  int _sampleByte = 0;
+  unsigned long _filledMicros = 0;
+};
+
+inline ParticleSensor &particleSensor() {
+  static ParticleSensor sensor;
+  return sensor;
+}
+
+}  // namespace mock
+
+class MAX30105 {
+ public:
+  bool begin(TwoWire &wirePort = Wire, uint32_t i2cSpeed = I2C_SPEED_STANDARD, uint8_t i2caddr = MAX30105_ADDRESS) {
+    mock::i2cDevice(i2caddr) = &mock::particleSensor();
+    return true;
+  }
+
+  void setup(byte powerLevel = 0x1f, byte sampleAverage = 4, byte ledMode = 3, int sampleRate = 400, int pulseWidth = 411, int adcRange = 4096) {
+    mock::particleSensor().configure(sampleRate / max(1, (int)sampleAverage), ledMode);
+  }
+
+  uint32_t getIR() { return mock::particleSensor().irLevel; }
+  uint32_t getRed() { return mock::particleSensor().redLevel; }
+  uint32_t getGreen() { return 0; }
+  uint8_t readPartID() { return 0x15; }
+
+  void softReset() {}
+  void shutDown() {}
+  void wakeUp() {}
+  void setLEDMode(uint8_t mode) {}
+  void setADCRange(uint8_t adcRange) {}
+  void setSampleRate(uint8_t sampleRate) {}
+  void setPulseWidth(uint8_t pulseWidth) {}
+  void setPulseAmplitudeRed(uint8_t value) {}
+  void setPulseAmplitudeIR(uint8_t value) {}
+  void setPulseAmplitudeGreen(uint8_t value) {}
+  void setPulseAmplitudeProximity(uint8_t value) {}
+  void enableSlot(uint8_t slotNumber, uint8_t device) {}
+  void disableSlots() {}
+  void setFIFOAverage(uint8_t samples) {}
+  void enableFIFORollover() {}
+  void clearFIFO() {}
+
+  uint8_t readRegister8(uint8_t address, uint8_t reg) {
+    Wire.beginTransmission(address);
+    Wire.write(reg);
+    Wire.endTransmission(false);
+    Wire.requestFrom(address, 1);
+    return Wire.read();
+  }
+
+  void writeRegister8(uint8_t address, uint8_t reg, uint8_t value) {
+    Wire.beginTransmission(address);
+    Wire.write(reg);
+    Wire.write(value);
+    Wire.endTransmission();
+  }
+};
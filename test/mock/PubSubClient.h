@@ -0,0 +1,101 @@
+// MQTT client without a broker. Tests set mock::mqttBrokerOnline() to let
+// connect() succeed, and read what was published from mock::mqttMessages().
+// Taking the broker offline drops the connection, as a lost network would.
+#pragma once
+
+#include <Arduino.h>
+#include <WiFiClient.h>
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+#define MQTT_CONNECTION_TIMEOUT -4
+#define MQTT_CONNECTION_LOST -3
+#define MQTT_CONNECT_FAILED -2
+#define MQTT_DISCONNECTED -1
+#define MQTT_CONNECTED 0
+
+namespace mock {
+
+struct MqttMessage {
+  std::string topic;
+  std::string payload;
+};
+
+inline std::atomic<bool> &mqttBrokerOnline() {
+  static std::atomic<bool> isOnline{ false };
+  return isOnline;
+}
+
+inline std::mutex &mqttMutex() {
+  static std::mutex mutex;
+  return mutex;
+}
+
+// Guarded by mqttMutex()
+inline std::vector<MqttMessage> &mqttMessages() {
+  static std::vector<MqttMessage> messages;
+  return messages;
+}
+
+}  // namespace mock
+
+class PubSubClient {
+ public:
+  explicit PubSubClient(WiFiClient &client) {}
+
+  PubSubClient &setServer(const char *domain, uint16_t port) { return *this; }
+  PubSubClient &setKeepAlive(uint16_t keepAlive) { return *this; }
+  PubSubClient &setSocketTimeout(uint16_t timeout) { return *this; }
+  bool setBufferSize(uint16_t size) { return true; }
+
+  bool connect(const char *id) {
+    _isConnected = mock::mqttBrokerOnline().load();
+    _state = _isConnected ? MQTT_CONNECTED : MQTT_CONNECT_FAILED;
+    return _isConnected;
+  }
+  void disconnect() {
+    _isConnected = false;
+    _state = MQTT_DISCONNECTED;
+  }
+  bool connected() {
+    if (_isConnected && !mock::mqttBrokerOnline()) {
+      _isConnected = false;
+      _state = MQTT_CONNECTION_LOST;
+    }
+    return _isConnected;
+  }
+  bool loop() { return connected(); }
+  int state() { return _state; }
+
+  bool publish(const char *topic, const uint8_t *payload, unsigned int length, bool retained = false) {
+    if (!beginPublish(topic, length, retained)) return false;
+    write(payload, length);
+    return endPublish();
+  }
+  bool publish(const char *topic, const char *payload) { return publish(topic, (const uint8_t *)payload, strlen(payload)); }
+
+  bool beginPublish(const char *topic, unsigned int length, bool retained) {
+    if (!connected()) return false;
+    _topic = topic;
+    _payload.clear();
+    return true;
+  }
+  size_t write(const uint8_t *buffer, size_t size) {
+    _payload.append((const char *)buffer, size);
+    return size;
+  }
+  int endPublish() {
+    if (!connected()) return 0;
+    std::lock_guard<std::mutex> lock(mock::mqttMutex());
+    mock::mqttMessages().push_back({ _topic, _payload });
+    return 1;
+  }
+
+ private:
+  bool _isConnected = false;
+  int _state = MQTT_DISCONNECTED;
+  std::string _topic;
+  std::string _payload;
+};
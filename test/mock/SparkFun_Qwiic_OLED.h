@@ -0,0 +1,61 @@
+// Native stand-in for the Qwiic OLED; keeps the text drawn since the last
+// erase so tests can see what the screen shows.
+#pragma once
+
+#include <Arduino.h>
+#include <Wire.h>
+
+#include <mutex>
+
+struct QwiicFont {
+  int width;
+  int height;
+};
+
+inline QwiicFont QW_FONT_5X7 = { 5, 7 };
+inline QwiicFont QW_FONT_8X16 = { 8, 16 };
+inline QwiicFont QW_FONT_7SEGMENT = { 10, 16 };
+inline QwiicFont QW_FONT_31X48 = { 31, 48 };
+
+class QwiicMicroOLED : public Print {
+ public:
+  bool begin(TwoWire &wirePort = Wire, uint8_t address = 0x3d) { return true; }
+
+  void erase() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _drawing.clear();
+  }
+
+  void display() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _screen = _drawing;
+  }
+
+  void setCursor(uint8_t x, uint8_t y) {}
+  void setFont(QwiicFont &font) {}
+  void setFont(const QwiicFont *font) {}
+  void rectangleFill(uint8_t x, uint8_t y, uint8_t width, uint8_t height, uint8_t color = 1) {}
+  void line(uint8_t x0, uint8_t y0, uint8_t x1, uint8_t y1, uint8_t color = 1) {}
+  uint8_t getWidth() { return 64; }
+  uint8_t getHeight() { return 48; }
+  uint8_t getStringWidth(const String &text) { return text.length() * 8; }
+
+  size_t write(uint8_t c) override {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _drawing += (char)c;
+    return 1;
+  }
+  using Print::write;
+
+  std::string screen() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _screen;
+  }
+
+ private:
+  std::mutex _mutex;
+  std::string _drawing;
+  std::string _screen;
+};
+
+typedef QwiicMicroOLED QwiicCustomOLED;
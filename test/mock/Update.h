@@ -0,0 +1,77 @@
+// Firmware update state. Written images are kept in mock::updateImage(), and
+// tests set mock::updateRunning() to pretend an image is being flashed.
+#pragma once
+
+#include <Arduino.h>
+
+#include <functional>
+#include <vector>
+
+#define UPDATE_SIZE_UNKNOWN 0xFFFFFFFF
+#define U_FLASH 0
+
+namespace mock {
+
+inline std::atomic<bool> &updateRunning() {
+  static std::atomic<bool> isRunning{ false };
+  return isRunning;
+}
+
+// The last image passed to Update.end(), empty when it was aborted
+inline std::vector<uint8_t> &updateImage() {
+  static std::vector<uint8_t> image;
+  return image;
+}
+
+}  // namespace mock
+
+class UpdateClass {
+ public:
+  typedef std::function<void(size_t, size_t)> THandlerFunction_Progress;
+
+  UpdateClass &onProgress(THandlerFunction_Progress fn) {
+    _onProgress = fn;
+    return *this;
+  }
+
+  bool begin(size_t size = UPDATE_SIZE_UNKNOWN, int command = U_FLASH, int ledPin = -1, uint8_t ledOn = LOW, const char *label = NULL) {
+    _image.clear();
+    _size = size;
+    _isRunning = true;
+    return true;
+  }
+
+  size_t write(uint8_t *data, size_t len) {
+    if (!_isRunning) return 0;
+    _image.insert(_image.end(), data, data + len);
+    if (_onProgress) _onProgress(_image.size(), _size);
+    return len;
+  }
+
+  bool end(bool evenIfRemaining = false) {
+    if (!_isRunning) return false;
+    _isRunning = false;
+    mock::updateImage() = _image;
+    return true;
+  }
+
+  void abort() {
+    _isRunning = false;
+    mock::updateImage().clear();
+  }
+
+  bool isRunning() { return _isRunning || mock::updateRunning(); }
+  bool hasError() { return false; }
+  uint8_t getError() { return 0; }
+  const char *errorString() { return "No Error"; }
+  size_t progress() { return _image.size(); }
+  size_t size() { return _size; }
+
+ private:
+  THandlerFunction_Progress _onProgress;
+  std::vector<uint8_t> _image;
+  size_t _size = 0;
+  std::atomic<bool> _isRunning{ false };
+};
+
+inline UpdateClass Update;
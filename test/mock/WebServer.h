@@ -0,0 +1,246 @@
+// Records the registered routes. No HTTP traffic reaches it on the host, but
+// request(), post() and upload() run a route's handlers from handleClient(), on the
+// thread that serves the web, as a browser's request would. Responses are
+// written to the browser's socket the way the ESP32 WebServer writes them,
+// chunked when the content length is unknown.
+#pragma once
+
+#include <Arduino.h>
+#include <WiFi.h>
+
+#include <functional>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#define CONTENT_LENGTH_UNKNOWN ((size_t)-1)
+#define CONTENT_LENGTH_NOT_SET ((size_t)-2)
+#define HTTP_UPLOAD_BUFLEN 1436
+
+enum HTTPMethod { HTTP_ANY, HTTP_GET, HTTP_HEAD, HTTP_POST, HTTP_PUT, HTTP_PATCH, HTTP_DELETE, HTTP_OPTIONS };
+enum HTTPUploadStatus { UPLOAD_FILE_START, UPLOAD_FILE_WRITE, UPLOAD_FILE_END, UPLOAD_FILE_ABORTED };
+
+struct HTTPUpload {
+  HTTPUploadStatus status;
+  String filename;
+  String name;
+  String type;
+  size_t totalSize;
+  size_t currentSize;
+  uint8_t buf[HTTP_UPLOAD_BUFLEN];
+};
+
+class WebServer {
+ public:
+  typedef std::function<void(void)> THandlerFunction;
+  typedef std::map<std::string, std::string> Fields;
+
+  struct Route {
+    String uri;
+    HTTPMethod method;
+    THandlerFunction handler;
+    THandlerFunction uploadHandler;
+  };
+
+  WebServer(int port = 80) {}
+
+  void begin() {}
+  void stop() {}
+  void close() { stop(); }
+  void handleClient() {
+    std::lock_guard<std::mutex> lock(_requestMutex);
+    for (PendingRequest &request : _requests) {
+      std::string uri = request.uri.c_str();
+      size_t query = uri.find('?');
+
+      _args.clear();
+      if (query != std::string::npos) {
+        parseArgs(uri.substr(query + 1));
+        uri.resize(query);
+      }
+      if (!request.isUpload) parseArgs(request.file);
+
+      _method = request.method;
+      _headers = request.headers;
+      _client = WiFiClient(request.fd);
+      _responseHeaders.clear();
+      _contentLength = CONTENT_LENGTH_NOT_SET;
+      _isChunked = false;
+
+      bool isHandled = false;
+      for (const Route &route : _routes) {
+        if (route.uri != uri.c_str() || (route.method != HTTP_ANY && route.method != request.method)) continue;
+        if (request.isUpload && route.uploadHandler) runUpload(route, request);
+        route.handler();
+        isHandled = true;
+        break;
+      }
+      if (!isHandled) send(404, "text/plain", "Not found");
+
+      _client = WiFiClient();
+      *request.isHandled = true;
+    }
+    _requests.clear();
+  }
+
+  WiFiClient client() { return _client; }
+
+  // Waits for the next handleClient() to run the handler for uri, which may
+  // carry a query string. Returns the browser's end of the connection, or -1
+  // if nothing served it in time.
+  int request(const String &uri, const Fields &headers = Fields(), unsigned long timeoutMs = 1000) {
+    return queueRequest({ uri, HTTP_GET, headers, false, std::string(), String(), -1, nullptr }, timeoutMs);
+  }
+
+  // As request(), posting form, URL encoded without the escapes, whose
+  // fields the handler gets from arg() along with the query string's
+  int post(const String &uri, const std::string &form, unsigned long timeoutMs = 1000) {
+    return queueRequest({ uri, HTTP_POST, Fields(), false, form, String(), -1, nullptr }, timeoutMs);
+  }
+
+  // As request(), posting file as a multipart form upload, which the route's
+  // upload handler gets in HTTP_UPLOAD_BUFLEN pieces
+  int upload(const String &uri, const std::string &file, const String &filename, unsigned long timeoutMs = 5000) {
+    return queueRequest({ uri, HTTP_POST, Fields(), true, file, filename, -1, nullptr }, timeoutMs);
+  }
+
+  HTTPUpload &upload() { return _upload; }
+
+  void on(const String &uri, THandlerFunction handler) { on(uri, HTTP_ANY, handler); }
+  void on(const String &uri, HTTPMethod method, THandlerFunction handler) { _routes.push_back({ uri, method, handler, nullptr }); }
+  void on(const String &uri, HTTPMethod method, THandlerFunction handler, THandlerFunction uploadHandler) {
+    _routes.push_back({ uri, method, handler, uploadHandler });
+  }
+  void onNotFound(THandlerFunction handler) {}
+
+  String arg(const String &name) {
+    auto value = _args.find(name.c_str());
+    return value == _args.end() ? String() : String(value->second);
+  }
+  bool hasArg(const String &name) { return _args.count(name.c_str()) > 0; }
+  HTTPMethod method() { return _method; }
+
+  void collectHeaders(const char *headerKeys[], const size_t headerKeysCount) {}
+  String header(const String &name) {
+    auto value = _headers.find(name.c_str());
+    return value == _headers.end() ? String() : String(value->second);
+  }
+  bool hasHeader(const String &name) { return _headers.count(name.c_str()) > 0; }
+
+  void sendHeader(const String &name, const String &value, bool first = false) {
+    std::string line = std::string(name.c_str()) + ": " + value.c_str() + "\r\n";
+    _responseHeaders = first ? line + _responseHeaders : _responseHeaders + line;
+  }
+  void setContentLength(const size_t contentLength) { _contentLength = contentLength; }
+
+  void send(int code, const char *contentType = NULL, const String &content = String("")) {
+    std::string response = "HTTP/1.1 " + std::to_string(code) + "\r\n";
+    if (contentType) response += std::string("Content-Type: ") + contentType + "\r\n";
+    _isChunked = _contentLength == CONTENT_LENGTH_UNKNOWN;
+    if (_isChunked) {
+      response += "Transfer-Encoding: chunked\r\n";
+    } else {
+      response += "Content-Length: " + std::to_string(_contentLength == CONTENT_LENGTH_NOT_SET ? content.length() : _contentLength) + "\r\n";
+    }
+    response += _responseHeaders + "\r\n";
+    _client.write((const uint8_t *)response.data(), response.size());
+    if (content.length() > 0) sendContent(content);
+  }
+  void send(int code, const String &contentType, const String &content) { send(code, contentType.c_str(), content); }
+  void send_P(int code, const char *contentType, const char *content, size_t contentLength) {
+    setContentLength(contentLength);
+    send(code, contentType);
+    _client.write((const uint8_t *)content, contentLength);
+  }
+
+  void sendContent(const char *content, size_t size) {
+    if (_isChunked) {
+      char header[16];
+      int length = snprintf(header, sizeof(header), "%zx\r\n", size);
+      _client.write((const uint8_t *)header, length);
+    }
+    _client.write((const uint8_t *)content, size);
+    if (_isChunked) _client.write((const uint8_t *)"\r\n", 2);
+  }
+  void sendContent(const String &content) { sendContent(content.c_str(), content.length()); }
+
+  const std::vector<Route> &routes() const { return _routes; }
+
+ private:
+  struct PendingRequest {
+    String uri;
+    HTTPMethod method;
+    Fields headers;
+    bool isUpload;
+    std::string file;
+    String filename;
+    int fd;
+    std::shared_ptr<std::atomic<bool>> isHandled;
+  };
+
+  int queueRequest(PendingRequest request, unsigned long timeoutMs) {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) return -1;
+
+    request.fd = fds[0];
+    request.isHandled = std::make_shared<std::atomic<bool>>(false);
+    std::shared_ptr<std::atomic<bool>> isHandled = request.isHandled;
+    {
+      std::lock_guard<std::mutex> lock(_requestMutex);
+      _requests.push_back(request);
+    }
+
+    unsigned long start = millis();
+    while (!*isHandled && millis() - start < timeoutMs) delay(1);
+    if (!*isHandled) {
+      ::close(fds[1]);
+      return -1;
+    }
+    return fds[1];
+  }
+
+  void parseArgs(const std::string &fields) {
+    for (size_t start = 0; start < fields.size();) {
+      size_t end = fields.find('&', start);
+      if (end == std::string::npos) end = fields.size();
+      std::string field = fields.substr(start, end - start);
+      size_t equals = field.find('=');
+      if (!field.empty()) _args[field.substr(0, equals)] = equals == std::string::npos ? "" : field.substr(equals + 1);
+      start = end + 1;
+    }
+  }
+
+  void runUpload(const Route &route, const PendingRequest &request) {
+    _upload.filename = request.filename;
+    _upload.name = "update";
+    _upload.type = "application/octet-stream";
+    _upload.totalSize = 0;
+    _upload.currentSize = 0;
+    _upload.status = UPLOAD_FILE_START;
+    route.uploadHandler();
+
+    for (size_t position = 0; position < request.file.size(); position += HTTP_UPLOAD_BUFLEN) {
+      _upload.currentSize = std::min<size_t>(HTTP_UPLOAD_BUFLEN, request.file.size() - position);
+      memcpy(_upload.buf, request.file.data() + position, _upload.currentSize);
+      _upload.totalSize += _upload.currentSize;
+      _upload.status = UPLOAD_FILE_WRITE;
+      route.uploadHandler();
+    }
+
+    _upload.currentSize = 0;
+    _upload.status = UPLOAD_FILE_END;
+    route.uploadHandler();
+  }
+
+  std::vector<Route> _routes;
+  WiFiClient _client;
+  HTTPUpload _upload;
+  HTTPMethod _method = HTTP_GET;
+  Fields _args;
+  Fields _headers;
+  std::string _responseHeaders;
+  size_t _contentLength = CONTENT_LENGTH_NOT_SET;
+  bool _isChunked = false;
+  std::mutex _requestMutex;
+  std::vector<PendingRequest> _requests;
+};
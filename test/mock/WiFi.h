@@ -0,0 +1,64 @@
+// The radio is not modelled on the host. Tests set mock::wifiStations() to
+// pretend a station joined the soft AP, and mock::wifiConnected() to let a
+// station started with begin() reach its access point.
+#pragma once
+
+#include <Arduino.h>
+#include <IPAddress.h>
+#include <WiFiClient.h>
+
+typedef enum { WIFI_OFF = 0, WIFI_STA, WIFI_AP, WIFI_AP_STA } wifi_mode_t;
+typedef enum { WL_IDLE_STATUS = 0, WL_NO_SSID_AVAIL, WL_SCAN_COMPLETED, WL_CONNECTED, WL_CONNECT_FAILED, WL_CONNECTION_LOST, WL_DISCONNECTED } wl_status_t;
+
+namespace mock {
+
+inline std::atomic<uint8_t> &wifiStations() {
+  static std::atomic<uint8_t> stations{ 0 };
+  return stations;
+}
+
+inline std::atomic<bool> &wifiConnected() {
+  static std::atomic<bool> isConnected{ false };
+  return isConnected;
+}
+
+}  // namespace mock
+
+class WiFiClass {
+ public:
+  bool mode(wifi_mode_t mode) {
+    _mode = mode;
+    return true;
+  }
+  wifi_mode_t getMode() { return _mode; }
+
+  bool softAP(const char *ssid, const char *passphrase = NULL) { return true; }
+  bool softAP(const String &ssid, const String &passphrase) { return softAP(ssid.c_str(), passphrase.c_str()); }
+  bool softAPConfig(IPAddress localIP, IPAddress gateway, IPAddress subnet) {
+    _softAPIP = localIP;
+    return true;
+  }
+  IPAddress softAPIP() { return _softAPIP; }
+  uint8_t softAPgetStationNum() { return _mode == WIFI_AP || _mode == WIFI_AP_STA ? mock::wifiStations().load() : 0; }
+  bool softAPdisconnect(bool isWifiOff = false) { return true; }
+
+  wl_status_t begin(const char *ssid, const char *passphrase = NULL) {
+    _isBegun = true;
+    return status();
+  }
+  wl_status_t status() { return _isBegun && (_mode == WIFI_STA || _mode == WIFI_AP_STA) && mock::wifiConnected() ? WL_CONNECTED : WL_DISCONNECTED; }
+  bool disconnect(bool isWifiOff = false) { return true; }
+  bool reconnect() { return false; }
+  bool setAutoReconnect(bool isAutoReconnect) { return true; }
+  bool setSleep(bool isSleep) { return true; }
+  IPAddress localIP() { return IPAddress(); }
+  String macAddress() { return "A1:B2:C3:D4:E5:F6"; }
+  int8_t RSSI() { return 0; }
+
+ private:
+  std::atomic<wifi_mode_t> _mode{ WIFI_OFF };
+  std::atomic<bool> _isBegun{ false };
+  IPAddress _softAPIP;
+};
+
+inline WiFiClass WiFi;
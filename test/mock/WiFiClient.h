@@ -0,0 +1,55 @@
+// Clients never connect out. A client the web server hands to a handler is
+// one end of a socketpair, so writes behave as on a real socket; the test
+// holds the browser's end, see WebServer::request().
+#pragma once
+
+#include <Arduino.h>
+#include <IPAddress.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <memory>
+
+namespace mock {
+
+struct ClientSocket {
+  int fd = -1;
+  ~ClientSocket() {
+    if (fd >= 0) ::close(fd);
+  }
+};
+
+}  // namespace mock
+
+class WiFiClient : public Stream {
+ public:
+  WiFiClient() {}
+  explicit WiFiClient(int fd) : _socket(std::make_shared<mock::ClientSocket>()) { _socket->fd = fd; }
+
+  int connect(const char *host, uint16_t port) { return 0; }
+  int connect(IPAddress ip, uint16_t port) { return 0; }
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t *buffer, size_t size) override {
+    if (!_socket) return 0;
+    ssize_t sent = ::send(_socket->fd, buffer, size, MSG_NOSIGNAL);
+    return sent < 0 ? 0 : sent;
+  }
+  using Print::write;
+  int available() override { return 0; }
+  int read() override { return -1; }
+  int read(uint8_t *buffer, size_t size) { return -1; }
+  void flush() {}
+  void stop() { _socket.reset(); }
+  uint8_t connected() {
+    if (!_socket) return 0;
+    char c;
+    return ::recv(_socket->fd, &c, 1, MSG_PEEK | MSG_DONTWAIT) != 0;
+  }
+  operator bool() { return connected(); }
+  int fd() const { return _socket ? _socket->fd : -1; }
+  void setNoDelay(bool isNoDelay) {}
+  IPAddress remoteIP() const { return IPAddress(); }
+
+ private:
+  std::shared_ptr<mock::ClientSocket> _socket;
+};
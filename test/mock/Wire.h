@@ -0,0 +1,78 @@
+// Native I2C bus. Tests attach mock::I2CDevice models at an address; a
+// transaction's first written byte selects the register, as on the real
+// sensors, and reads are served from that register onwards.
+#pragma once
+
+#include <Arduino.h>
+
+#include <vector>
+
+namespace mock {
+
+class I2CDevice {
+ public:
+  virtual ~I2CDevice() {}
+  virtual void writeRegister(uint8_t reg, const uint8_t *data, size_t length) {}
+  virtual void readRegister(uint8_t reg, uint8_t *data, size_t length) = 0;
+};
+
+inline I2CDevice *&i2cDevice(uint8_t address) {
+  static I2CDevice *devices[128] = {};
+  return devices[address & 0x7f];
+}
+
+}  // namespace mock
+
+class TwoWire : public Stream {
+ public:
+  bool begin() { return true; }
+  bool begin(int sda, int scl, uint32_t frequency = 0) { return true; }
+  void setClock(uint32_t frequency) {}
+
+  void beginTransmission(int address) {
+    _address = address;
+    _transmit.clear();
+  }
+
+  uint8_t endTransmission(bool sendStop = true) {
+    mock::I2CDevice *device = mock::i2cDevice(_address);
+    if (device == nullptr) return 2;  // address NACK
+
+    if (!_transmit.empty()) {
+      _register[_address & 0x7f] = _transmit[0];
+      if (_transmit.size() > 1) device->writeRegister(_transmit[0], _transmit.data() + 1, _transmit.size() - 1);
+    }
+    return 0;
+  }
+
+  uint8_t requestFrom(int address, int quantity, int sendStop = true) {
+    _receive.clear();
+    _receiveIndex = 0;
+
+    mock::I2CDevice *device = mock::i2cDevice(address);
+    if (device == nullptr || quantity <= 0) return 0;
+
+    _receive.resize(quantity);
+    device->readRegister(_register[address & 0x7f], _receive.data(), quantity);
+    return quantity;
+  }
+
+  size_t write(uint8_t c) override {
+    _transmit.push_back(c);
+    return 1;
+  }
+  using Print::write;
+
+  int available() override { return _receive.size() - _receiveIndex; }
+  int read() override { return _receiveIndex < _receive.size() ? _receive[_receiveIndex++] : -1; }
+  int peek() override { return _receiveIndex < _receive.size() ? _receive[_receiveIndex] : -1; }
+
+ private:
+  uint8_t _address = 0;
+  uint8_t _register[128] = {};
+  std::vector<uint8_t> _transmit;
+  std::vector<uint8_t> _receive;
+  size_t _receiveIndex = 0;
+};
+
+inline TwoWire Wire;
@@ -0,0 +1,52 @@
+// Native stand-in for the ESP-IDF system calls the sketch uses.
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+typedef int esp_err_t;
+#define ESP_OK 0
+
+typedef enum {
+  ESP_RST_UNKNOWN,
+  ESP_RST_POWERON,
+  ESP_RST_EXT,
+  ESP_RST_SW,
+  ESP_RST_PANIC,
+  ESP_RST_INT_WDT,
+  ESP_RST_TASK_WDT,
+  ESP_RST_WDT,
+  ESP_RST_DEEPSLEEP,
+  ESP_RST_BROWNOUT,
+  ESP_RST_SDIO,
+} esp_reset_reason_t;
+
+typedef enum {
+  ESP_MAC_WIFI_STA,
+  ESP_MAC_WIFI_SOFTAP,
+  ESP_MAC_BT,
+  ESP_MAC_ETH,
+} esp_mac_type_t;
+
+namespace mock {
+
+inline esp_reset_reason_t &resetReason() {
+  static esp_reset_reason_t reason = ESP_RST_POWERON;
+  return reason;
+}
+
+}  // namespace mock
+
+inline esp_reset_reason_t esp_reset_reason() {
+  return mock::resetReason();
+}
+
+inline int64_t esp_timer_get_time() {
+  return micros();
+}
+
+inline esp_err_t esp_read_mac(uint8_t *mac, esp_mac_type_t type) {
+  const uint8_t address[6] = { 0xa1, 0xb2, 0xc3, 0xd4, 0xe5, (uint8_t)(0xf6 + type) };
+  memcpy(mac, address, 6);
+  return ESP_OK;
+}
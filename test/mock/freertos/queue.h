@@ -0,0 +1,105 @@
+// Copying queues with blocking timeouts, as FreeRTOS queues behave.
+#pragma once
+
+#include <string.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+#include "FreeRTOS.h"
+
+namespace mock {
+
+struct Queue {
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::deque<std::vector<uint8_t>> items;
+  UBaseType_t length;
+  UBaseType_t itemSize;
+};
+
+inline std::chrono::steady_clock::time_point queueDeadline(TickType_t ticks) {
+  return ticks == portMAX_DELAY ? std::chrono::steady_clock::time_point::max() : std::chrono::steady_clock::now() + std::chrono::milliseconds(ticks);
+}
+
+inline BaseType_t queueSend(QueueHandle_t handle, const void *item, TickType_t ticks, bool isOverwrite) {
+  Queue *queue = (Queue *)handle;
+  std::unique_lock<std::mutex> lock(queue->mutex);
+
+  if (isOverwrite) {
+    queue->items.clear();
+  } else if (!queue->changed.wait_until(lock, queueDeadline(ticks), [queue] { return queue->items.size() < queue->length; })) {
+    return pdFALSE;
+  }
+
+  const uint8_t *bytes = (const uint8_t *)item;
+  queue->items.emplace_back(bytes, bytes + queue->itemSize);
+  queue->changed.notify_all();
+  return pdTRUE;
+}
+
+inline BaseType_t queueReceive(QueueHandle_t handle, void *item, TickType_t ticks, bool isPeek) {
+  Queue *queue = (Queue *)handle;
+  std::unique_lock<std::mutex> lock(queue->mutex);
+
+  if (!queue->changed.wait_until(lock, queueDeadline(ticks), [queue] { return !queue->items.empty(); })) return pdFALSE;
+
+  memcpy(item, queue->items.front().data(), queue->itemSize);
+  if (!isPeek) {
+    queue->items.pop_front();
+    queue->changed.notify_all();
+  }
+  return pdTRUE;
+}
+
+}  // namespace mock
+
+inline QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize) {
+  mock::Queue *queue = new mock::Queue();
+  queue->length = length;
+  queue->itemSize = itemSize;
+  return queue;
+}
+
+inline BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks) {
+  return mock::queueSend(queue, item, ticks, false);
+}
+
+inline BaseType_t xQueueSendToBack(QueueHandle_t queue, const void *item, TickType_t ticks) {
+  return mock::queueSend(queue, item, ticks, false);
+}
+
+inline BaseType_t xQueueOverwrite(QueueHandle_t queue, const void *item) {
+  return mock::queueSend(queue, item, 0, true);
+}
+
+inline BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks) {
+  return mock::queueReceive(queue, item, ticks, false);
+}
+
+inline BaseType_t xQueuePeek(QueueHandle_t queue, void *item, TickType_t ticks) {
+  return mock::queueReceive(queue, item, ticks, true);
+}
+
+inline UBaseType_t uxQueueMessagesWaiting(QueueHandle_t handle) {
+  mock::Queue *queue = (mock::Queue *)handle;
+  std::lock_guard<std::mutex> lock(queue->mutex);
+  return queue->items.size();
+}
+
+inline UBaseType_t uxQueueSpacesAvailable(QueueHandle_t handle) {
+  mock::Queue *queue = (mock::Queue *)handle;
+  std::lock_guard<std::mutex> lock(queue->mutex);
+  return queue->length - queue->items.size();
+}
+
+inline BaseType_t xQueueReset(QueueHandle_t handle) {
+  mock::Queue *queue = (mock::Queue *)handle;
+  std::lock_guard<std::mutex> lock(queue->mutex);
+  queue->items.clear();
+  queue->changed.notify_all();
+  return pdPASS;
+}
@@ -0,0 +1,25 @@
+// Semaphores are single item queues, as in FreeRTOS.
+#pragma once
+
+#include "queue.h"
+
+inline SemaphoreHandle_t xSemaphoreCreateBinary() {
+  return xQueueCreate(1, 1);
+}
+
+inline SemaphoreHandle_t xSemaphoreCreateMutex() {
+  SemaphoreHandle_t semaphore = xSemaphoreCreateBinary();
+  uint8_t token = 0;
+  xQueueSend(semaphore, &token, 0);
+  return semaphore;
+}
+
+inline BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks) {
+  uint8_t token;
+  return xQueueReceive(semaphore, &token, ticks);
+}
+
+inline BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+  uint8_t token = 0;
+  return xQueueSend(semaphore, &token, 0);
+}
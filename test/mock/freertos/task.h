@@ -0,0 +1,35 @@
+// Tasks run as detached threads; priority and core affinity are ignored.
+#pragma once
+
+#include <chrono>
+#include <thread>
+
+#include "FreeRTOS.h"
+
+inline BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char *name, uint32_t stackDepth, void *parameter, UBaseType_t priority,
+                                          TaskHandle_t *handle, BaseType_t core) {
+  std::thread thread(function, parameter);
+  if (handle != NULL) *handle = (TaskHandle_t)(uintptr_t)std::hash<std::thread::id>()(thread.get_id());
+  thread.detach();
+  return pdPASS;
+}
+
+inline BaseType_t xTaskCreate(TaskFunction_t function, const char *name, uint32_t stackDepth, void *parameter, UBaseType_t priority, TaskHandle_t *handle) {
+  return xTaskCreatePinnedToCore(function, name, stackDepth, parameter, priority, handle, tskNO_AFFINITY);
+}
+
+// Only deleting the calling task is supported, which on the host simply
+// lets the task function return.
+inline void vTaskDelete(TaskHandle_t handle) {}
+
+inline void vTaskDelay(TickType_t ticks) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(ticks));
+}
+
+inline TickType_t xTaskGetTickCount() {
+  return millis();
+}
+
+inline UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t handle) {
+  return 4096;
+}
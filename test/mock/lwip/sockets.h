@@ -0,0 +1,4 @@
+// lwIP's BSD socket API is the host's
+#pragma once
+
+#include <sys/socket.h>
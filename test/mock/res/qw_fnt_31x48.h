@@ -0,0 +1,2 @@
+// Fonts are declared in SparkFun_Qwiic_OLED.h
+#pragma once
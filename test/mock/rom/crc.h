@@ -0,0 +1,9 @@
+// The ROM's CRC-32, which chains like zlib's
+#pragma once
+
+#include <stdint.h>
+#include <zlib.h>
+
+inline uint32_t crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len) {
+  return crc32(crc, buf, len);
+}
@@ -0,0 +1,22 @@
+// The single mock central always has connection handle 0.
+#pragma once
+
+#include <ArduinoBLE.h>
+
+class ATTClass {
+ public:
+  uint16_t mtu(uint16_t handle) const {
+    mock::BLEPeripheral &peripheral = mock::blePeripheral();
+    return peripheral.isConnected && handle == 0 ? peripheral.mtu : 0;
+  }
+
+  uint16_t connectionHandle(uint8_t addressType, const uint8_t address[6]) const {
+    mock::BLEPeripheral &peripheral = mock::blePeripheral();
+    return peripheral.isConnected && addressType == 0 && memcmp(peripheral.address, address, 6) == 0 ? 0 : 0xffff;
+  }
+
+  bool connected() const { return mock::blePeripheral().isConnected; }
+  bool connected(uint16_t handle) const { return connected() && handle == 0; }
+};
+
+inline ATTClass ATT;
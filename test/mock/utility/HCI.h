@@ -0,0 +1,20 @@
+// Records connection parameter update requests for the tests, which can
+// have them refused.
+#pragma once
+
+#include <ArduinoBLE.h>
+
+class HCIClass {
+ public:
+  int leConnUpdate(uint16_t handle, uint16_t minInterval, uint16_t maxInterval, uint16_t latency, uint16_t supervisionTimeout) {
+    mock::BLEPeripheral &peripheral = mock::blePeripheral();
+    if (!peripheral.isConnected || handle != 0) return -1;
+
+    std::lock_guard<std::mutex> lock(peripheral.mutex);
+    int status = peripheral.connectionUpdateStatus;
+    peripheral.connectionUpdates.push_back({ status, handle, minInterval, maxInterval, latency, supervisionTimeout });
+    return status;
+  }
+};
+
+inline HCIClass HCI;
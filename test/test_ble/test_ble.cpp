@@ -0,0 +1,1188 @@
+// Drives the firmware's BLE surface from a scripted central on the host.
+//
+// The sketch runs unchanged against the mocks in test/mock: setup() and
+// loop() on one thread, its FreeRTOS tasks on others. Set MOCK_SERIAL=1 to
+// see the firmware's Serial output.
+#include <unity.h>
+#include <zlib.h>
+
+#include <map>
+
+// A station uplink to a broker, which tests bring online with the mocks
+#define WIFI_SSID "roastery"
+#define MQTT_HOST "broker.local"
+
+#include "../../src/hh_roast_meter_ble.cpp"
+
+#define IR_UNLOADED 30000
+#define IR_LOADED 80000
+
+#define LEGACY_DEVIATION 0.2f
+#define LEGACY_COEFFICIENT_0 -7.5f
+#define LEGACY_BLE_NAME "Legacy Meter"
+
+#define BATTERY_VCELL 0xC300  // 3.9V on a MAX17043
+#define BATTERY_SOC 0x4E80    // 78.5%
+
+// MAX17043 registers, big endian as on the chip. Taking it off the bus makes
+// every transaction with it NACK, as a flaky connection would.
+class FuelGauge : public mock::I2CDevice {
+ public:
+  std::atomic<int> quickStarts{ 0 };
+  std::atomic<int> reads{ 0 };  // transactions, however many registers each
+
+  void set(uint8_t reg, uint16_t value) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _registers[reg] = value >> 8;
+    _registers[reg + 1] = value & 0xff;
+  }
+
+  void writeRegister(uint8_t reg, const uint8_t *data, size_t length) override {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (reg == MAX17043_MODE && length == 2 && (data[0] << 8 | data[1]) == MAX17043_MODE_QUICKSTART) quickStarts++;
+  }
+
+  void readRegister(uint8_t reg, uint8_t *data, size_t length) override {
+    std::lock_guard<std::mutex> lock(_mutex);
+    reads++;
+    for (size_t i = 0; i < length; i++) data[i] = _registers[(reg + i) & 0xff];
+  }
+
+ private:
+  std::mutex _mutex;
+  uint8_t _registers[256] = {};
+};
+
+FuelGauge fuelGauge;
+mock::BLECentral central(247);
+
+template <typename T>
+T notifiedValue(const mock::BLENotification &notification) {
+  T value = T();
+  memcpy(&value, notification.value.data(), min(sizeof(T), notification.value.size()));
+  return value;
+}
+
+bool waitForNotification(const char *uuid, unsigned long timeoutMs) {
+  unsigned long start = millis();
+  while (millis() - start < timeoutMs) {
+    if (!mock::bleNotifications(uuid).empty()) return true;
+    delay(10);
+  }
+  return false;
+}
+
+std::vector<MeasurementRecord> measurementRecords() {
+  std::vector<MeasurementRecord> records;
+  for (auto &notification : mock::bleNotifications(BLE_UUID_MEASUREMENT)) {
+    TEST_ASSERT_EQUAL_UINT8(MEASUREMENT_FRAME_VERSION, notification.value[0]);
+    TEST_ASSERT_EQUAL(MEASUREMENT_FRAME_HEADER_LENGTH + notification.value[1] * sizeof(MeasurementRecord), notification.value.size());
+
+    for (int i = 0; i < notification.value[1]; i++) {
+      MeasurementRecord record;
+      memcpy(&record, notification.value.data() + MEASUREMENT_FRAME_HEADER_LENGTH + i * sizeof(MeasurementRecord), sizeof(MeasurementRecord));
+      records.push_back(record);
+    }
+  }
+  return records;
+}
+
+// Samples of a raw stream frame, the first one and then zigzag varint deltas
+std::vector<uint32_t> rawStreamSamples(const mock::BLENotification &frame) {
+  std::vector<uint32_t> samples;
+  uint32_t sample = frame.value[5] | frame.value[6] << 8 | frame.value[7] << 16;
+  samples.push_back(sample);
+
+  size_t position = RAW_STREAM_FRAME_HEADER_LENGTH;
+  while (position < frame.value.size()) {
+    uint32_t zigzag = 0;
+    for (int shift = 0; position < frame.value.size(); shift += 7) {
+      uint8_t byte = frame.value[position++];
+      zigzag |= (uint32_t)(byte & 0x7f) << shift;
+      if (!(byte & 0x80)) break;
+    }
+    sample += (int32_t)(zigzag >> 1) ^ -(int32_t)(zigzag & 1);
+    samples.push_back(sample);
+  }
+  return samples;
+}
+
+// Measurement frames in the events a browser has received so far
+std::vector<std::vector<uint8_t>> eventFrames(int browser) {
+  std::string stream;
+  char buffer[1024];
+  ssize_t length;
+  while ((length = recv(browser, buffer, sizeof(buffer), MSG_DONTWAIT)) > 0) stream.append(buffer, length);
+
+  std::vector<std::vector<uint8_t>> frames;
+  const std::string field = "event: measurement\ndata: ";
+  for (size_t position = stream.find(field); position != std::string::npos; position = stream.find(field, position)) {
+    position += field.size();
+    size_t end = stream.find('\n', position);
+    if (end == std::string::npos) break;
+
+    std::vector<uint8_t> frame;
+    uint32_t group = 0;
+    int bits = 0;
+    for (size_t i = position; i < end && stream[i] != '='; i++) {
+      const char *alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+      group = group << 6 | (strchr(alphabet, stream[i]) - alphabet);
+      bits += 6;
+      if (bits >= 8) {
+        bits -= 8;
+        frame.push_back(group >> bits & 0xff);
+      }
+    }
+    frames.push_back(frame);
+  }
+  return frames;
+}
+
+// Status code, headers and de-chunked body of a finished response
+struct HTTPResponse {
+  int code = 0;
+  std::string headers;
+  std::string body;
+};
+
+HTTPResponse readResponse(int browser) {
+  std::string stream;
+  char buffer[1024];
+  ssize_t length;
+  while ((length = recv(browser, buffer, sizeof(buffer), 0)) > 0) stream.append(buffer, length);
+  close(browser);
+
+  HTTPResponse response;
+  size_t headersEnd = stream.find("\r\n\r\n");
+  if (headersEnd == std::string::npos) return response;
+  response.code = atoi(stream.c_str() + strlen("HTTP/1.1 "));
+  response.headers = stream.substr(0, headersEnd + 2);
+
+  std::string body = stream.substr(headersEnd + 4);
+  if (response.headers.find("Transfer-Encoding: chunked") == std::string::npos) {
+    response.body = body;
+    return response;
+  }
+  for (size_t position = 0; position < body.size();) {
+    char *sizeEnd;
+    size_t size = strtoul(body.c_str() + position, &sizeEnd, 16);
+    if (size == 0) break;
+    position = sizeEnd - body.c_str() + 2;
+    response.body += body.substr(position, size);
+    position += size + 2;
+  }
+  return response;
+}
+
+// As gzip writes it, with the original file name in the header
+std::string gzipImage(const std::vector<uint8_t> &image) {
+  z_stream stream = {};
+  deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY);
+  gz_header header = {};
+  header.name = (Bytef *)"firmware.bin";
+  deflateSetHeader(&stream, &header);
+
+  std::string compressed(deflateBound(&stream, image.size()) + 64, '\0');
+  stream.next_in = (Bytef *)image.data();
+  stream.avail_in = image.size();
+  stream.next_out = (Bytef *)&compressed[0];
+  stream.avail_out = compressed.size();
+  deflate(&stream, Z_FINISH);
+  compressed.resize(stream.total_out);
+  deflateEnd(&stream);
+  return compressed;
+}
+
+// Body of a gzip encoded response, as a browser inflates it
+std::string gunzipBody(const std::string &body) {
+  z_stream stream = {};
+  inflateInit2(&stream, 15 + 16);
+
+  std::string inflated(64 * 1024, '\0');
+  stream.next_in = (Bytef *)body.data();
+  stream.avail_in = body.size();
+  stream.next_out = (Bytef *)&inflated[0];
+  stream.avail_out = inflated.size();
+  int result = inflate(&stream, Z_FINISH);
+  inflated.resize(result == Z_STREAM_END ? stream.total_out : 0);
+  inflateEnd(&stream);
+  return inflated;
+}
+
+// The value of one sample line in Prometheus text, or -1 when it is missing
+double metricValue(const std::string &text, const char *name) {
+  std::string prefix = std::string("\n") + name + " ";
+  size_t position = text.find(prefix);
+  return position == std::string::npos ? -1 : atof(text.c_str() + position + prefix.size());
+}
+
+void printEventStats(const char *label) {
+  mock::BLEEventStats stats = mock::bleEventStats();
+  if (stats.count == 0) return;
+
+  char message[160];
+  snprintf(message, sizeof(message), "%s: %u events, wait avg %luus worst %luus, handler avg %luus worst %luus", label, stats.count,
+           (unsigned long)(stats.totalWaitUs / stats.count), stats.worstWaitUs, (unsigned long)(stats.totalHandlerUs / stats.count), stats.worstHandlerUs);
+  TEST_MESSAGE(message);
+}
+
+// Boots the firmware from settings written in the layout used before
+// StoredSettings
+void seedLegacySettings() {
+  EEPROM.begin(EEPROM_MAX_LENGTH);
+  EEPROM.put(EEPROM_VALID_IDX, (uint8_t)EEPROM_VALID_CODE);
+  EEPROM.put(EEPROM_LED_BRIGHTNESS_IDX, (uint8_t)EEPROM_LED_BRIGHTNESS_DEFAULT);
+  EEPROM.put(EEPROM_INTERSECTION_POINT_IDX, (uint8_t)EEPROM_INTERSECTION_POINT_DEFAULT);
+  EEPROM.put(EEPROM_DEVIATION_IDX, LEGACY_DEVIATION);
+  EEPROM.put(EEPROM_COEFFICIENT_0_IDX, LEGACY_COEFFICIENT_0);
+  EEPROM.put(EEPROM_COEFFICIENT_1_IDX, EEPROM_COEFFICIENT_1_DEFAULT);
+  EEPROM.put(EEPROM_COEFFICIENT_2_IDX, EEPROM_COEFFICIENT_2_DEFAULT);
+  EEPROM.put(EEPROM_COEFFICIENT_3_IDX, 0.0f);
+  EEPROM.put(EEPROM_IR_OFFSET_IDX, 0.0f);
+
+  const char *name = LEGACY_BLE_NAME;
+  EEPROM.write(EEPROM_BLE_NAME_IDX, strlen(name));
+  for (size_t i = 0; i < strlen(name); i++) EEPROM.write(EEPROM_BLE_NAME_IDX + 1 + i, name[i]);
+}
+
+void test_legacy_settings_are_migrated() {
+  SettingsBlob blob;
+  TEST_ASSERT_TRUE(central.read(BLE_UUID_SETTINGS_BLOB, blob));
+  TEST_ASSERT_EQUAL_FLOAT(LEGACY_DEVIATION, blob.deviation);
+  TEST_ASSERT_EQUAL_FLOAT(LEGACY_COEFFICIENT_0, blob.coefficient[0]);
+  TEST_ASSERT_EQUAL_FLOAT(EEPROM_AGTRON_DEADBAND_DEFAULT, blob.agtronDeadband);
+  TEST_ASSERT_EQUAL_UINT16(EEPROM_IR_DEADBAND_DEFAULT, blob.irDeadband);
+  TEST_ASSERT_EQUAL_UINT16(EEPROM_NOTIFY_HEARTBEAT_DEFAULT, blob.notifyHeartbeat);
+  TEST_ASSERT_EQUAL_STRING(LEGACY_BLE_NAME, blob.bleName);
+
+  // Rewritten as a current record, which the next boot loads as is
+  StoredSettings stored;
+  TEST_ASSERT_TRUE(loadStoredSettings(stored));
+  TEST_ASSERT_EQUAL_UINT8(SETTINGS_STORE_VERSION, stored.version);
+  TEST_ASSERT_EQUAL_FLOAT(LEGACY_COEFFICIENT_0, stored.coefficient[0]);
+}
+
+void test_services_are_advertised() {
+  mock::BLEAdvertisement advertisement = mock::bleAdvertisement();
+  TEST_ASSERT_GREATER_THAN(0, advertisement.count);
+  TEST_ASSERT_EQUAL_STRING(BLE_UUID_ROAST_METER_SERVICE, advertisement.advertisedService.c_str());
+  TEST_ASSERT_EQUAL_STRING(bleName.c_str(), advertisement.localName.c_str());
+
+  TEST_ASSERT_TRUE(mock::bleHasCharacteristic(BLE_UUID_PARTICLE_SENSOR, BLERead | BLENotify));
+  TEST_ASSERT_TRUE(mock::bleHasCharacteristic(BLE_UUID_AGTRON, BLERead | BLENotify));
+  TEST_ASSERT_TRUE(mock::bleHasCharacteristic(BLE_UUID_METER_STATE, BLERead | BLENotify));
+  TEST_ASSERT_TRUE(mock::bleHasCharacteristic(BLE_UUID_MEASUREMENT, BLERead | BLENotify));
+  TEST_ASSERT_TRUE(mock::bleHasCharacteristic(BLE_UUID_LED_BRIGHTNESS, BLERead | BLEWrite));
+  TEST_ASSERT_TRUE(mock::bleHasCharacteristic(BLE_UUID_SETTINGS_BLOB, BLERead | BLEWrite));
+  TEST_ASSERT_TRUE(mock::bleHasCharacteristic(BLE_UUID_LOG_CONTROL, BLEWrite));
+  TEST_ASSERT_TRUE(mock::bleHasCharacteristic(BLE_UUID_FIRMWARE_REVISION, BLERead));
+}
+
+void test_connect_publishes_state() {
+  mock::bleClearNotifications();
+  mock::bleResetEventStats();
+
+  TEST_ASSERT_TRUE(central.connect());
+  TEST_ASSERT_TRUE(central.subscribe(BLE_UUID_METER_STATE));
+  TEST_ASSERT_TRUE(central.subscribe(BLE_UUID_PARTICLE_SENSOR));
+
+  // A new connection gets every value on the next sample
+  TEST_ASSERT_TRUE(waitForNotification(BLE_UUID_METER_STATE, 2 * MEASUREMENT_INTERVAL_MS + 100));
+  TEST_ASSERT_EQUAL_UINT8(STATE_READY, notifiedValue<uint8_t>(mock::bleNotifications(BLE_UUID_METER_STATE).back()));
+
+  printEventStats("connect");
+}
+
+void test_setting_write_round_trip() {
+  mock::bleResetEventStats();
+
+  uint8_t brightness = 0;
+  TEST_ASSERT_TRUE(central.read(BLE_UUID_LED_BRIGHTNESS, brightness));
+
+  uint8_t changed = brightness == 0x40 ? 0x41 : 0x40;
+  TEST_ASSERT_TRUE(central.write(BLE_UUID_LED_BRIGHTNESS, changed));
+
+  SettingsBlob blob;
+  TEST_ASSERT_TRUE(central.read(BLE_UUID_SETTINGS_BLOB, blob));
+  TEST_ASSERT_TRUE(isSettingsBlobValid(blob, sizeof(SettingsBlob)));
+  TEST_ASSERT_EQUAL_UINT8(changed, blob.ledBrightness);
+
+  TEST_ASSERT_TRUE(central.write(BLE_UUID_LED_BRIGHTNESS, brightness));
+
+  printEventStats("setting write");
+}
+
+void test_setting_writes_are_coalesced() {
+  // Let anything earlier reach flash first
+  delay(SETTINGS_COMMIT_QUIET_MS + 2 * SETTINGS_COMMIT_POLL_MS);
+
+  float deviation = 0;
+  TEST_ASSERT_TRUE(central.read(BLE_UUID_DEVIATION, deviation));
+
+  uint32_t commits = EEPROM.commits;
+  for (int i = 1; i <= 5; i++) {
+    TEST_ASSERT_TRUE(central.write(BLE_UUID_DEVIATION, deviation + i * 0.01f));
+    TEST_ASSERT_TRUE(central.write(BLE_UUID_IR_DEADBAND, (uint16_t)(200 + i)));
+  }
+  TEST_ASSERT_TRUE(central.write(BLE_UUID_DEVIATION, deviation));
+  TEST_ASSERT_TRUE(central.write(BLE_UUID_IR_DEADBAND, (uint16_t)EEPROM_IR_DEADBAND_DEFAULT));
+  TEST_ASSERT_EQUAL_UINT32(commits, EEPROM.commits.load());
+
+  delay(SETTINGS_COMMIT_QUIET_MS + 2 * SETTINGS_COMMIT_POLL_MS);
+  TEST_ASSERT_EQUAL_UINT32(commits + 1, EEPROM.commits.load());
+
+  // An explicit save does not wait for the quiet period
+  TEST_ASSERT_TRUE(central.write(BLE_UUID_IR_DEADBAND, (uint16_t)EEPROM_IR_DEADBAND_DEFAULT));
+  TEST_ASSERT_TRUE(central.write(BLE_UUID_SETTINGS_SAVE, true));
+  delay(3 * SETTINGS_COMMIT_POLL_MS);
+  TEST_ASSERT_EQUAL_UINT32(commits + 2, EEPROM.commits.load());
+
+  // A write during a slow commit neither waits for it nor gets lost
+  EEPROM.commitDelayMs = 500;
+  TEST_ASSERT_TRUE(central.write(BLE_UUID_DEVIATION, deviation + 0.01f));
+  TEST_ASSERT_TRUE(central.write(BLE_UUID_SETTINGS_SAVE, true));
+  unsigned long startMillis = millis();
+  while (EEPROM.commits.load() < commits + 3 && millis() - startMillis < 1000) delay(1);
+  TEST_ASSERT_EQUAL_UINT32(commits + 3, EEPROM.commits.load());
+
+  startMillis = millis();
+  TEST_ASSERT_TRUE(central.write(BLE_UUID_DEVIATION, deviation));
+  TEST_ASSERT_LESS_THAN(EEPROM.commitDelayMs / 2, millis() - startMillis);
+  EEPROM.commitDelayMs = 0;
+
+  delay(500 + SETTINGS_COMMIT_QUIET_MS + 2 * SETTINGS_COMMIT_POLL_MS);
+  TEST_ASSERT_EQUAL_UINT32(commits + 4, EEPROM.commits.load());
+  StoredSettings newest;
+  TEST_ASSERT_TRUE(loadStoredSettings(newest));
+  TEST_ASSERT_EQUAL_FLOAT(deviation, newest.deviation);
+}
+
+void test_corrupt_settings_record_is_rejected() {
+  StoredSettings stored;
+  TEST_ASSERT_TRUE(loadStoredSettings(stored));
+  TEST_ASSERT_EQUAL_UINT32(settingsSequence, stored.sequence);
+
+  uint8_t *coefficient = EEPROM.getDataPtr() + EEPROM_SETTINGS_IDX + offsetof(StoredSettings, coefficient);
+  *coefficient ^= 0xff;
+
+  StoredSettings corrupt;
+  bool isLoaded = loadStoredSettings(corrupt);
+  *coefficient ^= 0xff;
+
+  TEST_ASSERT_FALSE(isLoaded);
+  TEST_ASSERT_EQUAL_FLOAT(EEPROM_COEFFICIENT_0_DEFAULT, corrupt.coefficient[0]);
+}
+
+void test_warm_boot_state_follows_commits() {
+  // The boot was a power on, so this is what the next software reset finds
+  mock::resetReason() = ESP_RST_SW;
+  bool isValid = loadWarmBootState();
+  mock::resetReason() = ESP_RST_POWERON;
+  TEST_ASSERT_TRUE(isValid);
+
+  StoredSettings newest;
+  TEST_ASSERT_TRUE(loadStoredSettings(newest));
+  TEST_ASSERT_TRUE(warmBootState.isSettingsCached);
+  TEST_ASSERT_EQUAL_MEMORY(&newest, &warmBootState.settings, sizeof(StoredSettings));
+
+  TEST_ASSERT_TRUE(warmBootState.isSensorConfigured);
+  TEST_ASSERT_EQUAL_UINT8(ledBrightness, warmBootState.sensorConfig.ledBrightness);
+  TEST_ASSERT_EQUAL_UINT16(sampleRate, warmBootState.sensorConfig.sampleRate);
+
+  // A power on reset discards it
+  xSemaphoreTake(settingsMutex, portMAX_DELAY);
+  WarmBootState state = warmBootState;
+  isValid = loadWarmBootState();
+  warmBootState = state;
+  xSemaphoreGive(settingsMutex);
+  TEST_ASSERT_FALSE(isValid);
+}
+
+void test_settings_blob_rejects_bad_crc() {
+  SettingsBlob blob;
+  TEST_ASSERT_TRUE(central.read(BLE_UUID_SETTINGS_BLOB, blob));
+
+  SettingsBlob corrupted = blob;
+  corrupted.ledBrightness ^= 0xff;
+  TEST_ASSERT_TRUE(central.write(BLE_UUID_SETTINGS_BLOB, corrupted));
+
+  SettingsBlob stored;
+  TEST_ASSERT_TRUE(central.read(BLE_UUID_SETTINGS_BLOB, stored));
+  TEST_ASSERT_EQUAL_MEMORY(&blob, &stored, sizeof(SettingsBlob));
+}
+
+void test_measurement_notify_rate() {
+  TEST_ASSERT_TRUE(central.subscribe(BLE_UUID_MEASUREMENT));
+  mock::particleSensor().irLevel = IR_LOADED;
+  delay(500);
+  mock::bleClearNotifications();
+
+  const unsigned long windowMs = 3000;
+  delay(windowMs);
+  std::vector<MeasurementRecord> records = measurementRecords();
+  size_t frames = mock::bleNotifications(BLE_UUID_MEASUREMENT).size();
+  mock::particleSensor().irLevel = IR_UNLOADED;
+
+  char message[120];
+  snprintf(message, sizeof(message), "measurement: %u records in %u frames over %lums", (unsigned)records.size(), (unsigned)frames, windowMs);
+  TEST_MESSAGE(message);
+
+  // One record per sample, batched into fewer notifications. The newest
+  // frame may still be filling when the window closes.
+  TEST_ASSERT_GREATER_OR_EQUAL((windowMs - MEASUREMENT_BATCH_MAX_AGE_MS) / MEASUREMENT_INTERVAL_MS, records.size());
+  TEST_ASSERT_LESS_OR_EQUAL(windowMs / MEASUREMENT_INTERVAL_MS + MEASUREMENT_BATCH_MAX_AGE_MS / MEASUREMENT_INTERVAL_MS, records.size());
+  TEST_ASSERT_LESS_THAN(records.size(), frames);
+
+  for (size_t i = 1; i < records.size(); i++) {
+    TEST_ASSERT_EQUAL_UINT32(records[i - 1].sequence + 1, records[i].sequence);
+    TEST_ASSERT_EQUAL_UINT8(STATE_MEASURED, records[i].state);
+    TEST_ASSERT_EQUAL_UINT32(IR_LOADED, records[i].rawIR);
+  }
+
+  TEST_ASSERT_TRUE(central.unsubscribe(BLE_UUID_MEASUREMENT));
+}
+
+void test_notifications_follow_deadband() {
+  TEST_ASSERT_TRUE(central.subscribe(BLE_UUID_AGTRON));
+  uint16_t heartbeat = notifyHeartbeat;
+  TEST_ASSERT_TRUE(central.write(BLE_UUID_NOTIFY_HEARTBEAT, (uint16_t)60));
+
+  // Loaded, and left until the filtered level has settled
+  mock::particleSensor().irLevel = IR_LOADED;
+  delay(5000);
+
+  // Agtron moves by about 0.12, well inside both deadbands
+  mock::bleClearNotifications();
+  mock::particleSensor().irLevel = IR_LOADED + irDeadband / 2;
+  delay(1000);
+  TEST_ASSERT_EQUAL(0, mock::bleNotifications(BLE_UUID_PARTICLE_SENSOR).size());
+  TEST_ASSERT_EQUAL(0, mock::bleNotifications(BLE_UUID_AGTRON).size());
+  TEST_ASSERT_EQUAL(0, mock::bleNotifications(BLE_UUID_METER_STATE).size());
+
+  // Past the IR deadband on the next sample, and Agtron past its own as the
+  // filter follows
+  mock::particleSensor().irLevel = IR_LOADED + 5 * irDeadband;
+  TEST_ASSERT_TRUE(waitForNotification(BLE_UUID_PARTICLE_SENSOR, 2 * MEASUREMENT_INTERVAL_MS + 100));
+  TEST_ASSERT_EQUAL_UINT32(IR_LOADED + 5 * irDeadband, notifiedValue<uint32_t>(mock::bleNotifications(BLE_UUID_PARTICLE_SENSOR).front()));
+  TEST_ASSERT_TRUE(waitForNotification(BLE_UUID_AGTRON, 2 * MEASUREMENT_INTERVAL_MS + 100));
+  TEST_ASSERT_EQUAL(0, mock::bleNotifications(BLE_UUID_METER_STATE).size());
+
+  // Nothing changes, so only the heartbeat notifies, everything at once
+  TEST_ASSERT_TRUE(central.write(BLE_UUID_NOTIFY_HEARTBEAT, (uint16_t)1));
+  delay(1000);
+  mock::bleClearNotifications();
+  delay(2500);
+  size_t heartbeats = mock::bleNotifications(BLE_UUID_METER_STATE).size();
+  TEST_ASSERT_UINT_WITHIN(1, 2, heartbeats);
+  TEST_ASSERT_EQUAL(heartbeats, mock::bleNotifications(BLE_UUID_PARTICLE_SENSOR).size());
+  TEST_ASSERT_EQUAL(heartbeats, mock::bleNotifications(BLE_UUID_AGTRON).size());
+  TEST_ASSERT_EQUAL_UINT8(STATE_MEASURED, notifiedValue<uint8_t>(mock::bleNotifications(BLE_UUID_METER_STATE).back()));
+
+  mock::particleSensor().irLevel = IR_UNLOADED;
+  TEST_ASSERT_TRUE(central.write(BLE_UUID_NOTIFY_HEARTBEAT, heartbeat));
+  TEST_ASSERT_TRUE(central.unsubscribe(BLE_UUID_AGTRON));
+}
+
+void assertConnectionProfile(uint8_t profile, const mock::BLEConnectionUpdate &update) {
+  const BLEConnectionProfile &parameters = bleConnectionProfiles[profile];
+  TEST_ASSERT_EQUAL_INT(0, update.status);
+  TEST_ASSERT_EQUAL_UINT16(parameters.minInterval, update.minInterval);
+  TEST_ASSERT_EQUAL_UINT16(parameters.maxInterval, update.maxInterval);
+  TEST_ASSERT_EQUAL_UINT16(parameters.latency, update.latency);
+  TEST_ASSERT_EQUAL_UINT16(parameters.supervisionTimeout, update.supervisionTimeout);
+  TEST_ASSERT_EQUAL_UINT8(profile, bleProfile);
+}
+
+void test_connection_profile_follows_activity() {
+  // Idle since connecting, so slow once the central settled
+  std::vector<mock::BLEConnectionUpdate> updates = mock::bleConnectionUpdates();
+  TEST_ASSERT_GREATER_THAN(0, updates.size());
+  assertConnectionProfile(BLE_PROFILE_SLOW, updates.back());
+
+  // Streaming asks for fast, which the central refuses. The connection stays
+  // slow and its time is booked there, and the request is not repeated on
+  // every pass.
+  mock::bleSetConnectionUpdateStatus(0x0C);
+  size_t requests = updates.size();
+  uint32_t slowMs = bleConnectionStats.profiles[BLE_PROFILE_SLOW].activeMs;
+  uint32_t fastMs = bleConnectionStats.profiles[BLE_PROFILE_FAST].activeMs;
+  TEST_ASSERT_TRUE(central.write(BLE_UUID_RAW_STREAM_RATE, (uint16_t)50));
+  delay(BLE_PROFILE_RETRY_MS / 2);
+
+  updates = mock::bleConnectionUpdates();
+  TEST_ASSERT_EQUAL(requests + 1, updates.size());
+  TEST_ASSERT_EQUAL_INT(0x0C, updates.back().status);
+  TEST_ASSERT_EQUAL_UINT16(bleConnectionProfiles[BLE_PROFILE_FAST].maxInterval, updates.back().maxInterval);
+  TEST_ASSERT_EQUAL_UINT8(BLE_PROFILE_SLOW, bleProfile);
+  TEST_ASSERT_GREATER_THAN(slowMs, bleConnectionStats.profiles[BLE_PROFILE_SLOW].activeMs);
+  TEST_ASSERT_EQUAL_UINT32(fastMs, bleConnectionStats.profiles[BLE_PROFILE_FAST].activeMs);
+
+  // Asked again after BLE_PROFILE_RETRY_MS, and accepted this time
+  mock::bleSetConnectionUpdateStatus(0);
+  unsigned long start = millis();
+  while (bleProfile != BLE_PROFILE_FAST && millis() - start < BLE_PROFILE_RETRY_MS + 500) delay(10);
+  updates = mock::bleConnectionUpdates();
+  TEST_ASSERT_EQUAL(requests + 2, updates.size());
+  assertConnectionProfile(BLE_PROFILE_FAST, updates.back());
+
+  // Back to slow once streaming has been off for BLE_PROFILE_IDLE_MS
+  TEST_ASSERT_TRUE(central.write(BLE_UUID_RAW_STREAM_RATE, (uint16_t)0));
+  start = millis();
+  while (bleProfile != BLE_PROFILE_SLOW && millis() - start < BLE_PROFILE_IDLE_MS + 1000) delay(10);
+  TEST_ASSERT_GREATER_OR_EQUAL(BLE_PROFILE_IDLE_MS, millis() - start);
+  assertConnectionProfile(BLE_PROFILE_SLOW, mock::bleConnectionUpdates().back());
+}
+
+void test_advertising_carries_locked_reading() {
+  // A fresh sample, locked once it settles
+  mock::particleSensor().irLevel = IR_UNLOADED;
+  delay(500);
+  uint16_t sequence = lockedReadingSequence;
+  mock::particleSensor().irLevel = IR_LOADED;
+  unsigned long start = millis();
+  while (lockedReadingSequence == sequence && millis() - start < 10000) delay(10);
+  TEST_ASSERT_EQUAL_UINT16(sequence + 1, lockedReadingSequence);
+  delay(ADVERTISING_MIN_INTERVAL_MS + 300);
+
+  // uint8 version << 4 | state, int16 centi-Agtron, uint8 battery %, uint16
+  // sequence, little endian
+  mock::BLEAdvertisement advertisement = mock::bleAdvertisement();
+  const std::vector<uint8_t> &data = advertisement.manufacturerData;
+  TEST_ASSERT_EQUAL_UINT16(ADVERTISING_COMPANY_ID, advertisement.companyId);
+  TEST_ASSERT_EQUAL(6, data.size());
+  TEST_ASSERT_EQUAL_UINT8(ADVERTISING_PAYLOAD_VERSION << 4 | STATE_MEASURED, data[0]);
+  // Locked while the filter is still within LOCK_TOLERANCE of the level
+  TEST_ASSERT_INT_WITHIN(LOCK_TOLERANCE * MEASUREMENT_AGTRON_SCALE, lroundf(mapIRToAgtron(IR_LOADED) * MEASUREMENT_AGTRON_SCALE), (int16_t)(data[1] | data[2] << 8));
+  TEST_ASSERT_EQUAL_UINT8(lroundf(fuelGuageSOC), data[3]);
+  TEST_ASSERT_EQUAL_UINT16(sequence + 1, data[4] | data[5] << 8);
+
+  // Flags (3 bytes), the 128-bit service UUID (18) and the manufacturer data
+  // with its length, type and company ID (4) fill the 31 byte packet
+  TEST_ASSERT_EQUAL(31, 3 + 18 + 4 + data.size());
+
+  // Unloading changes only the state; the reading stays until the next lock
+  mock::particleSensor().irLevel = IR_UNLOADED;
+  delay(ADVERTISING_MIN_INTERVAL_MS + 500);
+  std::vector<uint8_t> unloaded = mock::bleAdvertisement().manufacturerData;
+  TEST_ASSERT_EQUAL_UINT8(ADVERTISING_PAYLOAD_VERSION << 4 | STATE_READY, unloaded[0]);
+  TEST_ASSERT_EQUAL_MEMORY(data.data() + 1, unloaded.data() + 1, data.size() - 1);
+  TEST_ASSERT_GREATER_THAN(advertisement.count, mock::bleAdvertisement().count);
+}
+
+void test_wifi_starts_on_demand() {
+  // Nothing is listening until asked for
+  TEST_ASSERT_FALSE(WiFi.getMode() & WIFI_AP);
+  TEST_ASSERT_EQUAL_INT(-1, server.request("/", {}, 200));
+
+  mock::bleClearNotifications();
+  TEST_ASSERT_TRUE(central.subscribe(BLE_UUID_WIFI));
+  TEST_ASSERT_TRUE(central.write(BLE_UUID_WIFI, (uint8_t)WIFI_STATE_ON));
+  TEST_ASSERT_TRUE(waitForNotification(BLE_UUID_WIFI, 1000));
+  TEST_ASSERT_EQUAL_UINT8(WIFI_STATE_ON, notifiedValue<uint8_t>(mock::bleNotifications(BLE_UUID_WIFI).back()));
+  TEST_ASSERT_TRUE(WiFi.getMode() & WIFI_AP);
+  TEST_ASSERT_EQUAL_INT(200, readResponse(server.request("/")).code);
+
+  // A long press turns it off again, a short one does nothing
+  mock::pinLevels()[WIFI_BUTTON_PIN] = LOW;
+  delay(WIFI_BUTTON_HOLD_MS / 2);
+  mock::pinLevels()[WIFI_BUTTON_PIN] = HIGH;
+  delay(500);
+  TEST_ASSERT_TRUE(WiFi.getMode() & WIFI_AP);
+
+  mock::bleClearNotifications();
+  mock::pinLevels()[WIFI_BUTTON_PIN] = LOW;
+  delay(WIFI_BUTTON_HOLD_MS + 500);
+  mock::pinLevels()[WIFI_BUTTON_PIN] = HIGH;
+  TEST_ASSERT_TRUE(waitForNotification(BLE_UUID_WIFI, 1000));
+  TEST_ASSERT_EQUAL_UINT8(WIFI_STATE_OFF, notifiedValue<uint8_t>(mock::bleNotifications(BLE_UUID_WIFI).back()));
+  TEST_ASSERT_FALSE(WiFi.getMode() & WIFI_AP);
+
+  // Left on for the web tests that follow
+  TEST_ASSERT_TRUE(central.write(BLE_UUID_WIFI, (uint8_t)WIFI_STATE_ON));
+  TEST_ASSERT_TRUE(central.unsubscribe(BLE_UUID_WIFI));
+  delay(500);
+  TEST_ASSERT_TRUE(isWifiOn);
+}
+
+void test_only_flashing_stops_measuring() {
+  TEST_ASSERT_TRUE(central.subscribe(BLE_UUID_MEASUREMENT));
+  mock::particleSensor().irLevel = IR_LOADED;
+
+  // A phone joining the AP used to freeze the meter
+  mock::wifiStations() = 1;
+  delay(500);
+  mock::bleClearNotifications();
+  delay(1000);
+  size_t joinedRecords = measurementRecords().size();
+
+  mock::updateRunning() = true;
+  delay(500);
+  mock::bleClearNotifications();
+  delay(1000);
+  size_t flashingRecords = measurementRecords().size();
+
+  mock::updateRunning() = false;
+  mock::wifiStations() = 0;
+  TEST_ASSERT_TRUE(central.unsubscribe(BLE_UUID_MEASUREMENT));
+
+  TEST_ASSERT_GREATER_THAN(0, joinedRecords);
+  TEST_ASSERT_EQUAL(0, flashingRecords);
+}
+
+void test_live_events_stream_measurements() {
+  mock::particleSensor().irLevel = IR_LOADED;
+  int browsers[2] = { server.request("/events"), server.request("/events") };
+  TEST_ASSERT_GREATER_OR_EQUAL(0, browsers[0]);
+  TEST_ASSERT_GREATER_OR_EQUAL(0, browsers[1]);
+  TEST_ASSERT_EQUAL_UINT8(2, eventsClientCount);
+
+  delay(1500);
+  for (int browser : browsers) {
+    std::vector<MeasurementRecord> records;
+    for (auto &frame : eventFrames(browser)) {
+      TEST_ASSERT_EQUAL_UINT8(MEASUREMENT_FRAME_VERSION, frame[0]);
+      TEST_ASSERT_EQUAL(MEASUREMENT_FRAME_HEADER_LENGTH + frame[1] * sizeof(MeasurementRecord), frame.size());
+
+      for (int i = 0; i < frame[1]; i++) {
+        MeasurementRecord record;
+        memcpy(&record, frame.data() + MEASUREMENT_FRAME_HEADER_LENGTH + i * sizeof(MeasurementRecord), sizeof(MeasurementRecord));
+        records.push_back(record);
+      }
+    }
+
+    TEST_ASSERT_GREATER_OR_EQUAL(5, records.size());
+    for (size_t i = 1; i < records.size(); i++) {
+      TEST_ASSERT_EQUAL_UINT32(records[i - 1].sequence + 1, records[i].sequence);
+      TEST_ASSERT_EQUAL_UINT32(IR_LOADED, records[i].rawIR);
+    }
+  }
+
+  // A browser that goes away is dropped, the other keeps its stream
+  close(browsers[0]);
+  delay(500);
+  TEST_ASSERT_EQUAL_UINT8(1, eventsClientCount);
+
+  close(browsers[1]);
+  delay(500);
+  TEST_ASSERT_EQUAL_UINT8(0, eventsClientCount);
+}
+
+void test_log_export() {
+  // A session of its own, well past any the firmware has used
+  const uint16_t session = logSession + 100;
+  const uint32_t firstIndex = logRecordCount;
+  for (uint32_t i = 0; i < 40; i++) {
+    LogRecord record = { 1700000000 + i, 50000 + i, (int16_t)(4000 + i), session, 0, LOG_FLAG_TIME_SYNCED, 0 };
+    record.crc = crc16((const uint8_t *)&record, offsetof(LogRecord, crc));
+    TEST_ASSERT_EQUAL_UINT32(1, writeLogRecords(&record, 1));
+  }
+
+  char uri[64];
+  snprintf(uri, sizeof(uri), "/log.csv?session=%u", session);
+  HTTPResponse csv = readResponse(server.request(uri));
+  TEST_ASSERT_EQUAL_INT(200, csv.code);
+  TEST_ASSERT_TRUE(csv.body.rfind(LOG_EXPORT_CSV_HEADER, 0) == 0);
+  TEST_ASSERT_EQUAL(41, std::count(csv.body.begin(), csv.body.end(), '\n'));
+
+  char line[LOG_EXPORT_LINE_MAX_LENGTH];
+  snprintf(line, sizeof(line), "\n%lu,1700000039,1,%u,0,50039,40.39\n", (unsigned long)firstIndex + 39, session);
+  TEST_ASSERT_TRUE(csv.body.find(line) != std::string::npos);
+
+  // Resume part way, as after a dropped connection
+  snprintf(uri, sizeof(uri), "/log.ndjson?session=%u", session);
+  snprintf(line, sizeof(line), "records=%lu-", (unsigned long)firstIndex + 30);
+  HTTPResponse json = readResponse(server.request(uri, { { "Range", line } }));
+  TEST_ASSERT_EQUAL_INT(206, json.code);
+  snprintf(line, sizeof(line), "Content-Range: records %lu-%lu/%lu", (unsigned long)firstIndex + 30, (unsigned long)firstIndex + 39, (unsigned long)logRecordCount);
+  TEST_ASSERT_TRUE(json.headers.find(line) != std::string::npos);
+  TEST_ASSERT_EQUAL(10, std::count(json.body.begin(), json.body.end(), '\n'));
+  snprintf(line, sizeof(line), "{\"index\":%lu,\"time\":1700000030,", (unsigned long)firstIndex + 30);
+  TEST_ASSERT_TRUE(json.body.rfind(line, 0) == 0);
+
+  snprintf(line, sizeof(line), "records=%lu-", (unsigned long)logRecordCount);
+  TEST_ASSERT_EQUAL_INT(416, readResponse(server.request(uri, { { "Range", line } })).code);
+
+  // The newest few, as the dashboard's chart asks for
+  snprintf(uri, sizeof(uri), "/log.ndjson?session=%u&last=5", session);
+  json = readResponse(server.request(uri));
+  TEST_ASSERT_EQUAL(5, std::count(json.body.begin(), json.body.end(), '\n'));
+  snprintf(line, sizeof(line), "{\"index\":%lu,", (unsigned long)firstIndex + 35);
+  TEST_ASSERT_TRUE(json.body.rfind(line, 0) == 0);
+
+  // Never moved back before a resume point past the end
+  snprintf(uri, sizeof(uri), "/log.ndjson?session=%u&start=%lu&last=5", session, (unsigned long)logRecordCount + 10);
+  json = readResponse(server.request(uri));
+  TEST_ASSERT_EQUAL_INT(200, json.code);
+  TEST_ASSERT_TRUE(json.body.empty());
+}
+
+void test_dashboard_is_served_gzipped() {
+  HTTPResponse page = readResponse(server.request("/"));
+  TEST_ASSERT_EQUAL_INT(200, page.code);
+  TEST_ASSERT_TRUE(page.headers.find("Content-Encoding: gzip\r\n") != std::string::npos);
+  TEST_ASSERT_TRUE(page.headers.find("ETag: " DASHBOARD_INDEX_ETAG "\r\n") != std::string::npos);
+  TEST_ASSERT_EQUAL(DASHBOARD_INDEX_GZIP_LENGTH, page.body.size());
+  std::string html = gunzipBody(page.body);
+  TEST_ASSERT_TRUE(html.find("<script src=\"" DASHBOARD_SCRIPT_PATH "\">") != std::string::npos);
+
+  // A reload only revalidates
+  HTTPResponse reload = readResponse(server.request("/", { { "If-None-Match", DASHBOARD_INDEX_ETAG } }));
+  TEST_ASSERT_EQUAL_INT(304, reload.code);
+  TEST_ASSERT_TRUE(reload.body.empty());
+
+  HTTPResponse script = readResponse(server.request(DASHBOARD_SCRIPT_PATH));
+  TEST_ASSERT_EQUAL_INT(200, script.code);
+  TEST_ASSERT_TRUE(script.headers.find("max-age=31536000") != std::string::npos);
+  TEST_ASSERT_TRUE(gunzipBody(script.body).find("EventSource('/events')") != std::string::npos);
+
+  HTTPResponse settings = readResponse(server.request("/settings"));
+  TEST_ASSERT_EQUAL_INT(200, settings.code);
+  std::string name = "\"bleName\":\"" + std::string(bleName.c_str()) + "\"";
+  TEST_ASSERT_TRUE(settings.body.find(name) != std::string::npos);
+
+  // Saved through the BLE task like a settings blob write
+  uint16_t heartbeat = notifyHeartbeat;
+  float previousDeviation = deviation;
+  TEST_ASSERT_EQUAL_INT(202, readResponse(server.post("/settings", "notifyHeartbeat=7&deviation=0.25")).code);
+  delay(200);
+  TEST_ASSERT_EQUAL_UINT16(7, notifyHeartbeat);
+  TEST_ASSERT_TRUE(deviation == 0.25f);
+  TEST_ASSERT_TRUE(readResponse(server.request("/settings")).body.find("\"notifyHeartbeat\":7,") != std::string::npos);
+
+  TEST_ASSERT_EQUAL_INT(400, readResponse(server.post("/settings", "notifyHeartbeat=0")).code);
+  TEST_ASSERT_EQUAL_INT(400, readResponse(server.post("/settings", "ledBrightness=300")).code);
+  TEST_ASSERT_EQUAL_UINT16(7, notifyHeartbeat);
+
+  const char *badFloats[] = { "deviation=abc", "deviation=", "coefficient0=inf", "agtronDeadband=nan",
+                              "irOffset=1.5x", "coefficient2=1e30", "agtronDeadband=-1" };
+  for (const char *body : badFloats) {
+    TEST_ASSERT_EQUAL_INT(400, readResponse(server.post("/settings", body)).code);
+  }
+  delay(200);
+  TEST_ASSERT_TRUE(deviation == 0.25f);
+
+  char restore[64];
+  snprintf(restore, sizeof(restore), "notifyHeartbeat=%u&deviation=%.9g", heartbeat, previousDeviation);
+  TEST_ASSERT_EQUAL_INT(202, readResponse(server.post("/settings", restore)).code);
+  delay(200);
+  TEST_ASSERT_EQUAL_UINT16(heartbeat, notifyHeartbeat);
+  TEST_ASSERT_TRUE(deviation == previousDeviation);
+}
+
+void test_metrics_are_exported() {
+  HTTPResponse first = readResponse(server.request("/metrics"));
+  TEST_ASSERT_EQUAL_INT(200, first.code);
+  TEST_ASSERT_TRUE(first.body.find("# TYPE roastmeter_loop_iterations_total counter\n") != std::string::npos);
+  TEST_ASSERT_EQUAL_UINT32(ESP.getFreeHeap(), (uint32_t)metricValue(first.body, "roastmeter_heap_free_bytes"));
+  TEST_ASSERT_EQUAL_UINT32(ESP.getMaxAllocHeap(), (uint32_t)metricValue(first.body, "roastmeter_heap_largest_free_block_bytes"));
+  TEST_ASSERT_GREATER_THAN(0, metricValue(first.body, "roastmeter_settings_commits_total"));
+  TEST_ASSERT_GREATER_THAN(0, metricValue(first.body, "roastmeter_log_records_written_total"));
+  TEST_ASSERT_TRUE(metricValue(first.body, "roastmeter_i2c_errors_total") == 0);
+  TEST_ASSERT_TRUE(fabs(metricValue(first.body, "roastmeter_battery_volts") - 3.9) < 0.001);
+
+  // Streamed, every family whole: HELP, TYPE and the sample
+  TEST_ASSERT_TRUE(first.headers.find("Transfer-Encoding: chunked") != std::string::npos);
+  int families = 0;
+  for (size_t help = first.body.find("# HELP "); help != std::string::npos; help = first.body.find("# HELP ", help + 1)) {
+    std::string name = first.body.substr(help + 7, first.body.find(' ', help + 7) - help - 7);
+    size_t type = first.body.find('\n', help) + 1;
+    TEST_ASSERT_TRUE(first.body.compare(type, 7 + name.size() + 1, "# TYPE " + name + " ") == 0);
+    size_t sample = first.body.find('\n', type) + 1;
+    TEST_ASSERT_TRUE(first.body.compare(sample, name.size() + 1, name + " ") == 0);
+    TEST_ASSERT_NOT_EQUAL(std::string::npos, first.body.find('\n', sample));
+    families++;
+  }
+  TEST_ASSERT_EQUAL_INT(18, families);
+
+  delay(1000);
+  HTTPResponse second = readResponse(server.request("/metrics"));
+  double samples = metricValue(second.body, "roastmeter_samples_total") - metricValue(first.body, "roastmeter_samples_total");
+  TEST_ASSERT_GREATER_OR_EQUAL(3, samples);
+  TEST_ASSERT_GREATER_THAN(samples, metricValue(second.body, "roastmeter_loop_iterations_total") - metricValue(first.body, "roastmeter_loop_iterations_total"));
+
+  // The same counters over BLE
+  DeviceMetrics metrics;
+  TEST_ASSERT_TRUE(central.read(BLE_UUID_METRICS, metrics));
+  TEST_ASSERT_EQUAL_UINT8(METRICS_VERSION, metrics.version);
+  TEST_ASSERT_GREATER_OR_EQUAL(metricValue(first.body, "roastmeter_samples_total"), metrics.sampleCount);
+  TEST_ASSERT_EQUAL_UINT32(ESP.getFreeHeap(), metrics.freeHeap);
+  TEST_ASSERT_EQUAL_UINT16(3900, metrics.batteryMillivolts);
+  TEST_ASSERT_EQUAL_UINT8(79, metrics.batterySOC);
+}
+
+void test_fuel_gauge_never_blocks() {
+  // Quick started on the cold boot and read since
+  TEST_ASSERT_EQUAL_INT(1, fuelGauge.quickStarts);
+  TEST_ASSERT_EQUAL_FLOAT(3.9f, fuelGuageVoltage);
+  TEST_ASSERT_EQUAL_FLOAT(78.5f, fuelGuageSOC);
+
+  // The gauge drops off the bus as a reading falls due
+  fuelGauge.set(MAX17043_VCELL, 0xB900);  // 3.7V
+  fuelGauge.set(MAX17043_SOC, 0x3C00);    // 60%
+  mock::i2cDevice(MAX1704x_ADDRESS) = nullptr;
+  uint32_t errors = metricsCounters.i2cErrors;
+  uint32_t samples = metricsCounters.sampleCount;
+  fuelGuageDueMillis = millis();
+
+  delay(1000);
+
+  // Retried after 0, 100, 300 and 700ms, sampling on time throughout, and
+  // the last reading kept
+  TEST_ASSERT_EQUAL_UINT32(errors + 4, metricsCounters.i2cErrors);
+  TEST_ASSERT_GREATER_OR_EQUAL(1000 / MEASUREMENT_INTERVAL_MS - 1, metricsCounters.sampleCount - samples);
+  TEST_ASSERT_EQUAL_FLOAT(3.9f, fuelGuageVoltage);
+
+  // Back on the bus, the next retry completes a reading, voltage and SOC in
+  // a single transaction
+  int reads = fuelGauge.reads;
+  mock::i2cDevice(MAX1704x_ADDRESS) = &fuelGauge;
+  unsigned long start = millis();
+  while (fuelGuageSOC != 60.0f && millis() - start < 2000) delay(10);
+  TEST_ASSERT_EQUAL_FLOAT(3.7f, fuelGuageVoltage);
+  TEST_ASSERT_EQUAL_FLOAT(60.0f, fuelGuageSOC);
+  TEST_ASSERT_EQUAL_INT(reads + 1, fuelGauge.reads);
+  TEST_ASSERT_EQUAL_UINT32(FUEL_GUAGE_BACKOFF_MIN_MS, fuelGuageBackoffMs);
+  TEST_ASSERT_EQUAL_INT(1, fuelGauge.quickStarts);
+}
+
+void test_compressed_firmware_update() {
+  // Compresses about as well as firmware does, to many upload buffers
+  std::vector<uint8_t> image(300 * 1024);
+  srand(3);
+  for (size_t i = 0; i < image.size(); i++) image[i] = rand() % 16;
+  std::string compressed = gzipImage(image);
+
+  int restarts = mock::restartCount();
+  HTTPResponse response = readResponse(server.upload("/update.gz", compressed, "firmware.bin.gz"));
+  TEST_MESSAGE(response.body.c_str());
+  TEST_ASSERT_EQUAL_INT(200, response.code);
+  TEST_ASSERT_TRUE(mock::updateImage() == image);
+
+  delay(OTA_RESTART_DELAY_MS + 200);
+  TEST_ASSERT_EQUAL_INT(restarts + 1, mock::restartCount());
+
+  // A flipped bit in the trailer must not switch partitions
+  compressed[compressed.size() - OTA_GZIP_TRAILER_LENGTH] ^= 1;
+  response = readResponse(server.upload("/update.gz", compressed, "firmware.bin.gz"));
+  TEST_ASSERT_EQUAL_INT(400, response.code);
+  TEST_ASSERT_TRUE(response.body.find("checksum") != std::string::npos);
+  TEST_ASSERT_TRUE(mock::updateImage().empty());
+  TEST_ASSERT_FALSE(Update.isRunning());
+
+  delay(OTA_RESTART_DELAY_MS + 200);
+  TEST_ASSERT_EQUAL_INT(restarts + 1, mock::restartCount());
+}
+
+void test_mqtt_drains_offline_readings() {
+  // Readings locked while the roastery network is out of reach wait in the log
+  mock::mqttBrokerOnline() = true;
+  const uint32_t firstIndex = logRecordCount;
+  for (int i = 0; i < 40; i++) appendLogRecord(40.0f + i, 60000 + i);
+  delay(500);
+  {
+    std::lock_guard<std::mutex> lock(mock::mqttMutex());
+    TEST_ASSERT_EQUAL(0, mock::mqttMessages().size());
+  }
+
+  // Full batches go at once, the rest after MQTT_BATCH_INTERVAL_MS
+  uint32_t cursorSaves = mqttCursorSaveCount;
+  mock::wifiConnected() = true;
+  unsigned long start = millis();
+  while (mqttPublishedIndex < logRecordCount && millis() - start < MQTT_BATCH_INTERVAL_MS + 1000) delay(10);
+  TEST_ASSERT_EQUAL_UINT32(logRecordCount, mqttPublishedIndex);
+
+  // The cursor on flash is not rewritten for every message, and never falls
+  // more than MQTT_CURSOR_SAVE_RECORDS behind
+  TEST_ASSERT_LESS_OR_EQUAL(cursorSaves + 1, mqttCursorSaveCount);
+  TEST_ASSERT_LESS_THAN(MQTT_CURSOR_SAVE_RECORDS, mqttPublishedIndex - loadMqttCursor());
+  TEST_ASSERT_EQUAL_UINT32(mqttSavedIndex, loadMqttCursor());
+
+  // In batches, each record once and in order
+  std::vector<mock::MqttMessage> messages;
+  {
+    std::lock_guard<std::mutex> lock(mock::mqttMutex());
+    messages = mock::mqttMessages();
+  }
+  uint32_t publishedIndex = 0;
+  uint32_t nextIndex = 0;
+  for (const mock::MqttMessage &message : messages) {
+    TEST_ASSERT_EQUAL_STRING(mqttTopic.c_str(), message.topic.c_str());
+    size_t lines = std::count(message.payload.begin(), message.payload.end(), '\n');
+    TEST_ASSERT_LESS_OR_EQUAL(MQTT_BATCH_RECORDS, lines);
+
+    unsigned long index;
+    TEST_ASSERT_EQUAL_INT(1, sscanf(message.payload.c_str(), "{\"index\":%lu,", &index));
+    if (nextIndex > 0) TEST_ASSERT_EQUAL_UINT32(nextIndex, index);
+    if (nextIndex == 0) publishedIndex = index;
+    nextIndex = index + lines;
+  }
+  TEST_ASSERT_GREATER_OR_EQUAL(firstIndex + 40, nextIndex);
+  TEST_ASSERT_LESS_OR_EQUAL((nextIndex - publishedIndex + MQTT_BATCH_RECORDS - 1) / MQTT_BATCH_RECORDS + 1, messages.size());
+
+  char line[LOG_EXPORT_LINE_MAX_LENGTH];
+  snprintf(line, sizeof(line), "{\"index\":%lu,", (unsigned long)firstIndex + 39);
+  auto last = std::find_if(messages.begin(), messages.end(), [&](const mock::MqttMessage &message) { return message.payload.find(line) != std::string::npos; });
+  TEST_ASSERT_TRUE(last != messages.end());
+  TEST_ASSERT_TRUE(last->payload.find("\"raw_ir\":60039,\"agtron\":79.00}") != std::string::npos);
+
+  // A record torn by a power loss is skipped, as the export skips it
+  const uint32_t tornIndex = logRecordCount;
+  LogRecord torn = { 1700000000, 61000, 4000, logSession, 0, LOG_FLAG_TIME_SYNCED, 0 };
+  torn.crc = crc16((const uint8_t *)&torn, offsetof(LogRecord, crc)) ^ 1;
+  TEST_ASSERT_EQUAL_UINT32(1, writeLogRecords(&torn, 1));
+  appendLogRecord(41.0f, 61001);
+
+  start = millis();
+  while (mqttPublishedIndex <= tornIndex + 1 && millis() - start < MQTT_BATCH_INTERVAL_MS + 1000) delay(10);
+  TEST_ASSERT_GREATER_THAN(tornIndex + 1, mqttPublishedIndex);
+  {
+    std::lock_guard<std::mutex> lock(mock::mqttMutex());
+    messages = mock::mqttMessages();
+  }
+  snprintf(line, sizeof(line), "{\"index\":%lu,", (unsigned long)tornIndex);
+  for (const mock::MqttMessage &message : messages) {
+    TEST_ASSERT_TRUE(message.payload.find(line) == std::string::npos);
+    TEST_ASSERT_TRUE(message.payload.find("\"raw_ir\":61000,") == std::string::npos);
+  }
+  TEST_ASSERT_TRUE(messages.back().payload.find("\"raw_ir\":61001,") != std::string::npos);
+}
+
+void test_raw_stream_throughput() {
+  const uint16_t rate = 200;
+  const unsigned long windowMs = 2000;
+
+  TEST_ASSERT_TRUE(central.subscribe(BLE_UUID_RAW_STREAM));
+  TEST_ASSERT_TRUE(central.write(BLE_UUID_RAW_STREAM_RATE, rate));
+  delay(300);
+  mock::bleClearNotifications();
+
+  delay(windowMs);
+  std::vector<mock::BLENotification> frames = mock::bleNotifications(BLE_UUID_RAW_STREAM);
+  TEST_ASSERT_TRUE(central.write(BLE_UUID_RAW_STREAM_RATE, (uint16_t)0));
+
+  // The IR channel of every sample, never the Red one ahead of it
+  size_t samples = 0;
+  size_t bytes = 0;
+  for (auto &frame : frames) {
+    TEST_ASSERT_LESS_OR_EQUAL(central.mtu() - 3, frame.value.size());
+    std::vector<uint32_t> values = rawStreamSamples(frame);
+    TEST_ASSERT_EQUAL(frame.value[4], values.size());
+    for (uint32_t value : values) TEST_ASSERT_EQUAL_UINT32(mock::particleSensor().irLevel, value);
+
+    samples += frame.value[4];
+    bytes += frame.value.size();
+  }
+
+  char message[120];
+  snprintf(message, sizeof(message), "raw stream: %u samples/s in %u frames/s, %u B/s", (unsigned)(samples * 1000 / windowMs),
+           (unsigned)(frames.size() * 1000 / windowMs), (unsigned)(bytes * 1000 / windowMs));
+  TEST_MESSAGE(message);
+
+  size_t expected = rate * windowMs / 1000;
+  TEST_ASSERT_UINT_WITHIN(expected / 4, expected, samples);
+
+  TEST_ASSERT_TRUE(central.unsubscribe(BLE_UUID_RAW_STREAM));
+}
+
+// Adds the records of every log data chunk to received, by index, and
+// returns whether the transfer has ended with an empty chunk
+bool readLogChunks(std::map<uint32_t, std::vector<LogRecord>> &received) {
+  bool isEnded = false;
+  for (auto &chunk : mock::bleNotifications(BLE_UUID_LOG_DATA)) {
+    TEST_ASSERT_GREATER_OR_EQUAL(LOG_DATA_HEADER_LENGTH, chunk.value.size());
+    uint32_t index;
+    memcpy(&index, chunk.value.data(), sizeof(uint32_t));
+    uint8_t count = chunk.value[4];
+    TEST_ASSERT_EQUAL(LOG_DATA_HEADER_LENGTH + count * sizeof(LogRecord), chunk.value.size());
+    TEST_ASSERT_LESS_OR_EQUAL(central.mtu() - 3, chunk.value.size());
+
+    if (count == 0) isEnded = true;
+    for (int i = 0; i < count; i++) {
+      LogRecord record;
+      memcpy(&record, chunk.value.data() + LOG_DATA_HEADER_LENGTH + i * sizeof(LogRecord), sizeof(LogRecord));
+      received[index + i].push_back(record);
+    }
+  }
+  return isEnded;
+}
+
+void startLogDownload(uint32_t index) {
+  uint8_t command[5] = { LOG_COMMAND_START_TRANSFER };
+  memcpy(command + 1, &index, sizeof(uint32_t));
+  TEST_ASSERT_TRUE(central.write(BLE_UUID_LOG_CONTROL, command, sizeof(command)));
+}
+
+void test_log_download_resumes() {
+  // Enough records to take a few hundred chunks
+  const uint32_t firstIndex = logRecordCount;
+  const uint32_t recordCount = 3000;
+  for (uint32_t i = 0; i < recordCount; i++) {
+    LogRecord record = { 1700000000 + i, 90000 + i, (int16_t)(5000 + i), logSession, 0, LOG_FLAG_TIME_SYNCED, 0 };
+    record.crc = crc16((const uint8_t *)&record, offsetof(LogRecord, crc));
+    TEST_ASSERT_EQUAL_UINT32(1, writeLogRecords(&record, 1));
+  }
+  const uint32_t endIndex = logRecordCount;
+
+  mock::bleClearNotifications();
+  TEST_ASSERT_TRUE(central.subscribe(BLE_UUID_LOG_DATA));
+  startLogDownload(firstIndex);
+
+  // The connection drops part way through
+  unsigned long start = millis();
+  while (mock::bleNotifications(BLE_UUID_LOG_DATA).size() < 20 && millis() - start < 2000) delay(1);
+  TEST_ASSERT_TRUE(central.disconnect());
+  TEST_ASSERT_FALSE(isLogTransferring);
+
+  std::map<uint32_t, std::vector<LogRecord>> received;
+  TEST_ASSERT_FALSE(readLogChunks(received));
+  TEST_ASSERT_GREATER_THAN(0, received.size());
+  TEST_ASSERT_LESS_THAN(recordCount, received.size());
+
+  // Picks up from the first record it has not received
+  uint32_t resumeIndex = received.rbegin()->first + 1;
+  mock::bleClearNotifications();
+  TEST_ASSERT_TRUE(central.connect());
+  TEST_ASSERT_TRUE(central.subscribe(BLE_UUID_LOG_DATA));
+  startLogDownload(resumeIndex);
+
+  bool isEnded = false;
+  start = millis();
+  while (!isEnded && millis() - start < 5000) {
+    delay(10);
+    isEnded = !mock::bleNotifications(BLE_UUID_LOG_DATA).empty() && mock::bleNotifications(BLE_UUID_LOG_DATA).back().value[4] == 0;
+  }
+  TEST_ASSERT_TRUE(readLogChunks(received));
+
+  // Every record once, intact and in place
+  TEST_ASSERT_EQUAL_UINT32(firstIndex, received.begin()->first);
+  TEST_ASSERT_EQUAL_UINT32(endIndex - 1, received.rbegin()->first);
+  TEST_ASSERT_EQUAL(endIndex - firstIndex, received.size());
+  for (auto &entry : received) {
+    TEST_ASSERT_EQUAL(1, entry.second.size());
+    const LogRecord &record = entry.second[0];
+    TEST_ASSERT_EQUAL_UINT16(crc16((const uint8_t *)&record, offsetof(LogRecord, crc)), record.crc);
+    TEST_ASSERT_EQUAL_UINT32(90000 + entry.first - firstIndex, record.rawIR);
+  }
+
+  TEST_ASSERT_TRUE(central.unsubscribe(BLE_UUID_LOG_DATA));
+}
+
+void test_log_erase_keeps_indexes() {
+  // Everything so far has reached the broker
+  mock::mqttBrokerOnline() = true;
+  mock::wifiConnected() = true;
+  unsigned long start = millis();
+  while (mqttPublishedIndex < logRecordCount && millis() - start < MQTT_RECONNECT_INTERVAL_MS + MQTT_BATCH_INTERVAL_MS + 1000) delay(10);
+  const uint32_t endIndex = logRecordCount;
+  TEST_ASSERT_EQUAL_UINT32(endIndex, mqttPublishedIndex);
+
+  uint8_t command = LOG_COMMAND_ERASE;
+  TEST_ASSERT_TRUE(central.write(BLE_UUID_LOG_CONTROL, &command, sizeof(command)));
+  start = millis();
+  while (logFirstIndex < endIndex && millis() - start < 1000) delay(10);
+  TEST_ASSERT_EQUAL_UINT32(endIndex, logFirstIndex);
+  TEST_ASSERT_EQUAL_UINT32(endIndex, logRecordCount);
+
+  // The broker and the central both drop off while new readings are logged
+  mock::mqttBrokerOnline() = false;
+  TEST_ASSERT_TRUE(central.disconnect());
+  for (int i = 0; i < 10; i++) appendLogRecord(45.0f, 70000 + i);
+  start = millis();
+  while (logRecordCount < endIndex + 10 && millis() - start < 1000) delay(10);
+  TEST_ASSERT_EQUAL_UINT32(endIndex + 10, logRecordCount);
+
+  // Once back, MQTT carries on with the first new reading
+  {
+    std::lock_guard<std::mutex> lock(mock::mqttMutex());
+    mock::mqttMessages().clear();
+  }
+  mock::mqttBrokerOnline() = true;
+  start = millis();
+  while (mqttPublishedIndex < endIndex + 10 && millis() - start < MQTT_RECONNECT_INTERVAL_MS + MQTT_BATCH_INTERVAL_MS + 1000) delay(10);
+  TEST_ASSERT_EQUAL_UINT32(endIndex + 10, mqttPublishedIndex);
+  {
+    std::lock_guard<std::mutex> lock(mock::mqttMutex());
+    TEST_ASSERT_GREATER_THAN(0, mock::mqttMessages().size());
+    char line[LOG_EXPORT_LINE_MAX_LENGTH];
+    snprintf(line, sizeof(line), "{\"index\":%lu,", (unsigned long)endIndex);
+    TEST_ASSERT_TRUE(mock::mqttMessages().front().payload.rfind(line, 0) == 0);
+    TEST_ASSERT_TRUE(mock::mqttMessages().front().payload.find("\"raw_ir\":70000,") != std::string::npos);
+  }
+
+  // A download resumed from before the erase gets just the new readings
+  mock::bleClearNotifications();
+  TEST_ASSERT_TRUE(central.connect());
+  TEST_ASSERT_TRUE(central.subscribe(BLE_UUID_LOG_DATA));
+  startLogDownload(endIndex - 5);
+
+  bool isEnded = false;
+  start = millis();
+  while (!isEnded && millis() - start < 2000) {
+    delay(10);
+    isEnded = !mock::bleNotifications(BLE_UUID_LOG_DATA).empty() && mock::bleNotifications(BLE_UUID_LOG_DATA).back().value[4] == 0;
+  }
+  std::map<uint32_t, std::vector<LogRecord>> received;
+  TEST_ASSERT_TRUE(readLogChunks(received));
+  TEST_ASSERT_EQUAL(10, received.size());
+  for (auto &entry : received) {
+    TEST_ASSERT_EQUAL(1, entry.second.size());
+    TEST_ASSERT_EQUAL_UINT32(70000 + entry.first - endIndex, entry.second[0].rawIR);
+  }
+
+  TEST_ASSERT_TRUE(central.unsubscribe(BLE_UUID_LOG_DATA));
+}
+
+void test_disconnect_rejects_operations() {
+  TEST_ASSERT_TRUE(central.disconnect());
+  uint8_t brightness;
+  TEST_ASSERT_FALSE(central.read(BLE_UUID_LED_BRIGHTNESS, brightness));
+}
+
+int main(int argc, char **argv) {
+  mock::particleSensor().irLevel = IR_UNLOADED;
+  seedLegacySettings();
+  fuelGauge.set(MAX17043_VERSION, 0x0003);
+  fuelGauge.set(MAX17043_VCELL, BATTERY_VCELL);
+  fuelGauge.set(MAX17043_SOC, BATTERY_SOC);
+  mock::i2cDevice(MAX1704x_ADDRESS) = &fuelGauge;
+
+  std::thread([] {
+    setup();
+    for (;;) loop();
+  }).detach();
+
+  unsigned long start = millis();
+  while (!isBLEReady && millis() - start < 5000) delay(10);
+
+  UNITY_BEGIN();
+  RUN_TEST(test_services_are_advertised);
+  RUN_TEST(test_connect_publishes_state);
+  RUN_TEST(test_legacy_settings_are_migrated);
+  RUN_TEST(test_setting_write_round_trip);
+  RUN_TEST(test_setting_writes_are_coalesced);
+  RUN_TEST(test_corrupt_settings_record_is_rejected);
+  RUN_TEST(test_warm_boot_state_follows_commits);
+  RUN_TEST(test_settings_blob_rejects_bad_crc);
+  RUN_TEST(test_measurement_notify_rate);
+  RUN_TEST(test_notifications_follow_deadband);
+  RUN_TEST(test_connection_profile_follows_activity);
+  RUN_TEST(test_advertising_carries_locked_reading);
+  RUN_TEST(test_wifi_starts_on_demand);
+  RUN_TEST(test_only_flashing_stops_measuring);
+  RUN_TEST(test_live_events_stream_measurements);
+  RUN_TEST(test_log_export);
+  RUN_TEST(test_dashboard_is_served_gzipped);
+  RUN_TEST(test_metrics_are_exported);
+  RUN_TEST(test_fuel_gauge_never_blocks);
+  RUN_TEST(test_compressed_firmware_update);
+  RUN_TEST(test_mqtt_drains_offline_readings);
+  RUN_TEST(test_raw_stream_throughput);
+  RUN_TEST(test_log_download_resumes);
+  RUN_TEST(test_log_erase_keeps_indexes);
+  RUN_TEST(test_disconnect_rejects_operations);
+  int failures = UNITY_END();
+
+  // The firmware threads never return, so leave without unwinding them
+  fflush(stdout);
+  _Exit(failures);
+}
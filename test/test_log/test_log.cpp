@@ -0,0 +1,183 @@
+// Benchmarks the measurement log on a file backed fake flash.
+//
+// Only the log is brought up: LittleFS writes through to a temporary
+// directory, so a remount reads back what the previous "boot" left, and
+// records go straight to writeLogRecords() without the firmware's tasks.
+#include <unity.h>
+
+#include "../../src/hh_roast_meter_ble.cpp"
+
+#define BENCHMARK_RECORDS 40000
+#define BENCHMARK_SESSION_RECORDS 500
+#define BENCHMARK_START_TIME 1700000000UL
+#define QUERY_COUNT 1000
+
+char flashDirectory[] = "/tmp/hh_log_XXXXXX";
+
+// Record index gets session index / BENCHMARK_SESSION_RECORDS + 1 and a
+// synced timestamp one second after the previous record
+LogRecord benchmarkRecord(uint32_t index) {
+  LogRecord record;
+  record.timestamp = BENCHMARK_START_TIME + index;
+  record.rawIR = index;
+  record.agtron = index % 1000;
+  record.session = index / BENCHMARK_SESSION_RECORDS + 1;
+  record.profile = 0;
+  record.flags = LOG_FLAG_TIME_SYNCED;
+  record.crc = crc16((const uint8_t *)&record, offsetof(LogRecord, crc));
+  return record;
+}
+
+void printRate(const char *label, uint32_t count, unsigned long elapsedUs) {
+  char message[120];
+  snprintf(message, sizeof(message), "%s: %lu in %lums, %.0f/s", label, (unsigned long)count, elapsedUs / 1000, count * 1e6 / max(elapsedUs, 1UL));
+  TEST_MESSAGE(message);
+}
+
+void test_append_throughput() {
+  TEST_ASSERT_TRUE(isLogReady);
+  TEST_ASSERT_EQUAL_UINT32(0, logRecordCount);
+  LittleFS.resetStats();
+
+  unsigned long start = micros();
+  for (uint32_t index = 0; index < BENCHMARK_RECORDS; index++) {
+    LogRecord record = benchmarkRecord(index);
+    TEST_ASSERT_EQUAL_UINT32(1, writeLogRecords(&record, 1));
+  }
+  printRate("Appends", BENCHMARK_RECORDS, micros() - start);
+
+  fs::FileSystemStats stats = LittleFS.stats();
+  char message[120];
+  snprintf(message, sizeof(message), "Flash writes: %.1f bytes per %u byte record", (double)stats.bytesWritten / BENCHMARK_RECORDS, (unsigned)sizeof(LogRecord));
+  TEST_MESSAGE(message);
+
+  // Index rewrites are shared by a whole segment of appends
+  TEST_ASSERT_LESS_THAN(2 * sizeof(LogRecord) * BENCHMARK_RECORDS, stats.bytesWritten);
+
+  // Retention keeps the newest segments only
+  TEST_ASSERT_EQUAL_UINT32(BENCHMARK_RECORDS, logRecordCount);
+  TEST_ASSERT_EQUAL(LOG_MAX_SEGMENTS, logSegmentCount);
+  TEST_ASSERT_GREATER_THAN(0, logFirstIndex);
+  TEST_ASSERT_LESS_OR_EQUAL(LOG_MAX_SEGMENTS * LOG_SEGMENT_RECORDS, logRecordCount - logFirstIndex);
+}
+
+void test_boot_reads_index() {
+  uint32_t firstIndex = logFirstIndex;
+  uint32_t recordCount = logRecordCount;
+
+  LittleFS.mountDirectory(flashDirectory);
+  LittleFS.resetStats();
+
+  unsigned long start = micros();
+  setupLog();
+  unsigned long elapsedUs = micros() - start;
+
+  char message[80];
+  snprintf(message, sizeof(message), "Boot: %d segments in %luus", logSegmentCount, elapsedUs);
+  TEST_MESSAGE(message);
+
+  TEST_ASSERT_EQUAL_UINT32(firstIndex, logFirstIndex);
+  TEST_ASSERT_EQUAL_UINT32(recordCount, logRecordCount);
+  TEST_ASSERT_EQUAL_UINT16(benchmarkRecord(recordCount - 1).session + 1, logSession);
+
+  // The index and the newest, partly filled segment
+  TEST_ASSERT_LESS_OR_EQUAL(2, LittleFS.stats().opens);
+}
+
+void test_session_query() {
+  uint16_t firstSession = benchmarkRecord(logFirstIndex).session + 1;
+  uint16_t lastSession = benchmarkRecord(logRecordCount - 1).session - 1;
+
+  srand(1);
+  unsigned long start = micros();
+  for (int i = 0; i < QUERY_COUNT; i++) {
+    uint16_t session = firstSession + rand() % (lastSession - firstSession + 1);
+
+    uint32_t firstIndex, endIndex;
+    TEST_ASSERT_TRUE(findLogSession(session, firstIndex, endIndex));
+    TEST_ASSERT_EQUAL_UINT32((session - 1) * BENCHMARK_SESSION_RECORDS, firstIndex);
+    TEST_ASSERT_EQUAL_UINT32(session * BENCHMARK_SESSION_RECORDS, endIndex);
+  }
+  printRate("Session queries", QUERY_COUNT, micros() - start);
+
+  // Dropped with the oldest segments
+  uint32_t firstIndex, endIndex;
+  TEST_ASSERT_FALSE(findLogSession(0, firstIndex, endIndex));
+}
+
+void test_time_query() {
+  uint32_t retained = logRecordCount - logFirstIndex;
+
+  srand(2);
+  unsigned long start = micros();
+  for (int i = 0; i < QUERY_COUNT; i++) {
+    uint32_t fromIndex = logFirstIndex + rand() % retained;
+    uint32_t toIndex = min(fromIndex + 1 + rand() % 3600, logRecordCount);
+
+    uint32_t firstIndex, endIndex;
+    TEST_ASSERT_TRUE(findLogTime(BENCHMARK_START_TIME + fromIndex, BENCHMARK_START_TIME + toIndex, firstIndex, endIndex));
+    TEST_ASSERT_EQUAL_UINT32(fromIndex, firstIndex);
+    TEST_ASSERT_EQUAL_UINT32(toIndex, endIndex);
+  }
+  printRate("Time queries", QUERY_COUNT, micros() - start);
+}
+
+void test_read_round_trip() {
+  LogRecord records[LOG_DATA_MAX_LENGTH / sizeof(LogRecord)];
+
+  unsigned long start = micros();
+  uint32_t index = logFirstIndex;
+  while (index < logRecordCount) {
+    uint32_t count = readLogRecords(index, records, sizeof(records) / sizeof(LogRecord));
+    TEST_ASSERT_GREATER_THAN(0, count);
+
+    for (uint32_t i = 0; i < count; i++) {
+      TEST_ASSERT_EQUAL_UINT32(index + i, records[i].rawIR);
+      TEST_ASSERT_EQUAL_UINT16(crc16((const uint8_t *)&records[i], offsetof(LogRecord, crc)), records[i].crc);
+    }
+    index += count;
+  }
+  printRate("Reads", logRecordCount - logFirstIndex, micros() - start);
+}
+
+void test_erase_keeps_indexes() {
+  const uint32_t endIndex = logRecordCount;
+  eraseLog();
+  TEST_ASSERT_EQUAL_UINT32(endIndex, logFirstIndex);
+  TEST_ASSERT_EQUAL_UINT32(endIndex, logRecordCount);
+
+  LogRecord record;
+  TEST_ASSERT_EQUAL_UINT32(0, readLogRecords(endIndex - 1, &record, 1));
+
+  // The next boot carries on from there too
+  LittleFS.mountDirectory(flashDirectory);
+  setupLog();
+  TEST_ASSERT_EQUAL_UINT32(endIndex, logFirstIndex);
+  TEST_ASSERT_EQUAL_UINT32(endIndex, logRecordCount);
+
+  record = benchmarkRecord(endIndex);
+  TEST_ASSERT_EQUAL_UINT32(1, writeLogRecords(&record, 1));
+  TEST_ASSERT_EQUAL_UINT32(1, readLogRecords(endIndex, &record, 1));
+  TEST_ASSERT_EQUAL_UINT32(endIndex, record.rawIR);
+  TEST_ASSERT_EQUAL(1, logSegmentCount);
+}
+
+int main(int argc, char **argv) {
+  mkdtemp(flashDirectory);
+  LittleFS.mountDirectory(flashDirectory);
+  setupLog();
+
+  UNITY_BEGIN();
+  RUN_TEST(test_append_throughput);
+  RUN_TEST(test_boot_reads_index);
+  RUN_TEST(test_session_query);
+  RUN_TEST(test_time_query);
+  RUN_TEST(test_read_round_trip);
+  RUN_TEST(test_erase_keeps_indexes);
+  int failures = UNITY_END();
+
+  LittleFS.format();
+  rmdir((std::string(flashDirectory) + LOG_DIRECTORY).c_str());
+  rmdir(flashDirectory);
+  return failures;
+}
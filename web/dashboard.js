@@ -0,0 +1,127 @@
+// Live reading from /events, history from /log.ndjson and settings from
+// /settings. Event frames carry the BLE_UUID_MEASUREMENT layout.
+'use strict';
+
+const FRAME_HEADER_LENGTH = 2;
+const RECORD_LENGTH = 16;
+const AGTRON_SCALE = 100;
+const STATE_MEASURED = 3;
+const STATES = ['Starting', 'Warming up', 'Load a sample', 'Measuring'];
+const HISTORY_RECORDS = 200;
+const HISTORY_REFRESH_MS = 30000;
+
+// Name, label and input step of every field /settings takes
+const SETTINGS = [
+  ['bleName', 'Name', null],
+  ['ledBrightness', 'LED brightness', 1],
+  ['intersectionPoint', 'Intersection point', 1],
+  ['deviation', 'Deviation', 'any'],
+  ['coefficient0', 'Coefficient 0', 'any'],
+  ['coefficient1', 'Coefficient 1', 'any'],
+  ['coefficient2', 'Coefficient 2', 'any'],
+  ['coefficient3', 'Coefficient 3', 'any'],
+  ['irOffset', 'IR offset', 'any'],
+  ['agtronDeadband', 'Agtron deadband', 'any'],
+  ['irDeadband', 'IR deadband', 1],
+  ['notifyHeartbeat', 'Heartbeat (s)', 1],
+];
+
+const $ = (id) => document.getElementById(id);
+
+function decodeFrame(data) {
+  const bytes = Uint8Array.from(atob(data), (c) => c.charCodeAt(0));
+  const view = new DataView(bytes.buffer);
+  const records = [];
+  for (let i = 0; i < bytes[1]; i++) {
+    const offset = FRAME_HEADER_LENGTH + i * RECORD_LENGTH;
+    records.push({
+      rawIR: view.getUint32(offset + 8, true),
+      agtron: view.getInt16(offset + 12, true) / AGTRON_SCALE,
+      state: bytes[offset + 14],
+    });
+  }
+  return records;
+}
+
+function followEvents() {
+  const events = new EventSource('/events');
+  events.addEventListener('measurement', (event) => {
+    const records = decodeFrame(event.data);
+    if (records.length === 0) return;
+
+    const latest = records[records.length - 1];
+    $('agtron').textContent = latest.state === STATE_MEASURED ? latest.agtron.toFixed(1) : '--';
+    $('state').textContent = STATES[latest.state] || 'Unknown';
+  });
+  events.onerror = () => { $('state').textContent = 'Reconnecting'; };
+}
+
+function drawHistory(points) {
+  const canvas = $('history');
+  const ratio = window.devicePixelRatio || 1;
+  canvas.width = canvas.clientWidth * ratio;
+  canvas.height = canvas.clientHeight * ratio;
+
+  const context = canvas.getContext('2d');
+  context.clearRect(0, 0, canvas.width, canvas.height);
+  if (points.length < 2) return;
+
+  const lowest = Math.min(...points) - 1;
+  const highest = Math.max(...points) + 1;
+  const x = (i) => (i / (points.length - 1)) * canvas.width;
+  const y = (value) => canvas.height - ((value - lowest) / (highest - lowest)) * canvas.height;
+
+  context.strokeStyle = '#8b5a2b';
+  context.lineWidth = 2 * ratio;
+  context.beginPath();
+  points.forEach((value, i) => (i === 0 ? context.moveTo(x(i), y(value)) : context.lineTo(x(i), y(value))));
+  context.stroke();
+
+  context.fillStyle = '#7a6657';
+  context.font = `${12 * ratio}px system-ui`;
+  context.fillText(highest.toFixed(0), 4, 14 * ratio);
+  context.fillText(lowest.toFixed(0), 4, canvas.height - 4);
+}
+
+async function loadHistory() {
+  try {
+    const response = await fetch(`/log.ndjson?last=${HISTORY_RECORDS}`);
+    const text = await response.text();
+    drawHistory(text.split('\n').filter((line) => line).map((line) => JSON.parse(line).agtron));
+  } catch (error) {
+    // Kept until the next refresh
+  }
+}
+
+async function loadSettings() {
+  const settings = await (await fetch('/settings')).json();
+  $('name').textContent = settings.bleName;
+
+  const form = $('settings');
+  form.replaceChildren(...SETTINGS.map(([name, label, step]) => {
+    const input = document.createElement('input');
+    input.name = name;
+    input.value = settings[name];
+    if (step !== null) {
+      input.type = 'number';
+      input.step = step;
+    }
+
+    const row = document.createElement('label');
+    row.append(label, input);
+    return row;
+  }));
+}
+
+async function saveSettings(event) {
+  event.preventDefault();
+  const response = await fetch('/settings', { method: 'POST', body: new URLSearchParams(new FormData($('settings'))) });
+  $('saved').textContent = response.ok ? 'Saved' : await response.text();
+  if (response.ok) setTimeout(loadSettings, 500);
+}
+
+$('settings').addEventListener('submit', saveSettings);
+followEvents();
+loadHistory();
+setInterval(loadHistory, HISTORY_REFRESH_MS);
+loadSettings();